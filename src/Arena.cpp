@@ -0,0 +1,79 @@
+#include <common.h>
+#include <Arena.h>
+
+namespace Lspl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+const size_t CArena::MinBlockSize;
+const size_t CArena::MaxSmallSize;
+const size_t CArena::Alignment;
+thread_local CArena* CArena::current = nullptr;
+
+CArena::CScope::CScope( CArena& arena ) :
+	previous( current )
+{
+	current = &arena;
+}
+
+CArena::CScope::~CScope()
+{
+	current = previous;
+}
+
+CArena::CArena() :
+	free( nullptr ),
+	freeSize( 0 ),
+	size( 0 )
+{
+	freeLists.fill( nullptr );
+}
+
+void* CArena::Allocate( const size_t allocationSize )
+{
+	if( allocationSize > MaxSmallSize ) {
+		return ::operator new( allocationSize );
+	}
+	const size_t units = unitsOf( allocationSize );
+	CFreeNode*& freeList = freeLists[units];
+	if( freeList != nullptr ) {
+		CFreeNode* const node = freeList;
+		freeList = node->Next;
+		return node;
+	}
+
+	const size_t alignedSize = units * Alignment;
+	if( alignedSize > freeSize ) {
+		// blocks grow with the arena
+		const size_t blockSize = max( MinBlockSize, size );
+		blocks.emplace_back( new char[blockSize] );
+		free = blocks.back().get();
+		freeSize = blockSize;
+		size += blockSize;
+	}
+	void* const pointer = free;
+	free += alignedSize;
+	freeSize -= alignedSize;
+	return pointer;
+}
+
+void CArena::Free( void* pointer, const size_t allocationSize )
+{
+	if( allocationSize > MaxSmallSize ) {
+		::operator delete( pointer );
+		return;
+	}
+	const size_t units = unitsOf( allocationSize );
+	CFreeNode* const node = static_cast<CFreeNode*>( pointer );
+	node->Next = freeLists[units];
+	freeLists[units] = node;
+}
+
+size_t CArena::unitsOf( const size_t allocationSize )
+{
+	return max<size_t>( ( allocationSize + Alignment - 1 ) / Alignment, 1 );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Lspl namespace
@@ -0,0 +1,134 @@
+#pragma once
+
+namespace Lspl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Memory arena for many small short-lived objects: memory is allocated
+// from large blocks, freed memory is reused by allocations of the same size,
+// blocks are released only all at once by the destructor.
+// Large allocations are passed to the heap.
+class CArena {
+	CArena( const CArena& ) = delete;
+	CArena& operator=( const CArena& ) = delete;
+
+public:
+	// the arena is current for the thread while the scope exists
+	class CScope {
+		CScope( const CScope& ) = delete;
+		CScope& operator=( const CScope& ) = delete;
+
+	public:
+		explicit CScope( CArena& arena );
+		~CScope();
+
+	private:
+		CArena* const previous;
+	};
+
+	CArena();
+
+	void* Allocate( const size_t size );
+	void Free( void* pointer, const size_t size );
+	// number of bytes of all blocks
+	size_t Size() const { return size; }
+
+	// arena of the innermost scope of the thread or nullptr
+	static CArena* Current() { return current; }
+
+private:
+	static const size_t MinBlockSize = 64 * 1024;
+	static const size_t MaxSmallSize = 1024;
+	static const size_t Alignment = alignof( max_align_t );
+
+	struct CFreeNode {
+		CFreeNode* Next;
+	};
+
+	vector<unique_ptr<char[]>> blocks;
+	// lists of freed memory by size in units of Alignment
+	array<CFreeNode*, MaxSmallSize / Alignment + 1> freeLists;
+	char* free; // free memory of the last block
+	size_t freeSize;
+	size_t size;
+
+	static thread_local CArena* current;
+
+	// number of units of Alignment of an allocation, empty allocations
+	// take one unit so that they are distinct and can be freed
+	static size_t unitsOf( const size_t allocationSize );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Allocator of containers. Containers constructed while a scope exists
+// allocate from the arena of the scope, other ones use the heap.
+// Copies of containers allocate from the arena current at the copy.
+template<typename VALUE_TYPE>
+class CArenaAllocator {
+public:
+	typedef VALUE_TYPE value_type;
+	typedef true_type propagate_on_container_move_assignment;
+	typedef true_type propagate_on_container_swap;
+
+	CArenaAllocator() : arena( CArena::Current() ) {}
+	template<typename OTHER_TYPE>
+	CArenaAllocator( const CArenaAllocator<OTHER_TYPE>& other ) :
+		arena( other.Arena() )
+	{
+	}
+
+	CArena* Arena() const { return arena; }
+
+	VALUE_TYPE* allocate( const size_t count ) const;
+	void deallocate( VALUE_TYPE* pointer, const size_t count ) const;
+	CArenaAllocator select_on_container_copy_construction() const;
+
+private:
+	CArena* arena;
+};
+
+template<typename VALUE_TYPE>
+VALUE_TYPE* CArenaAllocator<VALUE_TYPE>::allocate( const size_t count ) const
+{
+	const size_t size = count * sizeof( VALUE_TYPE );
+	void* const pointer = ( arena != nullptr )
+		? arena->Allocate( size ) : ::operator new( size );
+	return static_cast<VALUE_TYPE*>( pointer );
+}
+
+template<typename VALUE_TYPE>
+void CArenaAllocator<VALUE_TYPE>::deallocate( VALUE_TYPE* pointer,
+	const size_t count ) const
+{
+	if( arena != nullptr ) {
+		arena->Free( pointer, count * sizeof( VALUE_TYPE ) );
+	} else {
+		::operator delete( pointer );
+	}
+}
+
+template<typename VALUE_TYPE>
+CArenaAllocator<VALUE_TYPE>
+CArenaAllocator<VALUE_TYPE>::select_on_container_copy_construction() const
+{
+	return CArenaAllocator();
+}
+
+template<typename TYPE1, typename TYPE2>
+inline bool operator==( const CArenaAllocator<TYPE1>& allocator1,
+	const CArenaAllocator<TYPE2>& allocator2 )
+{
+	return ( allocator1.Arena() == allocator2.Arena() );
+}
+
+template<typename TYPE1, typename TYPE2>
+inline bool operator!=( const CArenaAllocator<TYPE1>& allocator1,
+	const CArenaAllocator<TYPE2>& allocator2 )
+{
+	return !( allocator1 == allocator2 );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Lspl namespace
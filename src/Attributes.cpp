@@ -31,6 +31,19 @@ bool CAttributesRestriction::Check( const CAttributes& attributes ) const
 	return true;
 }
 
+string CAttributesRestriction::Key() const
+{
+	debug_check_logic( !IsEmpty() );
+	const CHeader* header = data.get();
+	while( header->Length != 0 ) {
+		const size_t valueSize = header->Wide ? sizeof( TWide ) : sizeof( TShort );
+		header = reinterpret_cast<const CHeader*>(
+			reinterpret_cast<const char*>( header + 1 ) + header->Length * valueSize );
+	}
+	const char* begin = reinterpret_cast<const char*>( data.get() );
+	return string( begin, reinterpret_cast<const char*>( header + 1 ) );
+}
+
 bool CAttributesRestriction::checkOne( const CAttributes& attributes,
 	const CHeader*& header )
 {
@@ -41,7 +41,8 @@ public:
 	void Set( const TAttribute attribute, const TAttributeValue value );
 
 private:
-	CFixedSizeArray<TAttributeValue, TAttribute> attributes;
+	// attributes of usual configurations are stored without allocations
+	CFixedSizeArray<TAttributeValue, TAttribute, 16> attributes;
 };
 
 inline const TAttributeValue CAttributes::Get( const TAttribute attribute ) const
@@ -64,6 +65,8 @@ public:
 	bool IsEmpty() const { return !static_cast<bool>( data ); }
 	void Empty() { data.reset( nullptr ); }
 	bool Check( const CAttributes& attributes ) const;
+	// bytes of the restriction, equal restrictions have equal keys
+	string Key() const;
 
 private:
 	typedef uint8_t TShort;
@@ -0,0 +1,151 @@
+#include <common.h>
+#include <Chart.h>
+
+using namespace Lspl::Text;
+
+namespace Lspl {
+namespace Pattern {
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Collects recognitions of the automaton of the referenced pattern
+class CSpanRecognitionsCollector : public IRecognitionCallback {
+public:
+	CSpanRecognitionsCollector( const CSpanAutomaton& automaton,
+		const TVariantSize maxSize, CSpanRecognitions& recognitions );
+
+	void OnRecognized( const TWordIndex begin, const TWordIndex end,
+		const CText& text, const CData& data,
+		const CVariantParts& parts ) override;
+
+private:
+	const CSpanAutomaton& automaton;
+	const TVariantSize maxSize;
+	CSpanRecognitions& recognitions;
+};
+
+CSpanRecognitionsCollector::CSpanRecognitionsCollector(
+		const CSpanAutomaton& _automaton, const TVariantSize _maxSize,
+		CSpanRecognitions& _recognitions ) :
+	automaton( _automaton ),
+	maxSize( _maxSize ),
+	recognitions( _recognitions )
+{
+}
+
+void CSpanRecognitionsCollector::OnRecognized(
+	const TWordIndex begin, const TWordIndex end,
+	const CText& /*text*/, const CData& data, const CVariantParts& parts )
+{
+	debug_check_logic( begin <= end );
+	if( end - begin >= maxSize ) {
+		return;
+	}
+
+	CSpanRecognition recognition;
+	recognition.End = end;
+	recognition.Head = MaxVariantSize;
+	recognition.Parts = parts;
+	recognition.Indices.reserve( data.size() );
+	for( const CEdges& edges : data ) {
+		recognition.Indices.push_back( edges.Indices );
+	}
+
+	// the head is the word of the argument at the top level of the pattern
+	if( automaton.HasHead ) {
+		size_t depth = 0;
+		TVariantSize word = 0;
+		for( const CBaseVariantPart* const part : parts ) {
+			if( part == nullptr ) {
+				depth--;
+			} else if( part->Type() == VPR_Instance ) {
+				depth++;
+			} else {
+				if( depth == 1 && part->Type() == VPR_Word
+					&& part->Word() == automaton.HeadElement )
+				{
+					recognition.Head = word;
+				}
+				word++;
+			}
+		}
+		check_logic( recognition.HasHead() );
+	}
+
+	recognitions.push_back( move( recognition ) );
+}
+
+} // end of anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+CChart::CChart( const CText& _text, const CSpanAutomata& _automata ) :
+	text( _text ),
+	automata( _automata ),
+	wordClasses( nullptr ),
+	computed( 0 )
+{
+}
+
+void CChart::SetWordClasses( const CWordClasses* _wordClasses )
+{
+	wordClasses = _wordClasses;
+	for( unique_ptr<CMatchContext>& context : contexts ) {
+		if( static_cast<bool>( context ) ) {
+			context->SetWordClasses( wordClasses );
+		}
+	}
+}
+
+const CSpanRecognitions& CChart::Recognitions( const TSpan span,
+	const TWordIndex begin )
+{
+	debug_check_logic( begin < text.Length() );
+	if( span >= indices.size() ) {
+		indices.resize( automata.Size() );
+		contexts.resize( automata.Size() );
+	}
+	debug_check_logic( span < indices.size() );
+	vector<unique_ptr<CPage>>& pages = indices[span];
+	const size_t page = begin / PageSize;
+	if( page >= pages.size() ) {
+		pages.resize( page + 1 );
+	}
+	if( !static_cast<bool>( pages[page] ) ) {
+		pages[page].reset( new CPage );
+		pages[page]->fill( 0 );
+	}
+	// pages are not moved by matching of nested spans
+	uint32_t& index = ( *pages[page] )[begin % PageSize];
+	if( index > 0 ) {
+		return ( index == 1 ) ? noRecognitions : entries[index - 2];
+	}
+
+	computed++;
+	const CSpanAutomaton& automaton = automata.Automaton( span );
+	if( !static_cast<bool>( contexts[span] ) ) {
+		contexts[span].reset( new CMatchContext( text, automaton.States ) );
+		contexts[span]->SetChart( this );
+		contexts[span]->SetWordClasses( wordClasses );
+	}
+	CSpanRecognitions recognitions;
+	CSpanRecognitionsCollector collector( automaton, MaxSize(), recognitions );
+	contexts[span]->SetRecognitionCallback( &collector );
+	contexts[span]->Match( begin );
+	contexts[span]->SetRecognitionCallback( nullptr );
+
+	if( recognitions.empty() ) {
+		index = 1;
+		return noRecognitions;
+	}
+	entries.push_back( move( recognitions ) );
+	index = Cast<uint32_t>( entries.size() + 1 );
+	return entries.back();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Pattern namespace
+} // end of Lspl namespace
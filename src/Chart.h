@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Pattern.h>
+#include <PatternMatch.h>
+
+namespace Lspl {
+namespace Pattern {
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Recognition of a referenced pattern from some word of the text.
+// Spans of nested patterns are already replaced with their words and parts.
+struct CSpanRecognition {
+	Text::TWordIndex End;
+	// offset of the head word (the argument of the pattern) from the beginning
+	TVariantSize Head;
+	// annotations of each word
+	vector<Text::CAnnotationIndices> Indices;
+	// parts of the recognition, the first one is the pattern
+	CVariantParts Parts;
+
+	bool HasHead() const { return ( Head != MaxVariantSize ); }
+};
+
+typedef vector<CSpanRecognition> CSpanRecognitions;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Recognitions of referenced patterns are computed once
+// per pattern and beginning word and reused by all enclosing patterns.
+class CChart {
+	CChart( const CChart& ) = delete;
+	CChart& operator=( const CChart& ) = delete;
+
+public:
+	CChart( const Text::CText& text, const CSpanAutomata& automata );
+
+	const Text::CText& Text() const { return text; }
+	const CSpanAutomata& Automata() const { return automata; }
+	// maximum number of words of a recognition
+	TVariantSize MaxSize() const { return automata.MaxSize(); }
+	// references to the recognitions are valid while the chart exists
+	const CSpanRecognitions& Recognitions( const TSpan span,
+		const Text::TWordIndex begin );
+	// number of computed entries
+	size_t Size() const { return computed; }
+	// classes are given to the match contexts of spans
+	void SetWordClasses( const CWordClasses* wordClasses );
+
+private:
+	const Text::CText& text;
+	const CSpanAutomata& automata;
+	const CWordClasses* wordClasses;
+	size_t computed;
+	// recognitions of computed entries which are not empty,
+	// addresses are stable
+	deque<CSpanRecognitions> entries;
+	const CSpanRecognitions noRecognitions;
+	// for each span and each word of the text index of the entry plus two,
+	// one if the entry is empty, zero if the entry was not computed yet;
+	// pages are allocated for the words the span is matched from
+	static const size_t PageSize = 1024;
+	typedef array<uint32_t, PageSize> CPage;
+	vector<vector<unique_ptr<CPage>>> indices;
+	// match contexts are reused, a span never matches itself recursively
+	vector<unique_ptr<CMatchContext>> contexts;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Pattern namespace
+} // end of Lspl namespace
@@ -74,13 +74,25 @@ const string& CWordAttribute::Name( const TAttributeNameIndex index ) const
 	return names[index];
 }
 
+// guards values of all string attributes
+static mutex stringValuesMutex;
+
+// values of other attributes are not changed after the configuration is built
+static unique_lock<mutex> lockValues( const TWordAttributeType type )
+{
+	return ( type == WAT_String ) ? unique_lock<mutex>( stringValuesMutex )
+		: unique_lock<mutex>();
+}
+
 const TAttributeValue CWordAttribute::ValuesCount() const
 {
+	const unique_lock<mutex> lock = lockValues( type );
 	return Cast<TAttributeValue>( values.size() );
 }
 
 const string& CWordAttribute::Value( const TAttributeValue index ) const
 {
+	const unique_lock<mutex> lock = lockValues( type );
 	debug_check_logic( index < values.size() );
 	return values[index];
 }
@@ -88,24 +100,23 @@ const string& CWordAttribute::Value( const TAttributeValue index ) const
 const bool CWordAttribute::FindValue( const string& value,
 	TAttributeValue& index ) const
 {
-	CValueIndices::const_iterator valueIterator;
-
 	if( type == WAT_String ) {
+		lock_guard<mutex> lock( stringValuesMutex );
 		const TAttributeValue valueIndex = Cast<TAttributeValue>( values.size() );
 		const auto pair = valueIndices.insert( make_pair( value, valueIndex ) );
-		valueIterator = pair.first;
 		if( pair.second ) {
 			values.push_back( value );
 		}
-	} else {
-		valueIterator = valueIndices.find( value );
+		index = pair.first->second;
+		return true;
 	}
 
-	if( valueIterator != valueIndices.cend() ) {
-		index = valueIterator->second;
-		return true;
+	const CValueIndices::const_iterator valueIterator = valueIndices.find( value );
+	if( valueIterator == valueIndices.cend() ) {
+		return false;
 	}
-	return false;
+	index = valueIterator->second;
+	return true;
 }
 
 void CWordAttribute::Print( ostream& out ) const
@@ -291,6 +302,11 @@ const CWordAttributes& CConfiguration::Attributes() const
 	return wordAttributes;
 }
 
+const CDictionaries& CConfiguration::Dictionaries() const
+{
+	return dictionaries;
+}
+
 bool CConfiguration::LoadFromFile( const char* filename,
 	ostream& out, ostream& err )
 {
@@ -385,6 +401,57 @@ bool CConfiguration::LoadFromFile( const char* filename,
 
 	debug_check_logic( Attributes()[0].Type() == WAT_Main );
 
+	if( configDocument.HasMember( "dictionaries" ) ) {
+		// files of dictionaries are relative to the configuration file
+		const string path = filename;
+		const size_t slash = path.find_last_of( "/\\" );
+		const string directory = ( slash == string::npos )
+			? "" : path.substr( 0, slash + 1 );
+
+		Value dictionaryArray = configDocument["dictionaries"].GetArray();
+		for( rapidjson::SizeType i = 0; i < dictionaryArray.Size(); i++ ) {
+			Value dictionaryObject = dictionaryArray[i].GetObject();
+			const string name = dictionaryObject["name"].GetString();
+			string file = dictionaryObject["file"].GetString();
+			if( !directory.empty() && file[0] != '/' ) {
+				file = directory + file;
+			}
+
+			TAttribute attribute = MainAttribute;
+			if( dictionaryObject.HasMember( "word_sign" ) ) {
+				const string signName = dictionaryObject["word_sign"].GetString();
+				if( !wordAttributes.Find( signName, attribute ) ) {
+					err << "Dictionary '" << name << "' word sign '"
+						<< signName << "' was not found" << endl;
+					return false;
+				}
+			} else if( !wordAttributes.FindDefault( attribute ) ) {
+				err << "Dictionary '" << name
+					<< "' requires word sign or default word sign" << endl;
+				return false;
+			}
+			if( wordAttributes[attribute].Type() != WAT_String ) {
+				err << "Dictionary '" << name
+					<< "' word sign must have string type" << endl;
+				return false;
+			}
+
+			out << "Loading dictionary '" << name
+				<< "' from file '" << file << "'..." << endl;
+			CDictionary dictionary( name, attribute );
+			if( !dictionary.LoadFromFile( file, err ) ) {
+				return false;
+			}
+			out << "  entries: " << dictionary.Size()
+				<< ", arguments: " << dictionary.Arguments()
+				<< ( dictionary.Mapped() ? ", mapped image" : "" ) << endl;
+			if( !dictionaries.Add( move( dictionary ) ) ) {
+				err << "Dictionary '" << name << "' redefinition" << endl;
+				return false;
+			}
+		}
+	}
+
 	out << endl;
 	Attributes().Print( out );
 	out << "Configuration was successfully initialized!" << endl << endl;
@@ -404,6 +471,10 @@ const char* JsonConfigurationSchemeText()
       \"type\": \"array\",                                                 \n\
       \"minItems\": 1,                                                     \n\
       \"items\": { \"$ref\": \"#/definitions/word_sign\" }                 \n\
+    },                                                                     \n\
+    \"dictionaries\": {                                                    \n\
+      \"type\": \"array\",                                                 \n\
+      \"items\": { \"$ref\": \"#/definitions/dictionary\" }                \n\
     }                                                                      \n\
   },                                                                       \n\
   \"required\": [\"word_signs\"],                                          \n\
@@ -459,6 +530,22 @@ const char* JsonConfigurationSchemeText()
       \"required\": [\"names\", \"type\"],                                 \n\
       \"additionalProperties\": false                                      \n\
     },                                                                     \n\
+    \"dictionary\": {                                                      \n\
+      \"type\": \"object\",                                                \n\
+      \"properties\": {                                                    \n\
+        \"name\": {                                                        \n\
+          \"type\": \"string\",                                            \n\
+          \"pattern\": \"^[a-zA-Z]([a-zA-Z0-9_-]*[a-zA-Z_-])?$\"           \n\
+        },                                                                 \n\
+        \"file\": {                                                        \n\
+          \"type\": \"string\",                                            \n\
+          \"minLength\": 1                                                 \n\
+        },                                                                 \n\
+        \"word_sign\": { \"type\": \"string\" }                            \n\
+      },                                                                   \n\
+      \"required\": [\"name\", \"file\"],                                  \n\
+      \"additionalProperties\": false                                      \n\
+    },                                                                     \n\
     \"string_array\": {                                                    \n\
       \"type\": \"array\",                                                 \n\
       \"minItems\": 1,                                                     \n\
@@ -2,16 +2,13 @@
 
 #include <OrderedList.h>
 #include <Attributes.h>
+#include <Dictionary.h>
 
 namespace Lspl {
 namespace Configuration {
 
 ///////////////////////////////////////////////////////////////////////////////
 
-typedef size_t TDictionary;
-
-///////////////////////////////////////////////////////////////////////////////
-
 enum TWordAttributeType {
 	WAT_Main,
 	WAT_Enum,
@@ -39,6 +36,9 @@ public:
 	const string& Name( const TAttributeNameIndex index ) const;
 	const Text::TAttributeValue ValuesCount() const;
 	const string& Value( const Text::TAttributeValue index ) const;
+	// unknown values of string attributes are added, values of string
+	// attributes are found, added and read under a lock, so texts may be
+	// loaded while other threads build and match patterns
 	const bool FindValue( const string& value,
 		Text::TAttributeValue& index ) const;
 	void Print( ostream& out ) const;
@@ -48,7 +48,8 @@ private:
 	bool agreement;
 	bool byDefault;
 	vector<string> names;
-	mutable vector<string> values;
+	// references to values stay valid when values are added
+	mutable deque<string> values;
 	typedef unordered_map<string, Text::TAttributeValue> CValueIndices;
 	mutable CValueIndices valueIndices;
 };
@@ -91,10 +92,12 @@ public:
 	CConfiguration() = default;
 
 	const CWordAttributes& Attributes() const;
+	const CDictionaries& Dictionaries() const;
 	bool LoadFromFile( const char* filename, ostream& out, ostream& err );
 
 private:
 	CWordAttributes wordAttributes;
+	CDictionaries dictionaries;
 };
 
 typedef shared_ptr<CConfiguration> CConfigurationPtr;
@@ -0,0 +1,223 @@
+#include <common.h>
+#include <CorpusGenerator.h>
+
+using namespace Lspl::Configuration;
+
+namespace Lspl {
+namespace Text {
+
+///////////////////////////////////////////////////////////////////////////////
+
+CCorpusParameters::CCorpusParameters() :
+	Words( 100000 ),
+	Lemmas( 10000 ),
+	Forms( 4 ),
+	MaxAnnotations( 4 ),
+	Ambiguity( 0.3 ),
+	Homonymy( 0.2 ),
+	ZipfExponent( 1.0 ),
+	Correlation( 0.5 ),
+	Seed( 1 )
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CCorpusGenerator::CCorpusGenerator( const CConfiguration& _configuration,
+		const CCorpusParameters& _parameters ) :
+	configuration( _configuration ),
+	parameters( _parameters ),
+	random( _parameters.Seed )
+{
+	check_logic( parameters.Lemmas > 0 );
+	check_logic( parameters.Forms > 0 );
+	check_logic( parameters.MaxAnnotations > 0 );
+	check_logic( parameters.MaxAnnotations <= MaxAnnotation );
+	check_logic( configuration.Attributes().Main().ValuesCount() > 1 );
+	generateDefinedAttributes();
+	generateLemmas();
+}
+
+void CCorpusGenerator::Generate( ostream& out, const TTextFileFormat format )
+{
+	vector<double> weights( lemmas.size() );
+	for( size_t li = 0; li < weights.size(); li++ ) {
+		weights[li] = 1.0 / pow( static_cast<double>( li + 1 ),
+			parameters.ZipfExponent );
+	}
+	discrete_distribution<size_t> lemmaDistribution( weights.cbegin(),
+		weights.cend() );
+
+	if( format == TFF_Json ) {
+		out << "{ \"text\": [";
+	}
+	string line;
+	const CForm* previous = nullptr;
+	for( size_t wi = 0; wi < parameters.Words; wi++ ) {
+		const CLemma& lemma = lemmas[lemmaDistribution( random )];
+		const CForm& form = selectForm( lemma, previous );
+		line.clear();
+		writeForm( lemma, form, format, wi == 0, line );
+		out.write( line.data(), line.size() );
+		previous = &form;
+	}
+	if( format == TFF_Json ) {
+		out << "\n] }\n";
+	}
+	out.flush();
+}
+
+void CCorpusGenerator::generateDefinedAttributes()
+{
+	const CWordAttributes& attributes = configuration.Attributes();
+	bernoulli_distribution definedDistribution( 0.5 );
+	definedAttributes.resize( attributes.Main().ValuesCount() );
+	for( vector<bool>& defined : definedAttributes ) {
+		defined.resize( attributes.Size(), false );
+		for( TAttribute a = 0; a < attributes.Size(); a++ ) {
+			defined[a] = attributes[a].Type() != WAT_Enum
+				|| definedDistribution( random );
+		}
+	}
+}
+
+void CCorpusGenerator::generateLemmas()
+{
+	const TAttributeValue mainValues =
+		configuration.Attributes().Main().ValuesCount();
+	uniform_int_distribution<TAttributeValue> mainDistribution( 1, mainValues - 1 );
+	bernoulli_distribution ambiguityDistribution( parameters.Ambiguity );
+	bernoulli_distribution homonymyDistribution( parameters.Homonymy );
+
+	lemmas.resize( parameters.Lemmas );
+	for( size_t li = 0; li < lemmas.size(); li++ ) {
+		CLemma& lemma = lemmas[li];
+		lemma.Text = lemmaText( li );
+		const TAttributeValue main = mainDistribution( random );
+		lemma.Forms.resize( parameters.Forms );
+		for( size_t fi = 0; fi < lemma.Forms.size(); fi++ ) {
+			CForm& form = lemma.Forms[fi];
+			// texts of lemmas have no '-', so forms of different lemmas differ
+			form.Text = lemma.Text + ( fi > 0 ? "-" + lemmaText( fi - 1 ) : "" );
+			form.Annotations.emplace_back();
+			generateAnnotation( main, form.Annotations.back() );
+			while( form.Annotations.size() < parameters.MaxAnnotations
+				&& ambiguityDistribution( random ) )
+			{
+				form.Annotations.emplace_back();
+				generateAnnotation( homonymyDistribution( random ) ?
+					mainDistribution( random ) : main, form.Annotations.back() );
+			}
+		}
+	}
+}
+
+void CCorpusGenerator::generateAnnotation( const TAttributeValue main,
+	CAnnotationValues& values )
+{
+	const CWordAttributes& attributes = configuration.Attributes();
+	values.assign( attributes.Size(), NullAttributeValue );
+	values[MainAttribute] = main;
+	for( TAttribute a = 1; a < attributes.Size(); a++ ) {
+		const CWordAttribute& attribute = attributes[a];
+		if( attribute.Type() == WAT_Enum && definedAttributes[main][a]
+			&& attribute.ValuesCount() > 1 )
+		{
+			uniform_int_distribution<TAttributeValue> distribution( 1,
+				attribute.ValuesCount() - 1 );
+			values[a] = distribution( random );
+		}
+	}
+}
+
+// Selects random form of the lemma, with probability of correlation
+// selects form which agrees with the previous word if there is such form.
+const CCorpusGenerator::CForm& CCorpusGenerator::selectForm(
+	const CLemma& lemma, const CForm* previous )
+{
+	uniform_int_distribution<size_t> formDistribution( 0, lemma.Forms.size() - 1 );
+	const size_t first = formDistribution( random );
+	bernoulli_distribution correlationDistribution( parameters.Correlation );
+	if( previous == nullptr || !correlationDistribution( random ) ) {
+		return lemma.Forms[first];
+	}
+
+	for( size_t i = 0; i < lemma.Forms.size(); i++ ) {
+		const CForm& form = lemma.Forms[( first + i ) % lemma.Forms.size()];
+		if( agree( form.Annotations.front(), previous->Annotations.front() ) ) {
+			return form;
+		}
+	}
+	return lemma.Forms[first];
+}
+
+bool CCorpusGenerator::agree( const CAnnotationValues& values1,
+	const CAnnotationValues& values2 ) const
+{
+	const CWordAttributes& attributes = configuration.Attributes();
+	size_t common = 0;
+	for( TAttribute a = 1; a < attributes.Size(); a++ ) {
+		if( attributes[a].Agreement()
+			&& values1[a] != NullAttributeValue
+			&& values2[a] != NullAttributeValue )
+		{
+			if( values1[a] != values2[a] ) {
+				return false;
+			}
+			common++;
+		}
+	}
+	return ( common > 0 );
+}
+
+// JSON: { "word":"form", "annotations" : [ { "sp":"N", "b":"lemma" } ] }
+// TSV: form<TAB>sp=N;b=lemma<TAB>sp=A;b=lemma
+void CCorpusGenerator::writeForm( const CLemma& lemma, const CForm& form,
+	const TTextFileFormat format, const bool first, string& line ) const
+{
+	const CWordAttributes& attributes = configuration.Attributes();
+	const bool json = ( format == TFF_Json );
+	if( json ) {
+		line += first ? "\n  { \"word\":\"" : ",\n  { \"word\":\"";
+		line += form.Text;
+		line += "\", \"annotations\" : [";
+	} else {
+		line += form.Text;
+	}
+
+	for( size_t ai = 0; ai < form.Annotations.size(); ai++ ) {
+		const CAnnotationValues& values = form.Annotations[ai];
+		line += json ? ( ai > 0 ? ", {" : " {" ) : "\t";
+		bool firstValue = true;
+		for( TAttribute a = 0; a < attributes.Size(); a++ ) {
+			const CWordAttribute& attribute = attributes[a];
+			const bool isString = ( attribute.Type() == WAT_String );
+			if( !isString && values[a] == NullAttributeValue ) {
+				continue;
+			}
+			line += json ? ( firstValue ? " \"" : ", \"" ) : ( firstValue ? "" : ";" );
+			line += attribute.Name( attribute.NamesCount() - 1 );
+			line += json ? "\":\"" : "=";
+			line += isString ? lemma.Text : attribute.Value( values[a] );
+			line += json ? "\"" : "";
+			firstValue = false;
+		}
+		line += json ? " }" : "";
+	}
+	line += json ? " ] }" : "\n";
+}
+
+string CCorpusGenerator::lemmaText( size_t index )
+{
+	string text;
+	do {
+		text += static_cast<char>( 'a' + index % 26 );
+		index /= 26;
+	} while( index > 0 );
+	return text;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Text namespace
+} // end of Lspl namespace
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Text.h>
+
+namespace Lspl {
+namespace Text {
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct CCorpusParameters {
+	size_t Words; // number of words in the text
+	size_t Lemmas; // size of the vocabulary
+	size_t Forms; // number of word forms of each lemma
+	size_t MaxAnnotations; // maximum number of annotations per word form
+	double Ambiguity; // probability of each additional annotation
+	double Homonymy; // probability of other speech part in additional annotation
+	double ZipfExponent; // exponent of Zipf's law of lemma frequencies
+	double Correlation; // probability of agreement with the previous word
+	uint32_t Seed;
+
+	CCorpusParameters();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Generates synthetic annotated text for the configuration.
+// Lemma frequencies follow Zipf's law, each lemma has a fixed set of
+// word forms, each word form has a fixed set of annotations.
+// Text is written word by word, so its size is not limited by memory.
+class CCorpusGenerator {
+	CCorpusGenerator( const CCorpusGenerator& ) = delete;
+	CCorpusGenerator& operator=( const CCorpusGenerator& ) = delete;
+
+public:
+	CCorpusGenerator( const Configuration::CConfiguration& configuration,
+		const CCorpusParameters& parameters );
+
+	// writes text in the format accepted by CText::LoadFromFile
+	void Generate( ostream& out, const TTextFileFormat format = TFF_Json );
+
+private:
+	// values of all attributes, string attributes are set to lemma
+	typedef vector<TAttributeValue> CAnnotationValues;
+	struct CForm {
+		string Text;
+		vector<CAnnotationValues> Annotations;
+	};
+	struct CLemma {
+		string Text;
+		vector<CForm> Forms;
+	};
+
+	const Configuration::CConfiguration& configuration;
+	const CCorpusParameters parameters;
+	mt19937 random;
+	vector<CLemma> lemmas;
+	// attributes which are defined for each value of main attribute
+	vector<vector<bool>> definedAttributes;
+
+	void generateDefinedAttributes();
+	void generateLemmas();
+	void generateAnnotation( const TAttributeValue main,
+		CAnnotationValues& values );
+	const CForm& selectForm( const CLemma& lemma, const CForm* previous );
+	bool agree( const CAnnotationValues& values1,
+		const CAnnotationValues& values2 ) const;
+	void writeForm( const CLemma& lemma, const CForm& form,
+		const TTextFileFormat format, const bool first, string& line ) const;
+	static string lemmaText( size_t index );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Text namespace
+} // end of Lspl namespace
@@ -0,0 +1,567 @@
+#include <common.h>
+#include <Dictionary.h>
+#include <Configuration.h>
+
+using namespace Lspl::Text;
+
+namespace Lspl {
+namespace Configuration {
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Image is a sequence of sections aligned to 8 bytes in native byte order:
+// header, transition cells, bitset of final nodes, token hash slots,
+// offsets of tokens in the pool, pool of token strings.
+struct CDictionary::CHeader {
+	char Magic[8];
+	uint32_t ByteOrder;
+	uint32_t Version;
+	uint32_t Arguments;
+	uint32_t Entries;
+	uint32_t Tokens;
+	uint32_t Nodes;
+	uint32_t CellsSize; // power of two
+	uint32_t TokenSlotsSize; // power of two
+	uint32_t PoolSize;
+	uint32_t Reserved;
+};
+
+struct CDictionary::CCell {
+	uint64_t Key; // parent node and token, EmptyKey if the cell is empty
+	TNode Child;
+	uint32_t Reserved;
+};
+
+namespace {
+
+const char ImageMagic[8] = { 'L', 'S', 'P', 'L', 'D', 'I', 'C', 'T' };
+const uint32_t ImageByteOrder = 0x01020304;
+const uint32_t ImageVersion = 1;
+const uint64_t EmptyKey = numeric_limits<uint64_t>::max();
+
+inline uint64_t TransitionKey( const uint32_t node, const uint32_t token )
+{
+	return ( ( static_cast<uint64_t>( node ) << 32 ) | token );
+}
+
+// finalizer of MurmurHash3
+inline uint64_t HashKey( uint64_t key )
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+// FNV-1a, images do not depend on the standard library
+inline uint64_t HashWord( const char* word, const size_t length )
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for( size_t i = 0; i < length; i++ ) {
+		hash ^= static_cast<unsigned char>( word[i] );
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+// minimal power of two which is at least twice greater than the count
+inline size_t HashTableSize( const size_t count )
+{
+	size_t size = 1;
+	while( size < count * 2 ) {
+		size *= 2;
+	}
+	return size;
+}
+
+inline size_t Aligned( const size_t size )
+{
+	return ( ( size + sizeof( uint64_t ) - 1 ) & ~( sizeof( uint64_t ) - 1 ) );
+}
+
+} // end of anonymous namespace
+
+// offsets of sections in the image
+struct CDictionary::CLayout {
+	size_t Cells;
+	size_t Finals;
+	size_t TokenSlots;
+	size_t TokenOffsets;
+	size_t Pool;
+	size_t Size;
+
+	explicit CLayout( const CHeader& header )
+	{
+		Cells = Aligned( sizeof( CHeader ) );
+		Finals = Cells + Aligned( header.CellsSize * sizeof( CCell ) );
+		TokenSlots = Finals + Aligned( ( static_cast<size_t>( header.Nodes ) + 63 ) / 64 * sizeof( uint64_t ) );
+		TokenOffsets = TokenSlots + Aligned( header.TokenSlotsSize * sizeof( uint32_t ) );
+		Pool = TokenOffsets + Aligned( ( static_cast<size_t>( header.Tokens ) + 1 ) * sizeof( uint32_t ) );
+		Size = Pool + Aligned( header.PoolSize );
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Lazily filled tokens of values of the attribute of a dictionary.
+// Cells are atomic and pages are never freed, since values of attributes
+// are never removed, so several threads may find tokens at once.
+struct CDictionary::CValueTokens {
+	// KnownCell | token (Separator if the dictionary has no such word),
+	// 0 if the token is unknown
+	typedef uint64_t TCell;
+	static const TCell KnownCell = TCell( 1 ) << 32;
+	static const size_t PageSize = 1024;
+	// tokens of other values are found every time
+	static const size_t MaxPages = 4096;
+	struct CPage {
+		atomic<TCell> Cells[PageSize];
+	};
+
+	atomic<CPage*> Pages[MaxPages];
+
+	CValueTokens();
+	~CValueTokens();
+	atomic<TCell>& Cell( const TAttributeValue value );
+};
+
+const CDictionary::CValueTokens::TCell CDictionary::CValueTokens::KnownCell;
+const size_t CDictionary::CValueTokens::PageSize;
+const size_t CDictionary::CValueTokens::MaxPages;
+
+CDictionary::CValueTokens::CValueTokens()
+{
+	for( atomic<CPage*>& page : Pages ) {
+		page.store( nullptr, memory_order_relaxed );
+	}
+}
+
+CDictionary::CValueTokens::~CValueTokens()
+{
+	for( atomic<CPage*>& page : Pages ) {
+		delete page.load( memory_order_relaxed );
+	}
+}
+
+atomic<CDictionary::CValueTokens::TCell>& CDictionary::CValueTokens::Cell(
+	const TAttributeValue value )
+{
+	debug_check_logic( value < MaxPages * PageSize );
+	atomic<CPage*>& pagePtr = Pages[value / PageSize];
+	CPage* page = pagePtr.load( memory_order_acquire );
+	if( page == nullptr ) {
+		CPage* newPage = new CPage;
+		for( atomic<TCell>& cell : newPage->Cells ) {
+			cell.store( 0, memory_order_relaxed );
+		}
+		if( pagePtr.compare_exchange_strong( page, newPage,
+			memory_order_acq_rel ) )
+		{
+			page = newPage;
+		} else {
+			delete newPage; // added by another thread
+		}
+	}
+	return page->Cells[value % PageSize];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const CDictionary::TNode CDictionary::RootNode;
+const CDictionary::TToken CDictionary::Separator;
+
+CDictionary::CDictionary( const string& _name, const TAttribute _attribute ) :
+	name( _name ),
+	attribute( _attribute ),
+	header( nullptr ),
+	cells( nullptr ),
+	finals( nullptr ),
+	tokenSlots( nullptr ),
+	tokenOffsets( nullptr ),
+	pool( nullptr ),
+	valueTokens( new CValueTokens )
+{
+	debug_check_logic( !name.empty() );
+}
+
+CDictionary::CDictionary( CDictionary&& ) = default;
+CDictionary& CDictionary::operator=( CDictionary&& ) = default;
+CDictionary::~CDictionary() = default;
+
+bool CDictionary::LoadFromFile( const string& filename, ostream& err )
+{
+	unique_ptr<CMappedFile> mapped( new CMappedFile );
+	if( !mapped->Open( filename ) ) {
+		err << "Cannot open dictionary '" << name
+			<< "' file '" << filename << "'" << endl;
+		return false;
+	}
+
+	if( IsImage( mapped->Data(), mapped->Size() ) ) {
+		if( !attach( mapped->Data(), mapped->Size() ) ) {
+			err << "Dictionary '" << name << "' file '" << filename
+				<< "' is not a valid dictionary image" << endl;
+			return false;
+		}
+		file = move( mapped );
+		return true;
+	}
+
+	mapped.reset();
+	if( !Compile( filename, buffer, err ) ) {
+		return false;
+	}
+	const bool attached = attach( reinterpret_cast<const char*>( buffer.data() ),
+		buffer.size() * sizeof( uint64_t ) );
+	debug_check_logic( attached );
+	return attached;
+}
+
+bool CDictionary::IsImage( const char* data, const size_t size )
+{
+	return ( size >= sizeof( CHeader )
+		&& equal( ImageMagic, ImageMagic + sizeof( ImageMagic ), data ) );
+}
+
+bool CDictionary::Compile( const string& sourceFilename,
+	vector<uint64_t>& image, ostream& err )
+{
+	ifstream source( sourceFilename );
+	if( !source.good() ) {
+		err << "Cannot open dictionary source file '"
+			<< sourceFilename << "'" << endl;
+		return false;
+	}
+
+	unordered_map<string, TToken> tokenIndices;
+	vector<const string*> tokens;
+	unordered_map<uint64_t, TNode> transitions;
+	vector<bool> nodeFinals( 1, false ); // root
+	size_t arguments = 0;
+	size_t entries = 0;
+
+	const auto addTransition = [&]( const TNode node, const TToken token ) -> TNode
+	{
+		const TNode newNode = Cast<TNode>( nodeFinals.size() );
+		auto pair = transitions.insert(
+			make_pair( TransitionKey( node, token ), newNode ) );
+		if( pair.second ) {
+			nodeFinals.push_back( false );
+		}
+		return pair.first->second;
+	};
+
+	string line;
+	for( size_t lineNumber = 1; getline( source, line ); lineNumber++ ) {
+		if( !line.empty() && line.back() == '\r' ) {
+			line.pop_back();
+		}
+		if( line.empty() || line[0] == '#' ) {
+			continue;
+		}
+
+		TNode node = RootNode;
+		size_t lineArguments = 0;
+		istringstream lineStream( line );
+		string argument;
+		while( getline( lineStream, argument, '\t' ) ) {
+			if( lineArguments > 0 ) {
+				node = addTransition( node, Separator );
+			}
+			lineArguments++;
+
+			istringstream argumentStream( argument );
+			string word;
+			size_t words = 0;
+			while( argumentStream >> word ) {
+				auto pair = tokenIndices.insert(
+					make_pair( word, Cast<TToken>( tokens.size() ) ) );
+				if( pair.second ) {
+					tokens.push_back( &pair.first->first );
+				}
+				node = addTransition( node, pair.first->second );
+				words++;
+			}
+			if( words == 0 ) {
+				err << sourceFilename << ":" << lineNumber
+					<< ": empty argument of dictionary entry" << endl;
+				return false;
+			}
+		}
+
+		if( arguments == 0 ) {
+			arguments = lineArguments;
+		} else if( arguments != lineArguments ) {
+			err << sourceFilename << ":" << lineNumber
+				<< ": dictionary entry must have " << arguments
+				<< " arguments" << endl;
+			return false;
+		}
+		if( !nodeFinals[node] ) {
+			nodeFinals[node] = true;
+			entries++;
+		}
+	}
+
+	if( entries == 0 ) {
+		err << "Dictionary source file '" << sourceFilename
+			<< "' has no entries" << endl;
+		return false;
+	}
+
+	size_t poolSize = 0;
+	for( const string* token : tokens ) {
+		poolSize += token->length();
+	}
+	if( nodeFinals.size() >= numeric_limits<uint32_t>::max()
+		|| poolSize >= numeric_limits<uint32_t>::max() )
+	{
+		err << "Dictionary source file '" << sourceFilename
+			<< "' is too large" << endl;
+		return false;
+	}
+
+	CHeader header;
+	copy( ImageMagic, ImageMagic + sizeof( ImageMagic ), header.Magic );
+	header.ByteOrder = ImageByteOrder;
+	header.Version = ImageVersion;
+	header.Arguments = Cast<uint32_t>( arguments );
+	header.Entries = Cast<uint32_t>( entries );
+	header.Tokens = Cast<uint32_t>( tokens.size() );
+	header.Nodes = Cast<uint32_t>( nodeFinals.size() );
+	header.CellsSize = Cast<uint32_t>( HashTableSize( transitions.size() ) );
+	header.TokenSlotsSize = Cast<uint32_t>( HashTableSize( tokens.size() ) );
+	header.PoolSize = Cast<uint32_t>( poolSize );
+	header.Reserved = 0;
+
+	const CLayout layout( header );
+	image.assign( layout.Size / sizeof( uint64_t ), 0 );
+	char* data = reinterpret_cast<char*>( image.data() );
+	*reinterpret_cast<CHeader*>( data ) = header;
+
+	CCell* imageCells = reinterpret_cast<CCell*>( data + layout.Cells );
+	fill( imageCells, imageCells + header.CellsSize, CCell{ EmptyKey, RootNode, 0 } );
+	const size_t cellMask = header.CellsSize - 1;
+	for( const pair<const uint64_t, TNode>& transition : transitions ) {
+		size_t i = HashKey( transition.first ) & cellMask;
+		while( imageCells[i].Key != EmptyKey ) {
+			i = ( i + 1 ) & cellMask;
+		}
+		imageCells[i].Key = transition.first;
+		imageCells[i].Child = transition.second;
+	}
+
+	uint64_t* imageFinals = reinterpret_cast<uint64_t*>( data + layout.Finals );
+	for( size_t node = 0; node < nodeFinals.size(); node++ ) {
+		if( nodeFinals[node] ) {
+			imageFinals[node / 64] |= ( uint64_t( 1 ) << ( node % 64 ) );
+		}
+	}
+
+	uint32_t* imageSlots = reinterpret_cast<uint32_t*>( data + layout.TokenSlots );
+	uint32_t* imageOffsets = reinterpret_cast<uint32_t*>( data + layout.TokenOffsets );
+	char* imagePool = data + layout.Pool;
+	const size_t slotMask = header.TokenSlotsSize - 1;
+	uint32_t offset = 0;
+	for( TToken token = 0; token < tokens.size(); token++ ) {
+		const string& word = *tokens[token];
+		size_t i = HashWord( word.data(), word.length() ) & slotMask;
+		while( imageSlots[i] != 0 ) {
+			i = ( i + 1 ) & slotMask;
+		}
+		imageSlots[i] = token + 1;
+		imageOffsets[token] = offset;
+		copy( word.cbegin(), word.cend(), imagePool + offset );
+		offset += Cast<uint32_t>( word.length() );
+	}
+	imageOffsets[tokens.size()] = offset;
+	return true;
+}
+
+size_t CDictionary::Arguments() const
+{
+	debug_check_logic( header != nullptr );
+	return header->Arguments;
+}
+
+size_t CDictionary::Size() const
+{
+	debug_check_logic( header != nullptr );
+	return header->Entries;
+}
+
+size_t CDictionary::Nodes() const
+{
+	debug_check_logic( header != nullptr );
+	return header->Nodes;
+}
+
+size_t CDictionary::Tokens() const
+{
+	debug_check_logic( header != nullptr );
+	return header->Tokens;
+}
+
+bool CDictionary::FindToken( const string& word, TToken& token ) const
+{
+	const size_t mask = header->TokenSlotsSize - 1;
+	for( size_t i = HashWord( word.data(), word.length() ) & mask;
+		tokenSlots[i] != 0; i = ( i + 1 ) & mask )
+	{
+		const TToken candidate = tokenSlots[i] - 1;
+		const uint32_t begin = tokenOffsets[candidate];
+		const uint32_t length = tokenOffsets[candidate + 1] - begin;
+		if( length == word.length()
+			&& word.compare( 0, length, pool + begin, length ) == 0 )
+		{
+			token = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CDictionary::FindToken( const CWordAttribute& wordAttribute,
+	const TAttributeValue value, TToken& token ) const
+{
+	if( value >= CValueTokens::MaxPages * CValueTokens::PageSize ) {
+		return FindToken( wordAttribute.Value( value ), token );
+	}
+
+	atomic<CValueTokens::TCell>& cell = valueTokens->Cell( value );
+	const CValueTokens::TCell known = cell.load( memory_order_relaxed );
+	if( known != 0 ) {
+		token = static_cast<TToken>( known );
+		return ( token != Separator );
+	}
+
+	token = Separator;
+	const bool found = FindToken( wordAttribute.Value( value ), token );
+	cell.store( CValueTokens::KnownCell | token, memory_order_relaxed );
+	return found;
+}
+
+bool CDictionary::Next( const TNode node, const TToken token,
+	TNode& next ) const
+{
+	const uint64_t key = TransitionKey( node, token );
+	const size_t mask = header->CellsSize - 1;
+	for( size_t i = HashKey( key ) & mask; cells[i].Key != EmptyKey;
+		i = ( i + 1 ) & mask )
+	{
+		if( cells[i].Key == key ) {
+			next = cells[i].Child;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CDictionary::IsFinal( const TNode node ) const
+{
+	debug_check_logic( node < header->Nodes );
+	return ( ( finals[node / 64] >> ( node % 64 ) ) & 1 ) != 0;
+}
+
+bool CDictionary::attach( const char* data, const size_t size )
+{
+	if( !IsImage( data, size )
+		|| reinterpret_cast<uintptr_t>( data ) % sizeof( uint64_t ) != 0 )
+	{
+		return false;
+	}
+	const CHeader& imageHeader = *reinterpret_cast<const CHeader*>( data );
+	if( imageHeader.ByteOrder != ImageByteOrder
+		|| imageHeader.Version != ImageVersion
+		|| imageHeader.Nodes == 0
+		|| imageHeader.CellsSize == 0
+		|| ( imageHeader.CellsSize & ( imageHeader.CellsSize - 1 ) ) != 0
+		|| imageHeader.TokenSlotsSize == 0
+		|| ( imageHeader.TokenSlotsSize & ( imageHeader.TokenSlotsSize - 1 ) ) != 0 )
+	{
+		return false;
+	}
+	const CLayout layout( imageHeader );
+	if( layout.Size != size ) {
+		return false;
+	}
+
+	// lookups probe tables until an empty slot and follow children,
+	// tokens and offsets without checks, so they are checked once here
+	const CCell* imageCells = reinterpret_cast<const CCell*>( data + layout.Cells );
+	bool hasEmptyCell = false;
+	for( size_t i = 0; i < imageHeader.CellsSize; i++ ) {
+		if( imageCells[i].Key == EmptyKey ) {
+			hasEmptyCell = true;
+		} else if( imageCells[i].Child >= imageHeader.Nodes ) {
+			return false;
+		}
+	}
+	const uint32_t* slots
+		= reinterpret_cast<const uint32_t*>( data + layout.TokenSlots );
+	bool hasEmptySlot = false;
+	for( size_t i = 0; i < imageHeader.TokenSlotsSize; i++ ) {
+		if( slots[i] == 0 ) {
+			hasEmptySlot = true;
+		} else if( slots[i] > imageHeader.Tokens ) {
+			return false;
+		}
+	}
+	if( !hasEmptyCell || !hasEmptySlot ) {
+		return false;
+	}
+	const uint32_t* offsets
+		= reinterpret_cast<const uint32_t*>( data + layout.TokenOffsets );
+	for( size_t token = 0; token < imageHeader.Tokens; token++ ) {
+		if( offsets[token] > offsets[token + 1] ) {
+			return false;
+		}
+	}
+	if( offsets[imageHeader.Tokens] != imageHeader.PoolSize ) {
+		return false;
+	}
+
+	header = &imageHeader;
+	cells = reinterpret_cast<const CCell*>( data + layout.Cells );
+	finals = reinterpret_cast<const uint64_t*>( data + layout.Finals );
+	tokenSlots = reinterpret_cast<const uint32_t*>( data + layout.TokenSlots );
+	tokenOffsets = reinterpret_cast<const uint32_t*>( data + layout.TokenOffsets );
+	pool = data + layout.Pool;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool CDictionaries::Add( CDictionary&& dictionary )
+{
+	const auto pair = nameIndices.insert(
+		make_pair( dictionary.Name(), data.size() ) );
+	if( !pair.second ) {
+		return false;
+	}
+	data.emplace_back( move( dictionary ) );
+	return true;
+}
+
+const CDictionary& CDictionaries::operator[]( const TDictionary index ) const
+{
+	debug_check_logic( index < data.size() );
+	return data[index];
+}
+
+bool CDictionaries::Find( const string& name, TDictionary& index ) const
+{
+	auto i = nameIndices.find( name );
+	if( i == nameIndices.cend() ) {
+		return false;
+	}
+	index = i->second;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Configuration namespace
+} // end of Lspl namespace
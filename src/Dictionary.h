@@ -0,0 +1,110 @@
+#pragma once
+
+#include <Attributes.h>
+#include <MappedFile.h>
+
+namespace Lspl {
+namespace Configuration {
+
+typedef size_t TDictionary;
+
+class CWordAttribute;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Immutable trie over sequences of words (usually lemmas) stored in
+// a binary image: words are interned as tokens, a transition is one lookup
+// in a flat open addressing hash table keyed by the node and the token.
+// The image is either memory mapped from a file compiled by Compile
+// or compiled in memory from a source file.
+class CDictionary {
+	CDictionary( const CDictionary& ) = delete;
+	CDictionary& operator=( const CDictionary& ) = delete;
+
+public:
+	typedef uint32_t TNode;
+	typedef uint32_t TToken;
+	static const TNode RootNode = 0;
+	// token which separates arguments of an entry
+	static const TToken Separator = numeric_limits<TToken>::max();
+
+	CDictionary( const string& name, const Text::TAttribute attribute );
+	CDictionary( CDictionary&& );
+	CDictionary& operator=( CDictionary&& );
+	~CDictionary();
+
+	// maps a compiled image or compiles a source file
+	bool LoadFromFile( const string& filename, ostream& err );
+	// source has an entry per line: arguments are separated by tabs,
+	// words of an argument are separated by spaces
+	static bool Compile( const string& sourceFilename,
+		vector<uint64_t>& image, ostream& err );
+	static bool IsImage( const char* data, const size_t size );
+
+	const string& Name() const { return name; }
+	// string attribute compared with words of entries
+	Text::TAttribute Attribute() const { return attribute; }
+	// number of arguments of each entry
+	size_t Arguments() const;
+	size_t Size() const;
+	// nodes of the trie are 0 .. Nodes() - 1, tokens are 0 .. Tokens() - 1
+	size_t Nodes() const;
+	size_t Tokens() const;
+	bool Mapped() const { return static_cast<bool>( file ); }
+
+	bool FindToken( const string& word, TToken& token ) const;
+	// token of the value of the attribute of the dictionary,
+	// tokens of values are found once and kept in a table
+	bool FindToken( const CWordAttribute& wordAttribute,
+		const Text::TAttributeValue value, TToken& token ) const;
+	bool Next( const TNode node, const TToken token, TNode& next ) const;
+	bool IsFinal( const TNode node ) const;
+
+private:
+	struct CHeader;
+	struct CCell;
+	struct CLayout;
+
+	string name;
+	Text::TAttribute attribute;
+	unique_ptr<CMappedFile> file;
+	vector<uint64_t> buffer; // image compiled in memory
+	const CHeader* header;
+	const CCell* cells;
+	const uint64_t* finals;
+	const uint32_t* tokenSlots; // token + 1 or 0 if the slot is empty
+	const uint32_t* tokenOffsets;
+	const char* pool;
+	struct CValueTokens;
+	unique_ptr<CValueTokens> valueTokens;
+
+	bool attach( const char* data, const size_t size );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+class CDictionaries {
+	CDictionaries( const CDictionaries& ) = delete;
+	CDictionaries& operator=( const CDictionaries& ) = delete;
+
+public:
+	CDictionaries() = default;
+	CDictionaries( CDictionaries&& ) = default;
+	CDictionaries& operator=( CDictionaries&& ) = default;
+
+	// returns false if a dictionary with the same name exists
+	bool Add( CDictionary&& dictionary );
+
+	TDictionary Size() const { return data.size(); }
+	const CDictionary& operator[]( const TDictionary index ) const;
+	bool Find( const string& name, TDictionary& index ) const;
+
+private:
+	vector<CDictionary> data;
+	unordered_map<string, TDictionary> nameIndices;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Configuration namespace
+} // end of Lspl namespace
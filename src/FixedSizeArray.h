@@ -4,7 +4,9 @@ namespace Lspl {
 
 ///////////////////////////////////////////////////////////////////////////////
 
-template<typename VALUE_TYPE, typename SIZE_TYPE>
+// Array of a size fixed on construction. Arrays of at most INLINE_SIZE values
+// are stored in the object itself, larger arrays are allocated on the heap.
+template<typename VALUE_TYPE, typename SIZE_TYPE, size_t INLINE_SIZE = 0>
 class CFixedSizeArray {
 public:
 	typedef VALUE_TYPE ValueType;
@@ -12,46 +14,55 @@ public:
 
 	explicit CFixedSizeArray( const SizeType _size = 0 ) :
 		size( 0 ),
-		values( nullptr )
+		values( inlineValues )
 	{
-		if( _size > 0 ) {
-			size = _size;
-			values = new ValueType[size];
-			check_logic( values != nullptr );
-		}
+		allocate( _size );
 	}
 
-	CFixedSizeArray( const CFixedSizeArray& another )
+	CFixedSizeArray( const CFixedSizeArray& another ) :
+		size( 0 ),
+		values( inlineValues )
 	{
 		*this = another;
 	}
 
 	CFixedSizeArray& operator=( const CFixedSizeArray& another )
 	{
-		ValueType* tmp = new ValueType[another.size];
-		check_logic( tmp != nullptr );
-		for( SizeType i = 0; i < another.size; i++ ) {
-			new( tmp + i )ValueType( another.values[i] );
+		if( this != &another ) {
+			allocate( another.size );
+			copy( another.values, another.values + size, values );
 		}
-		values = tmp;
-		size = another.size;
 		return *this;
 	}
 
-	CFixedSizeArray( CFixedSizeArray&& another )
+	CFixedSizeArray( CFixedSizeArray&& another ) :
+		size( 0 ),
+		values( inlineValues )
 	{
 		*this = move( another );
 	}
 
 	CFixedSizeArray& operator=( CFixedSizeArray&& another )
 	{
-		values = another.values;
-		another.values = nullptr;
-		size = another.size;
-		another.size = 0;
+		if( this != &another ) {
+			if( another.isInline() ) {
+				*this = static_cast<const CFixedSizeArray&>( another );
+			} else {
+				deallocate();
+				values = another.values;
+				size = another.size;
+				another.values = another.inlineValues;
+			}
+			another.size = 0;
+		}
 		return *this;
 	}
 
+	~CFixedSizeArray()
+	{
+		deallocate();
+	}
+
 	const SizeType Size() const { return size; }
 	const ValueType& operator[]( const SizeType index ) const
 	{
@@ -65,10 +76,41 @@ public:
 	}
 
 private:
+	// zero length arrays are not allowed
+	static const size_t InlineSize = INLINE_SIZE > 0 ? INLINE_SIZE : 1;
+
 	SizeType size;
-	ValueType* values;
+	ValueType* values; // inlineValues or heap array
+	ValueType inlineValues[InlineSize];
+
+	bool isInline() const { return ( values == inlineValues ); }
+
+	// previous values are lost
+	void allocate( const SizeType newSize )
+	{
+		if( newSize == size ) {
+			return;
+		}
+		deallocate();
+		if( newSize > INLINE_SIZE ) {
+			values = new ValueType[newSize];
+		}
+		size = newSize;
+	}
+
+	void deallocate()
+	{
+		if( !isInline() ) {
+			delete[] values;
+			values = inlineValues;
+		}
+		size = 0;
+	}
 };
 
+template<typename VALUE_TYPE, typename SIZE_TYPE, size_t INLINE_SIZE>
+const size_t CFixedSizeArray<VALUE_TYPE, SIZE_TYPE, INLINE_SIZE>::InlineSize;
+
 ///////////////////////////////////////////////////////////////////////////////
 
 } // end of Lspl namespace
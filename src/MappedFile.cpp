@@ -0,0 +1,117 @@
+#include <common.h>
+#include <MappedFile.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace Lspl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+CMappedFile::CMappedFile() :
+	data( nullptr ),
+	size( 0 )
+#ifdef _WIN32
+	, file( INVALID_HANDLE_VALUE ),
+	mapping( nullptr )
+#endif
+{
+}
+
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool CMappedFile::Open( const string& filename )
+{
+	Close();
+	file = CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	LARGE_INTEGER fileSize;
+	if( file == INVALID_HANDLE_VALUE || !GetFileSizeEx( file, &fileSize )
+		|| fileSize.QuadPart == 0 )
+	{
+		Close();
+		return false;
+	}
+	mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if( mapping == nullptr ) {
+		Close();
+		return false;
+	}
+	data = static_cast<const char*>(
+		MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+	if( data == nullptr ) {
+		Close();
+		return false;
+	}
+	size = static_cast<size_t>( fileSize.QuadPart );
+	return true;
+}
+
+void CMappedFile::Close()
+{
+	if( data != nullptr ) {
+		UnmapViewOfFile( data );
+		data = nullptr;
+	}
+	if( mapping != nullptr ) {
+		CloseHandle( mapping );
+		mapping = nullptr;
+	}
+	if( file != INVALID_HANDLE_VALUE ) {
+		CloseHandle( file );
+		file = INVALID_HANDLE_VALUE;
+	}
+	size = 0;
+}
+
+#else
+
+bool CMappedFile::Open( const string& filename )
+{
+	Close();
+	const int file = open( filename.c_str(), O_RDONLY );
+	if( file == -1 ) {
+		return false;
+	}
+	struct stat fileStat;
+	if( fstat( file, &fileStat ) != 0 || fileStat.st_size == 0 ) {
+		close( file );
+		return false;
+	}
+	void* mapped = mmap( nullptr, static_cast<size_t>( fileStat.st_size ),
+		PROT_READ, MAP_SHARED, file, 0 );
+	close( file ); // the mapping keeps the file
+	if( mapped == MAP_FAILED ) {
+		return false;
+	}
+	data = static_cast<const char*>( mapped );
+	size = static_cast<size_t>( fileStat.st_size );
+	return true;
+}
+
+void CMappedFile::Close()
+{
+	if( data != nullptr ) {
+		munmap( const_cast<char*>( data ), size );
+		data = nullptr;
+	}
+	size = 0;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Lspl namespace
@@ -0,0 +1,35 @@
+#pragma once
+
+namespace Lspl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Read only memory mapping of a whole file,
+// pages are shared between all processes which map the file
+class CMappedFile {
+	CMappedFile( const CMappedFile& ) = delete;
+	CMappedFile& operator=( const CMappedFile& ) = delete;
+
+public:
+	CMappedFile();
+	~CMappedFile();
+
+	bool Open( const string& filename );
+	void Close();
+
+	bool IsOpen() const { return ( data != nullptr ); }
+	const char* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Lspl namespace
@@ -0,0 +1,168 @@
+#include <common.h>
+#include <MatchStatistics.h>
+#include <Pattern.h>
+
+namespace Lspl {
+namespace Pattern {
+
+///////////////////////////////////////////////////////////////////////////////
+
+CStateStatistics::CStateStatistics() :
+	Tests( 0 ),
+	Matches( 0 ),
+	LoopTests( 0 ),
+	LoopMatches( 0 ),
+	TransitionNanoseconds( 0 ),
+	Visits( 0 ),
+	ActionFailures( 0 ),
+	ActionNanoseconds( 0 )
+{
+}
+
+CStateStatistics& CStateStatistics::operator+=(
+	const CStateStatistics& statistics )
+{
+	Tests += statistics.Tests;
+	Matches += statistics.Matches;
+	LoopTests += statistics.LoopTests;
+	LoopMatches += statistics.LoopMatches;
+	TransitionNanoseconds += statistics.TransitionNanoseconds;
+	Visits += statistics.Visits;
+	ActionFailures += statistics.ActionFailures;
+	ActionNanoseconds += statistics.ActionNanoseconds;
+	return *this;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CMatchStatistics::CMatchStatistics( const CStates& _states ) :
+	states( _states.size() ),
+	scanNanoseconds( 0 )
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CMatchProfile::CMatchProfile( const size_t _top ) :
+	top( _top ),
+	totalScanNanoseconds( 0 )
+{
+}
+
+void CMatchProfile::Add( const CPattern& pattern,
+	const CPatternAutomaton& automaton, const CMatchStatistics& statistics )
+{
+	const vector<CStateStatistics>& states = statistics.States();
+	debug_check_logic( states.size() == automaton.States.size() );
+
+	CPatternEntry patternEntry{ pattern.Name(), states.size(),
+		CStateStatistics(), statistics.ScanNanoseconds() };
+	vector<TStateIndex> indices;
+	for( TStateIndex state = 0; state < states.size(); state++ ) {
+		patternEntry.Statistics += states[state];
+		if( states[state].AllTests() > 0 || states[state].Visits > 0 ) {
+			indices.push_back( state );
+		}
+	}
+	total += patternEntry.Statistics;
+	totalScanNanoseconds += patternEntry.ScanNanoseconds;
+	patternEntries.push_back( patternEntry );
+
+	// labels are built only for the states which can get into the top
+	const size_t count = min( top, indices.size() );
+	partial_sort( indices.begin(), indices.begin() + count, indices.end(),
+		[&states]( const TStateIndex s1, const TStateIndex s2 )
+		{
+			return moreExpensive( states[s1], states[s2] );
+		} );
+	for( size_t i = 0; i < count; i++ ) {
+		const TStateIndex state = indices[i];
+		entries.push_back( { pattern.Name(), automaton.StateLabel( state ),
+			states[state] } );
+	}
+
+	stable_sort( entries.begin(), entries.end(),
+		[]( const CEntry& e1, const CEntry& e2 )
+		{
+			return moreExpensive( e1.Statistics, e2.Statistics );
+		} );
+	if( entries.size() > top ) {
+		entries.erase( entries.begin() + top, entries.end() );
+	}
+}
+
+void CMatchProfile::Print( ostream& out ) const
+{
+	const auto milliseconds = []( const uint64_t nanoseconds )
+	{
+		return static_cast<double>( nanoseconds ) / 1000000;
+	};
+
+	vector<CPatternEntry> sortedPatterns = patternEntries;
+	stable_sort( sortedPatterns.begin(), sortedPatterns.end(),
+		[]( const CPatternEntry& e1, const CPatternEntry& e2 )
+		{
+			return ( e1.Nanoseconds() > e2.Nanoseconds() );
+		} );
+
+	// tests of the scanner have no time of their own, it is the scan time
+	const ios::fmtflags flags = out.flags();
+	out << fixed << setprecision( 3 )
+		<< "Profile: " << milliseconds( total.Nanoseconds()
+			+ totalScanNanoseconds ) << " ms in "
+		<< total.AllTests() << " transition tests and "
+		<< total.Visits << " visits of states, "
+		<< milliseconds( totalScanNanoseconds ) << " ms of scans" << endl
+		<< endl << "Patterns:" << endl
+		<< setw( 12 ) << "time, ms" << setw( 12 ) << "scan, ms"
+		<< setw( 12 ) << "tests"
+		<< setw( 12 ) << "visits" << setw( 12 ) << "rejected"
+		<< setw( 10 ) << "states" << "  pattern" << endl;
+	for( size_t i = 0; i < sortedPatterns.size() && i < top; i++ ) {
+		const CPatternEntry& entry = sortedPatterns[i];
+		out << setw( 12 ) << milliseconds( entry.Nanoseconds() )
+			<< setw( 12 ) << milliseconds( entry.ScanNanoseconds )
+			<< setw( 12 ) << entry.Statistics.AllTests()
+			<< setw( 12 ) << entry.Statistics.Visits
+			<< setw( 12 ) << entry.Statistics.ActionFailures
+			<< setw( 10 ) << entry.States
+			<< "  " << entry.Pattern << endl;
+	}
+
+	// time of a state is the time of tests of the transitions to the state
+	// and the time of actions of the state, tests and matches of
+	// the transition which begins repetitions are in the loop columns
+	out << endl << "States:" << endl
+		<< setw( 12 ) << "time, ms" << setw( 12 ) << "actions, ms"
+		<< setw( 12 ) << "tests" << setw( 12 ) << "matched"
+		<< setw( 12 ) << "loop tests" << setw( 14 ) << "loop matched"
+		<< setw( 12 ) << "rejected" << "  pattern: variant" << endl;
+	for( const CEntry& entry : entries ) {
+		out << setw( 12 ) << milliseconds( entry.Statistics.Nanoseconds() )
+			<< setw( 12 ) << milliseconds( entry.Statistics.ActionNanoseconds )
+			<< setw( 12 ) << entry.Statistics.Tests
+			<< setw( 12 ) << entry.Statistics.Matches
+			<< setw( 12 ) << entry.Statistics.LoopTests
+			<< setw( 14 ) << entry.Statistics.LoopMatches
+			<< setw( 12 ) << entry.Statistics.ActionFailures
+			<< "  " << entry.Pattern << ":"
+			<< ( entry.Label.empty() ? " <initial state>" : " " + entry.Label )
+			<< endl;
+	}
+	out.flags( flags );
+}
+
+bool CMatchProfile::moreExpensive( const CStateStatistics& s1,
+	const CStateStatistics& s2 )
+{
+	// tests of the scanner are not timed, so they order the states of scans
+	if( s1.Nanoseconds() != s2.Nanoseconds() ) {
+		return ( s1.Nanoseconds() > s2.Nanoseconds() );
+	}
+	return ( s1.AllTests() > s2.AllTests() );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Pattern namespace
+} // end of Lspl namespace
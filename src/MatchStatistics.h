@@ -0,0 +1,115 @@
+#pragma once
+
+#include <PatternMatch.h>
+
+namespace Lspl {
+namespace Pattern {
+
+class CPattern;
+struct CPatternAutomaton;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Counters of a state of the automaton. Counters of transitions are stored
+// in the states they lead to. Each state except the initial one has one
+// incoming transition, the state reached by the first transition of a loop
+// state, which begins a repetition, has it as one more incoming transition.
+struct CStateStatistics {
+	uint64_t Tests; // the transition to the state was tested
+	uint64_t Matches; // the word matched the transition to the state
+	uint64_t LoopTests; // the transition of repetitions was tested
+	uint64_t LoopMatches; // the word matched the transition of repetitions
+	uint64_t TransitionNanoseconds; // time of tests of both transitions
+	uint64_t Visits;
+	uint64_t ActionFailures; // the actions of the state rejected the match
+	uint64_t ActionNanoseconds;
+
+	CStateStatistics();
+	uint64_t AllTests() const { return ( Tests + LoopTests ); }
+	uint64_t Nanoseconds() const
+	{
+		return ( TransitionNanoseconds + ActionNanoseconds );
+	}
+	CStateStatistics& operator+=( const CStateStatistics& statistics );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Opt-in instrumentation of CMatchContext, see SetStatistics.
+class CMatchStatistics {
+	CMatchStatistics( const CMatchStatistics& ) = delete;
+	CMatchStatistics& operator=( const CMatchStatistics& ) = delete;
+
+public:
+	typedef chrono::steady_clock CClock;
+
+	explicit CMatchStatistics( const CStates& states );
+
+	CStateStatistics& State( const TStateIndex state )
+	{
+		debug_check_logic( state < states.size() );
+		return states[state];
+	}
+	const vector<CStateStatistics>& States() const { return states; }
+	// time of CPatternScanner, its tests are counted in the states
+	uint64_t ScanNanoseconds() const { return scanNanoseconds; }
+	void AddScanNanoseconds( const uint64_t nanoseconds )
+	{
+		scanNanoseconds += nanoseconds;
+	}
+
+	static uint64_t Nanoseconds( const CClock::time_point start )
+	{
+		return static_cast<uint64_t>( chrono::duration_cast<chrono::nanoseconds>(
+			CClock::now() - start ).count() );
+	}
+
+private:
+	vector<CStateStatistics> states;
+	uint64_t scanNanoseconds;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Collects statistics of automata of patterns and reports the most expensive
+// states mapped back to pattern names and texts of pattern variants.
+class CMatchProfile {
+public:
+	// only top most expensive states are kept
+	explicit CMatchProfile( const size_t top );
+
+	void Add( const CPattern& pattern, const CPatternAutomaton& automaton,
+		const CMatchStatistics& statistics );
+	void Print( ostream& out ) const;
+
+private:
+	struct CEntry {
+		string Pattern;
+		string Label;
+		CStateStatistics Statistics;
+	};
+	struct CPatternEntry {
+		string Pattern;
+		size_t States;
+		CStateStatistics Statistics;
+		uint64_t ScanNanoseconds;
+
+		uint64_t Nanoseconds() const
+		{
+			return ( Statistics.Nanoseconds() + ScanNanoseconds );
+		}
+	};
+	const size_t top;
+	vector<CEntry> entries;
+	vector<CPatternEntry> patternEntries;
+	CStateStatistics total;
+	uint64_t totalScanNanoseconds;
+
+	static bool moreExpensive( const CStateStatistics& s1,
+		const CStateStatistics& s2 );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Pattern namespace
+} // end of Lspl namespace
@@ -72,11 +72,11 @@ public:
 		}
 	}
 
-	void Add( const CTokenPtr& dictionary, const CExtendedNames& names,
-		CPatternArguments&& words )
+	void Add( const CTokenPtr& dictionary, const TDictionary dictionaryIndex,
+		const CExtendedNames& names, CPatternArguments&& words )
 	{
 		debug_check_logic( static_cast<bool>( dictionary ) );
-		CKey key( dictionary->Text, names, move( words ) );
+		CKey key( dictionary->Text, dictionaryIndex, names, move( words ) );
 		auto pair = conditions.insert( make_pair( move( key ), conditions.size() ) );
 		if( !pair.second ) {
 			addAgreementsOverlappedError( { CExtendedName{ dictionary, nullptr } }, names );
@@ -98,7 +98,8 @@ public:
 			if( key.Dictionary.empty() ) {
 				result.emplace_back( key.Strong, key.Words );
 			} else {
-				result.emplace_back( key.Dictionary, key.Words );
+				result.emplace_back( key.Dictionary, key.DictionaryIndex,
+					key.Words );
 			}
 		}
 
@@ -126,13 +127,15 @@ private:
 	struct CKey {
 		bool Strong;
 		string Dictionary;
+		TDictionary DictionaryIndex;
 		CExtendedNames Names;
 		CPatternArguments Words;
 
 		CKey( const bool strong,
 				const CExtendedName& name1, const CPatternArgument& word1,
 				const CExtendedName& name2, const CPatternArgument& word2 ) :
-			Strong( strong )
+			Strong( strong ),
+			DictionaryIndex( 0 )
 		{
 			debug_check_logic( word1.Type != PAT_None );
 			debug_check_logic( word2.Type != PAT_None );
@@ -145,10 +148,11 @@ private:
 			}
 		}
 
-		CKey( const string& dictionary, const CExtendedNames& names,
-				CPatternArguments&& words ) :
+		CKey( const string& dictionary, const TDictionary dictionaryIndex,
+				const CExtendedNames& names, CPatternArguments&& words ) :
 			Strong( false ),
 			Dictionary( dictionary ),
+			DictionaryIndex( dictionaryIndex ),
 			Names( names ),
 			Words( move( words ) )
 		{
@@ -248,7 +252,7 @@ private:
 				}
 				CPatternArgument::Comparator comparator;
 				if( !key1.Dictionary.empty() ) {
-					return ( key1.Words.size() == key1.Words.size() )
+					return ( key1.Words.size() == key2.Words.size() )
 						&& equal( key1.Words.begin(), key1.Words.end(),
 							key2.Words.begin(), comparator );
 				}
@@ -385,12 +389,23 @@ void CAlternativeCondition::checkDictionary(
 {
 	debug_check_logic( static_cast<bool>( dictionary ) );
 	debug_check_logic( !dictionary->Text.empty() );
-	// STUB:
-	context.Context.ErrorProcessor.AddError( CError( *dictionary,
-		"dictionary conditions are not implemented yet" ) );
 
-	// TODO: check dictionary name
-	// TODO: check number of arguments
+	const CDictionaries& dictionaries
+		= context.Context.Configuration().Dictionaries();
+	TDictionary dictionaryIndex;
+	if( !dictionaries.Find( dictionary->Text, dictionaryIndex ) ) {
+		context.Context.ErrorProcessor.AddError( CError( *dictionary,
+			"there is no such dictionary in configuration" ) );
+		return;
+	}
+
+	const size_t arguments = 1 + count_if( names.cbegin(), names.cend(),
+		[]( const CExtendedName& name ) { return !name.first; } );
+	if( arguments != dictionaries[dictionaryIndex].Arguments() ) {
+		context.Context.ErrorProcessor.AddError( CError( *dictionary,
+			"wrong number of dictionary arguments" ) );
+	}
+
 	CPatternArguments words;
 	for( const CExtendedName& name : names ) {
 		if( !static_cast<bool>( name.first ) ) {
@@ -410,7 +425,7 @@ void CAlternativeCondition::checkDictionary(
 	}
 
 	if( words.size() == names.size() ) {
-		context.Add( dictionary, names, move( words ) );
+		context.Add( dictionary, dictionaryIndex, names, move( words ) );
 	}
 }
 
@@ -549,6 +564,11 @@ void CPatternsBuilder::CheckAndBuildIfPossible()
 		rawPattern->SetReference( Patterns.size() );
 		Patterns.emplace_back( move( *rawPattern ) );
 	}
+
+	// factoring compares printed nodes, references are printed by their patterns
+	for( CPattern& pattern : Patterns ) {
+		pattern.Factor( *this );
+	}
 }
 
 Pattern::CPatterns CPatternsBuilder::GetResult()
@@ -96,6 +96,21 @@ bool CPatternArgument::Comparator::operator()(
 		&& arg1.Sign == arg2.Sign );
 }
 
+bool CPatternArgument::Less::operator()(
+	const CPatternArgument& arg1, const CPatternArgument& arg2 ) const
+{
+	if( arg1.Type != arg2.Type ) {
+		return ( arg1.Type < arg2.Type );
+	}
+	if( arg1.Element != arg2.Element ) {
+		return ( arg1.Element < arg2.Element );
+	}
+	if( arg1.Reference != arg2.Reference ) {
+		return ( arg1.Reference < arg2.Reference );
+	}
+	return ( arg1.Sign < arg2.Sign );
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 IPatternBase::IPatternBase()
@@ -106,6 +121,68 @@ IPatternBase::~IPatternBase()
 {
 }
 
+// Collects variants passed to the callback
+class CVariantsCollector : public IVariantCallback {
+public:
+	explicit CVariantsCollector( CPatternVariants& _variants ) :
+		variants( _variants )
+	{
+	}
+
+	void OnVariant( CPatternVariant& variant ) override
+	{
+		variants.push_back( move( variant ) );
+	}
+
+private:
+	CPatternVariants& variants;
+};
+
+void IPatternBase::Stream( CPatternBuildContext& context,
+	IVariantCallback& callback, const TVariantSize maxSize ) const
+{
+	CPatternVariants variants;
+	Build( context, variants, maxSize );
+	for( CPatternVariant& variant : variants ) {
+		callback.OnVariant( variant );
+	}
+}
+
+// Leaf of a factored copy, it is built by the leaf of the patterns,
+// so parts of variants are the same as without factoring
+class CPatternLink : public IPatternBase {
+public:
+	explicit CPatternLink( const IPatternBase& _node ) : node( _node ) {}
+
+	// IPatternBase
+	void Print( const CPatterns& context, ostream& out ) const override
+	{
+		node.Print( context, out );
+	}
+	TVariantSize MinSizePrediction() const override
+	{
+		return node.MinSizePrediction();
+	}
+	void Build( CPatternBuildContext& context, CPatternVariants& variants,
+		const TVariantSize maxSize ) const override
+	{
+		node.Build( context, variants, maxSize );
+	}
+	void Stream( CPatternBuildContext& context, IVariantCallback& callback,
+		const TVariantSize maxSize ) const override
+	{
+		node.Stream( context, callback, maxSize );
+	}
+
+private:
+	const IPatternBase& node;
+};
+
+CPatternBasePtr IPatternBase::Factored( const CPatterns& /*context*/ ) const
+{
+	return CPatternBasePtr( new CPatternLink( *this ) );
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 CBaseVariantPart::CBaseVariantPart()
@@ -136,6 +213,24 @@ TReference CBaseVariantPart::Instance() const
 
 ///////////////////////////////////////////////////////////////////////////////
 
+CSpanVariantPart::CSpanVariantPart( const CBaseVariantPart* _instance ) :
+	instance( _instance )
+{
+	debug_check_logic( instance != nullptr );
+}
+
+TVariantPartType CSpanVariantPart::Type() const
+{
+	return VPR_Span;
+}
+
+TReference CSpanVariantPart::Instance() const
+{
+	return instance->Instance();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 CPatternSequence::CPatternSequence( CPatternBasePtrs&& _elements,
 		const bool _transposition ) :
 	elements( move( _elements ) ),
@@ -169,6 +264,13 @@ TVariantSize CPatternSequence::MinSizePrediction() const
 
 void CPatternSequence::Build( CPatternBuildContext& context,
 	CPatternVariants& variants, const TVariantSize maxSize ) const
+{
+	CVariantsCollector collector( variants );
+	Stream( context, collector, maxSize );
+}
+
+void CPatternSequence::Stream( CPatternBuildContext& context,
+	IVariantCallback& callback, const TVariantSize maxSize ) const
 {
 	vector<CPatternVariants> allSubVariants;
 	collectAllSubVariants( context, allSubVariants, maxSize );
@@ -178,18 +280,33 @@ void CPatternSequence::Build( CPatternBuildContext& context,
 	}
 
 	debug_check_logic( allSubVariants.size() == elements.size() );
-	context.AddVariants( allSubVariants, variants, maxSize );
-
 	if( !transposition ) {
+		context.AddVariants( allSubVariants, callback, maxSize );
+		return;
+	}
+	if( streamTransposition( context, allSubVariants, callback, maxSize ) ) {
 		return;
 	}
 
-	const CTranspositionSupport::CSwaps& swaps =
-		CTranspositionSupport::Instance().Swaps( allSubVariants.size() );
-	for( const CTranspositionSupport::CSwap& swap : swaps ) {
-		swap.Apply( allSubVariants );
-		context.AddVariants( allSubVariants, variants, maxSize );
+	const size_t size = allSubVariants.size();
+	vector<const CPatternVariants*> orderedSubVariants( size );
+	for( size_t t = 0; t < CTranspositionSupport::Count( size ); t++ ) {
+		for( size_t i = 0; i < size; i++ ) {
+			orderedSubVariants[i] =
+				&allSubVariants[CTranspositionSupport::Element( size, t, i )];
+		}
+		context.AddVariants( orderedSubVariants, callback, maxSize );
+	}
+}
+
+CPatternBasePtr CPatternSequence::Factored( const CPatterns& context ) const
+{
+	CPatternBasePtrs factoredElements;
+	for( const CPatternBasePtr& childNode : elements ) {
+		factoredElements.push_back( childNode->Factored( context ) );
 	}
+	return CPatternBasePtr( new CPatternSequence(
+		move( factoredElements ), transposition ) );
 }
 
 void CPatternSequence::collectAllSubVariants( CPatternBuildContext& context,
@@ -218,8 +335,77 @@ void CPatternSequence::collectAllSubVariants( CPatternBuildContext& context,
 			return;
 		}
 
-		allSubVariants.push_back( subVariants );
+		allSubVariants.push_back( move( subVariants ) );
+	}
+}
+
+// Orders of variants of elements are matched by the states of the transposition
+// word, if each sequence of words is matched by one path: variants of elements
+// have no repeated words or transpositions, elements have no common words
+// and the variants of an element are different.
+bool CPatternSequence::streamTransposition( CPatternBuildContext& context,
+	const vector<CPatternVariants>& allSubVariants,
+	IVariantCallback& callback, const TVariantSize maxSize ) const
+{
+	const size_t size = allSubVariants.size();
+	if( size < 2 ) {
+		return false;
+	}
+
+	vector<const CPatternWord*> words;
+	vector<vector<TVariantSize>> transposition( size );
+	vector<CPatternVariantParts> variantsParts;
+	// elements of texts of words
+	unordered_map<const string*, size_t> elements;
+	bool isOptional = true;
+	size_t maxWords = 0;
+	for( size_t element = 0; element < size; element++ ) {
+		set<vector<const string*>> texts;
+		bool hasEmpty = false;
+		size_t elementMaxWords = 0;
+		for( const CPatternVariant& subVariant : allSubVariants[element] ) {
+			if( subVariant.HasRepeatedWord() || subVariant.HasTransposition() ) {
+				return false;
+			}
+			vector<const string*> variantTexts;
+			for( const CPatternWord* word : subVariant ) {
+				variantTexts.push_back( word->Text );
+				if( elements.insert( make_pair( word->Text, element ) ).first
+					->second != element )
+				{
+					return false;
+				}
+			}
+			if( !texts.insert( variantTexts ).second ) {
+				return false;
+			}
+			transposition[element].push_back(
+				Cast<TVariantSize>( subVariant.size() ) );
+			if( subVariant.empty() ) {
+				hasEmpty = true;
+			} else {
+				words.insert( words.end(), subVariant.cbegin(), subVariant.cend() );
+				variantsParts.push_back( subVariant.Parts );
+			}
+			elementMaxWords = max( elementMaxWords, subVariant.size() );
+		}
+		isOptional &= hasEmpty;
+		maxWords += elementMaxWords;
+	}
+	if( words.empty() || maxWords > maxSize ) {
+		return false;
 	}
+
+	CPatternVariant variant;
+	variant.push_back( context.Words().Add(
+		CPatternWord( words, transposition ) ) );
+	variant.Parts.Transposition( variantsParts );
+	callback.OnVariant( variant );
+	if( isOptional ) {
+		CPatternVariant emptyVariant;
+		callback.OnVariant( emptyVariant );
+	}
+	return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -227,6 +413,7 @@ void CPatternSequence::collectAllSubVariants( CPatternBuildContext& context,
 CCondition::CCondition( const bool _strong,
 		const CPatternArguments& _arguments ) :
 	strong( _strong ),
+	dictionaryIndex( 0 ),
 	arguments( move( _arguments ) )
 {
 	debug_check_logic( arguments.size() == 2 );
@@ -237,9 +424,11 @@ CCondition::CCondition( const bool _strong,
 }
 
 CCondition::CCondition( const string& _dictionary,
+		const TDictionary _dictionaryIndex,
 		const CPatternArguments& _arguments ) :
 	strong( false ),
 	dictionary( _dictionary ),
+	dictionaryIndex( _dictionaryIndex ),
 	arguments( move( _arguments ) )
 {
 	debug_check_logic( !dictionary.empty() );
@@ -278,129 +467,451 @@ void CCondition::Print( const CPatterns& context, ostream& out ) const
 
 ///////////////////////////////////////////////////////////////////////////////
 
+struct CConditions::CIndexLess {
+	bool operator()( const CIndex& index1, const CIndex& index2 ) const
+	{
+		if( CPatternArgument::Less{}( index1.Argument, index2.Argument ) ) {
+			return true;
+		}
+		if( CPatternArgument::Less{}( index2.Argument, index1.Argument ) ) {
+			return false;
+		}
+		return ( index1.Condition < index2.Condition
+			|| ( index1.Condition == index2.Condition
+				&& index1.Index < index2.Index ) );
+	}
+	bool operator()( const CIndex& index, const CPatternArgument& arg ) const
+	{
+		return CPatternArgument::Less{}( index.Argument, arg );
+	}
+	bool operator()( const CPatternArgument& arg, const CIndex& index ) const
+	{
+		return CPatternArgument::Less{}( arg, index.Argument );
+	}
+};
+
 CConditions::CConditions( vector<CCondition>&& conditions ) :
-	data( move( conditions ) )
+	data( move( conditions ) ),
+	argumentsCount( 0 )
 {
 	for( TVariantSize i = 0; i < data.size(); i++ ) {
 		const CPatternArguments& arguments = data[i].Arguments();
+		argumentsCount = max( argumentsCount, arguments.size() );
 		for( TVariantSize j = 0; j < arguments.size(); j++ ) {
 			CPatternArgument argument = arguments[j];
 			if( argument.Defined() ) {
 				argument.RemoveSign();
-				indices.insert( make_pair( argument, make_pair( i, j ) ) );
+				indices.push_back( CIndex{ argument, i, j } );
 			}
 		}
 	}
+	sort( indices.begin(), indices.end(), CIndexLess() );
 }
 
-bool CConditions::buildLinks( CPatternVariant& variant, CLinks& links ) const
+size_t CConditions::countLinks( const CPatternVariant& variant ) const
 {
-	debug_check_logic( links.empty() );
-	if( variant.empty() ) {
-		return false;
+	size_t count = 0;
+	if( indices.empty() ) {
+		return count;
+	}
+	for( const CPatternWord* word : variant ) {
+		if( word->Id.Defined() ) {
+			auto range = equal_range( indices.cbegin(), indices.cend(),
+				word->Id, CIndexLess() );
+			count += range.second - range.first;
+		}
 	}
+	return count;
+}
 
+void CConditions::buildLinks( const CPatternVariant& variant,
+	CLinks& links ) const
+{
+	size_t count = 0;
 	for( TVariantSize wi = 0; wi < variant.size(); wi++ ) {
-		if( !variant[wi].Id.Defined() ) {
+		if( !variant[wi]->Id.Defined() ) {
 			continue;
 		}
 
-		auto range = indices.equal_range( variant[wi].Id );
+		auto range = equal_range( indices.cbegin(), indices.cend(),
+			variant[wi]->Id, CIndexLess() );
 		for( auto ci = range.first; ci != range.second; ++ci ) {
-			const pair<TVariantSize, TVariantSize> ciai = ci->second;
-			if( data[ciai.first].Agreement() ) {
-				auto pair = links.insert( { ciai.first, wi, ciai.second } );
-				debug_check_logic( pair.second );
+			if( data[ci->Condition].Agreement() ) {
+				links[count++] = { { ci->Condition, wi, ci->Index } };
 			} else {
-				auto pair = links.insert( { ciai.first, ciai.second, wi }  );
-				debug_check_logic( pair.second );
+				links[count++] = { { ci->Condition, ci->Index, wi } };
+			}
+		}
+	}
+	debug_check_logic( count == links.Size() );
+
+	CLink* const begin = &links[0];
+	sort( begin, begin + count );
+	debug_check_logic( adjacent_find( begin, begin + count ) == begin + count );
+}
+
+void CConditions::buildTransposedLinks( const CPatternVariant& variant,
+	vector<CTransposedLinks>& links ) const
+{
+	links.assign( data.size(), CTransposedLinks() );
+	const auto addLinks = [&]( const CPatternWord* word,
+		const TVariantSize offset, const TTransposedWord transposedWord )
+	{
+		if( !word->Id.Defined() ) {
+			return;
+		}
+		auto range = equal_range( indices.cbegin(), indices.cend(),
+			word->Id, CIndexLess() );
+		for( auto ci = range.first; ci != range.second; ++ci ) {
+			links[ci->Condition].push_back(
+				CTransposedLink{ offset, transposedWord, ci->Index } );
+		}
+	};
+
+	const TVariantSize transposition = variant.TranspositionWord();
+	for( TVariantSize wi = 0; wi < variant.size(); wi++ ) {
+		if( wi != transposition ) {
+			addLinks( variant[wi], wi, NoTransposedWord );
+			continue;
+		}
+		const vector<const CPatternWord*>& group = variant[wi]->Group;
+		for( TTransposedWord word = 0; word < group.size(); word++ ) {
+			addLinks( group[word], wi, word );
+		}
+	}
+}
+
+// Words of the transposition agree with the words linked before them
+// in the order matched, so their agreements and agreements of words after
+// the transposition with its words or words before it are transposition
+// agreements, other agreements and dictionaries have fixed offsets.
+void CConditions::applyTransposed( CPatternBuildContext& context,
+	CPatternVariant& variant ) const
+{
+	vector<CTransposedLinks> allLinks;
+	buildTransposedLinks( variant, allLinks );
+
+	CPatternWords& words = context.Words();
+	CConditionActions& actions = context.ConditionActions();
+	const TVariantSize transposition = variant.TranspositionWord();
+	CPatternWord transposedWord = *variant[transposition];
+	bool isTransposedChanged = false;
+	const auto addAction = [&]( const CTransposedLink& link,
+		const CActionPtr& action )
+	{
+		if( link.Offset == transposition ) {
+			const CPatternWord*& word = transposedWord.Group[link.Word];
+			word = words.AddAction( word, action );
+			isTransposedChanged = true;
+		} else {
+			variant[link.Offset] = words.AddAction( variant[link.Offset], action );
+		}
+	};
+
+	// offsets of words before the word if they are fixed
+	vector<TVariantSize> offsets;
+	vector<CTranspositionAgreementAction::CWords> agreedWords;
+	for( size_t c = 0; c < data.size(); c++ ) {
+		const CCondition& condition = data[c];
+		const CTransposedLinks& links = allLinks[c];
+		if( links.empty() ) {
+			continue;
+		}
+
+		if( condition.Agreement() ) {
+			const TAttribute sign = condition.Arguments().front().Sign;
+			const bool strong = condition.Strong();
+			// weak agreement of two arguments links words of different ones
+			const bool anyArgument = strong || condition.SelfAgreement();
+			for( const CTransposedLink& link : links ) {
+				offsets.clear();
+				agreedWords.clear();
+				bool isFixed = ( link.Offset != transposition );
+				for( const CTransposedLink& previous : links ) {
+					const bool isTransposed = ( link.Offset == transposition
+						&& previous.Offset == transposition );
+					if( !( previous.Offset < link.Offset || ( isTransposed
+							&& previous.Word != link.Word ) )
+						|| ( !anyArgument && previous.Argument == link.Argument ) )
+					{
+						continue;
+					}
+					if( previous.Offset == transposition ) {
+						agreedWords.push_back( {
+							CTranspositionAgreementAction::WT_Transposed,
+							previous.Word } );
+						isFixed = false;
+					} else if( previous.Offset > transposition ) {
+						agreedWords.push_back( {
+							CTranspositionAgreementAction::WT_Current,
+							TTransposedWord( link.Offset - previous.Offset ) } );
+						offsets.push_back( previous.Offset );
+					} else {
+						agreedWords.push_back( {
+							CTranspositionAgreementAction::WT_BeforeTransposition,
+							TTransposedWord( transposition - previous.Offset ) } );
+						offsets.push_back( previous.Offset );
+						isFixed &= ( link.Offset < transposition );
+					}
+				}
+
+				if( agreedWords.empty() ) {
+					continue;
+				}
+				if( !isFixed ) {
+					addAction( link, actions.TranspositionAgreement( sign,
+						strong, agreedWords ) );
+				} else if( strong ) {
+					addAction( link, actions.StrongAgreement( sign,
+						link.Offset - offsets.back() ) );
+				} else {
+					addAction( link, actions.Agreement( sign, link.Offset,
+						offsets.data(), offsets.size() ) );
+				}
+			}
+		} else {
+			// words of arguments in the order of the condition,
+			// MaxVariantSize separates arguments of the dictionary
+			vector<pair<TVariantSize, TVariantSize>> arguments;
+			for( const CTransposedLink& link : links ) {
+				debug_check_logic( link.Offset != transposition );
+				arguments.push_back( make_pair( link.Argument, link.Offset ) );
+			}
+			sort( arguments.begin(), arguments.end() );
+			const CPatternArguments& conditionArguments = condition.Arguments();
+			offsets.clear();
+			TVariantSize maxOffset = 0;
+			TVariantSize argument = 0;
+			for( const pair<TVariantSize, TVariantSize>& offset : arguments ) {
+				for( ; argument < offset.first; argument++ ) {
+					if( conditionArguments[argument].Type == PAT_None ) {
+						offsets.push_back( MaxVariantSize );
+					}
+				}
+				offsets.push_back( offset.second );
+				maxOffset = max( offset.second, maxOffset );
+			}
+			for( ; argument < conditionArguments.size(); argument++ ) {
+				if( conditionArguments[argument].Type == PAT_None ) {
+					offsets.push_back( MaxVariantSize );
+				}
 			}
+			variant[maxOffset] = words.AddAction( variant[maxOffset],
+				actions.Dictionary( condition.DictionaryIndex(), maxOffset,
+					offsets.data(), offsets.size() ) );
 		}
 	}
 
-	return !links.empty();
+	if( isTransposedChanged ) {
+		variant[transposition] = words.Add( transposedWord );
+	}
 }
 
-void CConditions::Apply( CPatternVariant& variant ) const
+void CConditions::Apply( CPatternBuildContext& context,
+	CPatternVariant& variant ) const
 {
-	CLinks links;
-	if( !buildLinks( variant, links ) ) {
+	if( variant.HasTransposition() ) {
+		if( !indices.empty() ) {
+			applyTransposed( context, variant );
+		}
+		return;
+	}
+
+	CLinks links( countLinks( variant ) );
+	if( links.Size() == 0 ) {
 		// no conditions
 		return;
 	}
+	buildLinks( variant, links );
+
+	CPatternWords& words = context.Words();
+	CConditionActions& actions = context.ConditionActions();
+	const auto addAction = [&]( const TVariantSize offset,
+		const CActionPtr& action )
+	{
+		variant[offset] = words.AddAction( variant[offset], action );
+	};
+	// offsets of words from the repeated word and words after it
+	// to the repeated word and words before it depend on repetitions
+	const TVariantSize loop = variant.RepeatedWord();
+	const auto addAgreement = [&]( const TAttribute sign, const bool strong,
+		const TVariantSize offset, const TVariantSize* words, const size_t count )
+	{
+		bool dependsOnLoop = false;
+		for( size_t k = 0; k < count; k++ ) {
+			dependsOnLoop |= ( offset >= loop && words[k] <= loop );
+		}
+		if( dependsOnLoop ) {
+			addAction( offset, actions.LoopAgreement( sign, strong,
+				offset, loop, words, count ) );
+		} else if( strong ) {
+			debug_check_logic( count == 1 );
+			addAction( offset, actions.StrongAgreement( sign, offset - words[0] ) );
+		} else {
+			addAction( offset, actions.Agreement( sign, offset, words, count ) );
+		}
+	};
+
+	// two lists of words of arguments of a condition,
+	// a list also contains separators of arguments of a dictionary
+	const size_t listSize = links.Size() + argumentsCount;
+	CFixedSizeArray<TVariantSize, size_t, 64> buffer( 2 * listSize );
+	TVariantSize* const lists[2] = { &buffer[0], &buffer[0] + listSize };
 
-	auto i = links.cbegin();
-	while( i != links.cend() ) {
+	const CLink* i = &links[0];
+	const CLink* const end = i + links.Size();
+	while( i != end ) {
 		const CCondition& condition = data[( *i )[0]];
 		if( condition.Agreement() ) {
 			const TAttribute sign = condition.Arguments().front().Sign;
 			if( condition.Strong() ) {
+				// repetitions agree with the previous ones too
 				debug_check_logic( ( *i )[2] <= 1 );
+				if( ( *i )[1] == loop ) {
+					addAgreement( sign, true, loop, &loop, 1 );
+				}
 				auto j = i;
-				while( ++j != links.cend() && ( *j )[0] == ( *i )[0] ) {
+				while( ++j != end && ( *j )[0] == ( *i )[0] ) {
 					debug_check_logic( ( *j )[2] <= 1 );
-					const CLinks::value_type& di = *i;
-					const CLinks::value_type& dj = *j;
-					variant[dj[1]].Actions.Add( CActionPtr(
-						new CAgreementAction( sign, dj[1] - di[1] ) ) );
+					const CLink& di = *i;
+					const CLink& dj = *j;
+					const TVariantSize previous[2] = { di[1], loop };
+					addAgreement( sign, true, dj[1], previous,
+						dj[1] == loop ? 2 : 1 );
 					i++;
 				}
 				i = j;
 			} else if( condition.SelfAgreement() ) {
 				debug_check_logic( ( *i )[2] == 0 );
-				vector<TVariantSize> words;
-				words.push_back( ( *i )[1] );
+				TVariantSize* const list = lists[0];
+				size_t count = 0;
+				list[count++] = ( *i )[1];
+				if( ( *i )[1] == loop ) {
+					addAgreement( sign, false, loop, list, count );
+				}
 				auto j = i;
-				while( ++j != links.cend() && ( *j )[0] == ( *i )[0] ) {
+				while( ++j != end && ( *j )[0] == ( *i )[0] ) {
 					debug_check_logic( ( *j )[2] == 0 );
 					const TVariantSize offset = ( *j )[1];
-					variant[offset].Actions.Add( CActionPtr(
-						new CAgreementAction( sign, offset, words ) ) );
-					words.push_back( offset );
+					// the repetitions agree with the previous ones too
+					list[count] = loop;
+					addAgreement( sign, false, offset, list,
+						offset == loop ? count + 1 : count );
+					list[count++] = offset;
 				}
 				i = j;
 			} else {
 				debug_check_logic( ( *i )[2] <= 1 );
-				array<vector<TVariantSize>, 2> words;
-				words[( *i )[2]].push_back( ( *i )[1] );
+				size_t counts[2] = { 0, 0 };
+				lists[( *i )[2]][counts[( *i )[2]]++] = ( *i )[1];
 				auto j = i;
-				while( ++j != links.cend() && ( *j )[0] == ( *i )[0] ) {
+				while( ++j != end && ( *j )[0] == ( *i )[0] ) {
 					debug_check_logic( ( *j )[2] <= 1 );
 					const TVariantSize offset = ( *j )[1];
 					const TVariantSize another = ( *j )[2] == 0 ? 1 : 0;
-					if( !words[another].empty() ) {
-						variant[offset].Actions.Add( CActionPtr(
-							new CAgreementAction( sign, offset, words[another] ) ) );
+					if( counts[another] > 0 ) {
+						addAgreement( sign, false, offset,
+							lists[another], counts[another] );
 					}
-					words[( *j )[2]].push_back( offset );
+					lists[( *j )[2]][counts[( *j )[2]]++] = offset;
 				}
 				i = j;
 			}
 		} else {
-#pragma message( "not implemented yet" )
-			check_logic( false );
-#if 0
-			TVariantSize maxOffset = ( *i )[2];
-			vector<TVariantSize> words;
-			words.push_back( maxOffset );
+			// words of arguments in the order of the condition,
+			// MaxVariantSize separates arguments of the dictionary
+			const CPatternArguments& arguments = condition.Arguments();
+			TVariantSize* const list = lists[0];
+			size_t count = 0;
+			TVariantSize maxOffset = 0;
+			TVariantSize argument = 0;
 			auto j = i;
-			while( ++j != links.cend() && ( *j )[0] == ( *i )[0] ) {
-				if( ( *j )[1] - ( *i )[1] > 1 ) {
-					words.push_back( MaxVariantSize );
+			for( ; j != end && ( *j )[0] == ( *i )[0]; ++j ) {
+				for( ; argument < ( *j )[1]; argument++ ) {
+					if( arguments[argument].Type == PAT_None ) {
+						list[count++] = MaxVariantSize;
+					}
 				}
 				const TVariantSize offset = ( *j )[2];
-				words.push_back( offset );
+				list[count++] = offset;
 				maxOffset = max( offset, maxOffset );
-				i++;
 			}
+			for( ; argument < arguments.size(); argument++ ) {
+				if( arguments[argument].Type == PAT_None ) {
+					list[count++] = MaxVariantSize;
+				}
+			}
+			debug_check_logic( count <= listSize );
 			i = j;
-			// TODO: check condition
-			const TDictionary dictionary = 999;
-			variant[maxOffset].Actions.Add( CActionPtr(
-				new CDictionaryAction( dictionary, maxOffset, words ) ) );
-#endif
+			addAction( maxOffset, actions.Dictionary(
+				condition.DictionaryIndex(), maxOffset, list, count ) );
+		}
+	}
+}
+
+bool CConditions::CanLoop( const CPatternVariant& variant ) const
+{
+	// words of a repeated group are not linked
+	const TVariantSize loop = variant.RepeatedWord();
+	if( loop < variant.size() && !indices.empty() ) {
+		for( const CPatternWord* word : variant[loop]->Group ) {
+			if( word->Id.Defined() && binary_search( indices.cbegin(),
+				indices.cend(), word->Id, CIndexLess() ) )
+			{
+				return false;
+			}
+		}
+	}
+
+	CLinks links( countLinks( variant ) );
+	if( links.Size() == 0 ) {
+		return true;
+	}
+	buildLinks( variant, links );
+
+	// words of an entry of a dictionary are all before or after the loop
+	const CLink* i = &links[0];
+	const CLink* const end = i + links.Size();
+	while( i != end ) {
+		if( data[( *i )[0]].Agreement() ) {
+			i++;
+			continue;
+		}
+		const bool before = ( ( *i )[2] < loop );
+		auto j = i;
+		for( ; j != end && ( *j )[0] == ( *i )[0]; ++j ) {
+			if( ( *j )[2] == loop || ( ( *j )[2] < loop ) != before ) {
+				return false;
+			}
+		}
+		i = j;
+	}
+	return true;
+}
+
+bool CConditions::CanTranspose( const CPatternVariant& variant ) const
+{
+	const TVariantSize transposition = variant.TranspositionWord();
+	if( transposition == variant.size() || indices.empty() ) {
+		return true;
+	}
+
+	vector<CTransposedLinks> links;
+	buildTransposedLinks( variant, links );
+	for( size_t c = 0; c < data.size(); c++ ) {
+		if( data[c].Agreement() || links[c].empty() ) {
+			continue;
+		}
+		const bool before = ( links[c].front().Offset < transposition );
+		for( const CTransposedLink& link : links[c] ) {
+			if( link.Offset == transposition
+				|| ( link.Offset < transposition ) != before )
+			{
+				return false;
+			}
 		}
 	}
+	return true;
 }
 
 void CConditions::Print( const CPatterns& context, ostream& out ) const
@@ -446,11 +957,59 @@ TVariantSize CPatternAlternative::MinSizePrediction() const
 void CPatternAlternative::Build( CPatternBuildContext& context,
 	CPatternVariants& variants, const TVariantSize maxSize ) const
 {
-	element->Build( context, variants, maxSize );
-	for( CPatternVariant& variant : variants ) {
-		conditions.Apply( variant );
+	CVariantsCollector collector( variants );
+	Stream( context, collector, maxSize );
+	variants.SortAndRemoveDuplicates( context.Words() );
+}
+
+// Applies conditions to variants of the element
+class CPatternAlternative::CConditionsCallback : public IVariantCallback {
+public:
+	CConditionsCallback( CPatternBuildContext& _context,
+			const CConditions& _conditions, IVariantCallback& _callback ) :
+		context( _context ),
+		conditions( _conditions ),
+		callback( _callback )
+	{
+	}
+
+	void OnVariant( CPatternVariant& variant ) override
+	{
+		// offsets of words of dictionaries are fixed only without repetitions
+		// and transpositions
+		if( ( variant.HasRepeatedWord() && !conditions.CanLoop( variant ) )
+			|| ( variant.HasTransposition()
+				&& !conditions.CanTranspose( variant ) ) )
+		{
+			CPatternVariants unrolled;
+			variant.Unroll( context.Words(), unrolled );
+			for( CPatternVariant& unrolledVariant : unrolled ) {
+				conditions.Apply( context, unrolledVariant );
+				callback.OnVariant( unrolledVariant );
+			}
+		} else {
+			conditions.Apply( context, variant );
+			callback.OnVariant( variant );
+		}
 	}
-	variants.SortAndRemoveDuplicates( context.Patterns() );
+
+private:
+	CPatternBuildContext& context;
+	const CConditions& conditions;
+	IVariantCallback& callback;
+};
+
+void CPatternAlternative::Stream( CPatternBuildContext& context,
+	IVariantCallback& callback, const TVariantSize maxSize ) const
+{
+	CConditionsCallback conditionsCallback( context, conditions, callback );
+	element->Stream( context, conditionsCallback, maxSize );
+}
+
+CPatternBasePtr CPatternAlternative::Factored( const CPatterns& context ) const
+{
+	return CPatternBasePtr( new CPatternAlternative(
+		element->Factored( context ), CConditions( conditions ) ) );
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -488,14 +1047,176 @@ TVariantSize CPatternAlternatives::MinSizePrediction() const
 
 void CPatternAlternatives::Build( CPatternBuildContext& context,
 	CPatternVariants& variants, const TVariantSize maxSize ) const
+{
+	CVariantsCollector collector( variants );
+	Stream( context, collector, maxSize );
+	variants.SortAndRemoveDuplicates( context.Words() );
+}
+
+void CPatternAlternatives::Stream( CPatternBuildContext& context,
+	IVariantCallback& callback, const TVariantSize maxSize ) const
 {
 	for( const CPatternBasePtr& alternative : alternatives ) {
-		CPatternVariants subVariants;
-		alternative->Build( context, subVariants, maxSize );
-		variants.insert( variants.end(),
-			subVariants.cbegin(), subVariants.cend() );
+		alternative->Stream( context, callback, maxSize );
+	}
+}
+
+// Alternative of a factored copy: the conditions and the factored elements
+// of the sequence of the alternative if its edges can be factored,
+// the factored copy of the alternative otherwise
+struct CPatternAlternatives::CFactoredAlternative {
+	const CConditions* Conditions; // nullptr for rests of sequences
+	CPatternBasePtrs Elements;
+	CPatternBasePtr Node;
+
+	bool Removed() const { return Elements.empty() && !Node; }
+	void Print( const CPatterns& context, ostream& out ) const;
+	CPatternBasePtr Release();
+};
+
+void CPatternAlternatives::CFactoredAlternative::Print(
+	const CPatterns& context, ostream& out ) const
+{
+	if( static_cast<bool>( Node ) ) {
+		Node->Print( context, out );
+		return;
+	}
+	for( const CPatternBasePtr& element : Elements ) {
+		element->Print( context, out );
+		out << " ";
+	}
+	if( Conditions != nullptr ) {
+		Conditions->Print( context, out );
+	}
+}
+
+CPatternBasePtr CPatternAlternatives::CFactoredAlternative::Release()
+{
+	if( static_cast<bool>( Node ) ) {
+		return move( Node );
+	}
+	return CPatternBasePtr( new CPatternAlternative(
+		CPatternBasePtr( new CPatternSequence( move( Elements ) ) ),
+		Conditions != nullptr ? CConditions( *Conditions )
+			: CConditions( vector<CCondition>() ) ) );
+}
+
+CPatternBasePtr CPatternAlternatives::Factored( const CPatterns& context ) const
+{
+	CFactoredAlternatives factoredAlternatives;
+	for( const CPatternBasePtr& alternative : alternatives ) {
+		const CPatternAlternative* patternAlternative =
+			dynamic_cast<const CPatternAlternative*>( alternative.get() );
+		const CPatternSequence* sequence = patternAlternative == nullptr
+			? nullptr : dynamic_cast<const CPatternSequence*>(
+				&patternAlternative->Element() );
+		if( sequence == nullptr || sequence->Transposition()
+			|| sequence->Elements().size() < 2 )
+		{
+			factoredAlternatives.push_back( CFactoredAlternative{ nullptr,
+				CPatternBasePtrs(), alternative->Factored( context ) } );
+			continue;
+		}
+		CPatternBasePtrs elements;
+		for( const CPatternBasePtr& element : sequence->Elements() ) {
+			elements.push_back( element->Factored( context ) );
+		}
+		factoredAlternatives.push_back( CFactoredAlternative{
+			&patternAlternative->Conditions(), move( elements ),
+			CPatternBasePtr() } );
+	}
+	return factor( context, factoredAlternatives );
+}
+
+CPatternBasePtr CPatternAlternatives::factor( const CPatterns& context,
+	CFactoredAlternatives& alternatives )
+{
+	// identical alternatives have the same variants
+	unordered_set<string> printed;
+	CFactoredAlternatives uniqueAlternatives;
+	for( CFactoredAlternative& alternative : alternatives ) {
+		ostringstream oss;
+		alternative.Print( context, oss );
+		if( printed.insert( oss.str() ).second ) {
+			uniqueAlternatives.push_back( move( alternative ) );
+		}
+	}
+
+	factorEdges( context, uniqueAlternatives, true );
+	factorEdges( context, uniqueAlternatives, false );
+
+	CPatternBasePtrs factored;
+	for( CFactoredAlternative& alternative : uniqueAlternatives ) {
+		factored.push_back( alternative.Release() );
+	}
+	return CPatternBasePtr( new CPatternAlternatives( move( factored ) ) );
+}
+
+// Alternatives with the same conditions and the same first (last) element
+// of their sequences are replaced by one alternative: the common element
+// followed (preceded) by the alternatives of the rests of the sequences.
+// So the common element is built once and the conditions are applied once.
+void CPatternAlternatives::factorEdges( const CPatterns& context,
+	CFactoredAlternatives& alternatives, const bool prefixes )
+{
+	map<string, vector<size_t>> groups;
+	for( size_t i = 0; i < alternatives.size(); i++ ) {
+		const CFactoredAlternative& alternative = alternatives[i];
+		if( static_cast<bool>( alternative.Node )
+			|| alternative.Elements.size() < 2 )
+		{
+			continue;
+		}
+		ostringstream key;
+		if( alternative.Conditions != nullptr ) {
+			alternative.Conditions->Print( context, key );
+		}
+		key << endl;
+		const CPatternBasePtrs& elements = alternative.Elements;
+		( prefixes ? elements.front() : elements.back() )->Print( context, key );
+		groups[key.str()].push_back( i );
+	}
+
+	bool factored = false;
+	for( const pair<const string, vector<size_t>>& group : groups ) {
+		const vector<size_t>& indices = group.second;
+		if( indices.size() < 2 ) {
+			continue;
+		}
+
+		CPatternBasePtr common;
+		CFactoredAlternatives rests;
+		for( const size_t i : indices ) {
+			CPatternBasePtrs& elements = alternatives[i].Elements;
+			const auto edge = prefixes ? elements.begin() : prev( elements.end() );
+			if( !static_cast<bool>( common ) ) {
+				common = move( *edge );
+			}
+			elements.erase( edge );
+			rests.push_back( CFactoredAlternative{ nullptr,
+				move( elements ), CPatternBasePtr() } );
+			elements.clear();
+		}
+
+		CPatternBasePtr restAlternatives = factor( context, rests );
+		CPatternBasePtrs& elements = alternatives[indices.front()].Elements;
+		if( prefixes ) {
+			elements.push_back( move( common ) );
+			elements.push_back( move( restAlternatives ) );
+		} else {
+			elements.push_back( move( restAlternatives ) );
+			elements.push_back( move( common ) );
+		}
+		factored = true;
+	}
+
+	if( factored ) {
+		alternatives.erase( remove_if( alternatives.begin(), alternatives.end(),
+			[]( const CFactoredAlternative& alternative )
+			{
+				return alternative.Removed();
+			} ), alternatives.end() );
 	}
-	variants.SortAndRemoveDuplicates( context.Patterns() );
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -552,15 +1273,43 @@ void CPatternRepeating::Build( CPatternBuildContext& context,
 	CPatternVariants subVariants;
 	element->Build( context, subVariants, elementMaxSize );
 
+	// a single variant is repeated by a loop state of the automaton
+	// as a word or a group of words
+	if( finish > start && subVariants.size() == 1
+		&& !subVariants.front().HasRepeatedWord()
+		&& !subVariants.front().HasTransposition() )
+	{
+		CPatternVariant& variant = subVariants.front();
+		CPatternWord repeatedWord = variant.size() == 1 ? *variant.front()
+			: CPatternWord( vector<const CPatternWord*>( variant.cbegin(),
+				variant.cend() ), 1, 1 );
+		repeatedWord.MinCount = Cast<TVariantSize>( start );
+		repeatedWord.MaxCount = Cast<TVariantSize>( finish );
+		variant.assign( 1, context.Words().Add( repeatedWord ) );
+		variant.Parts.Group();
+		if( variant.MinSize() <= maxSize ) {
+			variant.LimitSize( context.Words(), maxSize );
+			variants.push_back( move( variant ) );
+		}
+		return;
+	}
+
+	CVariantsCollector collector( variants );
 	vector<CPatternVariants> allSubVariants( start - 1, subVariants );
 	for( size_t count = start; count <= finish; count++ ) {
 		allSubVariants.push_back( subVariants );
-		context.AddVariants( allSubVariants, variants, maxSize );
+		context.AddVariants( allSubVariants, collector, maxSize );
 	}
 
 	return;
 }
 
+CPatternBasePtr CPatternRepeating::Factored( const CPatterns& context ) const
+{
+	return CPatternBasePtr( new CPatternRepeating(
+		element->Factored( context ), minCount, maxCount ) );
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 CPatternRegexp::CPatternRegexp( const string& _regexp ) :
@@ -579,14 +1328,14 @@ TVariantSize CPatternRegexp::MinSizePrediction() const
 	return 1;
 }
 
-void CPatternRegexp::Build( CPatternBuildContext& /*context*/,
+void CPatternRegexp::Build( CPatternBuildContext& context,
 	CPatternVariants& variants, const TVariantSize maxSize ) const
 {
 	variants.clear();
 	if( maxSize > 0 ) {
 		CPatternVariant variant;
-		variant.emplace_back( &regexp );
-		variant.Parts.push_back( this );
+		variant.push_back( context.Words().Add( CPatternWord( &regexp ) ) );
+		variant.Parts = CPatternVariantParts( this );
 		variants.push_back( variant );
 	}
 }
@@ -788,14 +1537,15 @@ TVariantSize CPatternElement::MinSizePrediction() const
 	return 1;
 }
 
-void CPatternElement::Build( CPatternBuildContext& /*context*/,
+void CPatternElement::Build( CPatternBuildContext& context,
 	CPatternVariants& variants, const TVariantSize maxSize ) const
 {
 	variants.clear();
 	if( maxSize > 0 ) {
 		CPatternVariant variant;
-		variant.emplace_back( CPatternArgument( element ), signs );
-		variant.Parts.push_back( this );
+		variant.push_back( context.Words().Add(
+			CPatternWord( CPatternArgument( element ), signs ) ) );
+		variant.Parts = CPatternVariantParts( this );
 		variants.push_back( variant );
 	}
 }
@@ -814,14 +1564,16 @@ TElement CPatternElement::Word() const
 
 CPatternReference::CPatternReference( const TReference _reference ) :
 	reference( _reference ),
-	signs()
+	signs(),
+	spanPart( this )
 {
 }
 
 CPatternReference::CPatternReference( const TReference _reference,
 		CSignRestrictions&& _signs ) :
 	reference( _reference ),
-	signs( move( _signs ) )
+	signs( move( _signs ) ),
+	spanPart( this )
 {
 }
 
@@ -839,32 +1591,159 @@ TVariantSize CPatternReference::MinSizePrediction() const
 void CPatternReference::Build( CPatternBuildContext& context,
 	CPatternVariants& variants, const TVariantSize maxSize ) const
 {
-	const CPattern& pattern = context.Patterns().Pattern( reference );
-	pattern.Build( context, variants, maxSize );
+	TSpan span;
+	if( context.Spans() == nullptr || !buildSpan( context, span ) ) {
+		buildInline( context, variants, maxSize );
+		return;
+	}
 
-	auto last = variants.begin();
-	for( auto variant = last; variant != variants.end(); ++variant ) {
-		bool isEmpty = false;
-		for( CPatternWord& word : *variant ) {
-			if( word.Id.Type == PAT_ReferenceElement ) {
-				word.Id.Reference = reference;
-				// apply SignRestrictions
-				word.SignRestrictions.Intersection( signs, word.Id.Element );
-				if( word.SignRestrictions.IsEmpty( context.Patterns() ) ) {
-					isEmpty = true;
-					break;
-				}
-			} else {
-				word.Id = CPatternArgument();
+	variants.clear();
+	if( maxSize > 0 ) {
+		const CSpanAutomaton& automaton = context.Spans()->Automaton( span );
+		CPatternArgument head;
+		if( automaton.HasHead ) {
+			const TElement mainSize = context.Patterns().Configuration().
+				Attributes().Main().ValuesCount();
+			head = CPatternArgument( automaton.HeadElement % mainSize,
+				PAT_ReferenceElement, 0, reference );
+		}
+		CPatternVariant variant;
+		variant.push_back( context.Words().Add( CPatternWord( &automaton, head ) ) );
+		variant.Parts = CPatternVariantParts( &spanPart );
+		variants.push_back( variant );
+	}
+}
+
+bool CPatternReference::buildSpan( CPatternBuildContext& context,
+	TSpan& span ) const
+{
+	CSpanAutomata& spans = *context.Spans();
+	const CPattern& pattern = context.Patterns().Pattern( reference );
+
+	ostringstream name;
+	name << pattern.Name();
+	signs.Print( context.Patterns(), name );
+	switch( spans.Find( name.str(), span ) ) {
+		case CSpanAutomata::S_Built:
+			return true;
+		case CSpanAutomata::S_Building: // recursive reference
+		case CSpanAutomata::S_Inline:
+			return false;
+		case CSpanAutomata::S_NotFound:
+			break;
+	}
+
+	span = spans.Add( name.str() );
+	const bool hasHead = !pattern.Arguments().empty();
+	const TElement headElement = hasHead ? pattern.Arguments()[0].Element : 0;
+	CPatternBuildContext spanContext( context.Patterns(), &spans );
+	CPatternVariants variants;
+	buildInline( spanContext, variants, spans.MaxSize() );
+
+	// each variant must have exactly one word of the argument
+	bool inlineOnly = ( pattern.Arguments().size() > 1 || variants.empty() );
+	if( hasHead && !inlineOnly ) {
+		const TElement mainSize = context.Patterns().Configuration().
+			Attributes().Main().ValuesCount();
+		const auto isHead = [&]( const CPatternWord* word ) -> bool
+		{
+			return ( word->Id.Type == PAT_ReferenceElement
+				&& word->Id.Element == headElement % mainSize );
+		};
+		for( const CPatternVariant& variant : variants ) {
+			size_t heads = 0;
+			for( const CPatternWord* word : variant ) {
+				if( isHead( word ) ) {
+					heads += ( word->Span == nullptr && !word->IsRepeated() ) ? 1 : 2;
+				}
+				for( const CPatternWord* groupWord : word->Group ) {
+					heads += isHead( groupWord ) ? 2 : 0;
+				}
+			}
+			if( heads != 1 ) {
+				inlineOnly = true;
+				break;
+			}
+		}
+	}
+	if( inlineOnly ) {
+		spans.SetInline( span );
+		return false;
+	}
+
+	variants.Build( spanContext );
+	spans.SetBuilt( span, hasHead, headElement, move( spanContext.States ) );
+	return true;
+}
+
+void CPatternReference::buildInline( CPatternBuildContext& context,
+	CPatternVariants& variants, const TVariantSize maxSize ) const
+{
+	const CPattern& pattern = context.Patterns().Pattern( reference );
+	pattern.Build( context, variants, maxSize );
+
+	// returns nullptr if the restrictions of the word are empty
+	const auto addReferenceWord = [&]( const CPatternWord* word )
+		-> const CPatternWord*
+	{
+		CPatternWord referenceWord = *word;
+		if( referenceWord.Id.Type == PAT_ReferenceElement ) {
+			referenceWord.Id.Reference = reference;
+			// apply SignRestrictions
+			referenceWord.SignRestrictions.Intersection( signs,
+				referenceWord.Id.Element );
+			if( referenceWord.SignRestrictions.IsEmpty( context.Patterns() ) ) {
+				return nullptr;
+			}
+		} else {
+			referenceWord.Id = CPatternArgument();
+		}
+		return context.Words().Add( referenceWord );
+	};
+
+	// transpositions with words left out by the restrictions are unrolled,
+	// so the orders of their other words are kept
+	const auto isLeftOut = [&]( const CPatternVariant& variant ) -> bool
+	{
+		return ( variant.HasTransposition() && context.Words().Replace(
+			variant[variant.TranspositionWord()], addReferenceWord ) == nullptr );
+	};
+	const bool hasLeftOut =
+		any_of( variants.cbegin(), variants.cend(), isLeftOut );
+	if( hasLeftOut ) {
+		CPatternVariants unrolled;
+		for( const CPatternVariant& variant : variants ) {
+			if( isLeftOut( variant ) ) {
+				variant.Unroll( context.Words(), unrolled );
+			} else {
+				unrolled.push_back( variant );
+			}
+		}
+		variants.swap( unrolled );
+	}
+
+	auto last = variants.begin();
+	for( auto variant = last; variant != variants.end(); ++variant ) {
+		bool isEmpty = false;
+		for( const CPatternWord*& word : *variant ) {
+			word = context.Words().Replace( word, addReferenceWord );
+			if( word == nullptr ) {
+				isEmpty = true;
+				break;
 			}
 		}
 		if( !isEmpty ) {
-			*last = move( *variant );
-			last->Parts.front() = this;
+			if( last != variant ) { // self move assignment clears the variant
+				*last = move( *variant );
+			}
+			last->Parts.ReplaceInstance( this );
 			++last;
 		}
 	}
 	variants.erase( last, variants.end() );
+	if( hasLeftOut ) {
+		variants.SortAndRemoveDuplicates( context.Words() );
+	}
 }
 
 TVariantPartType CPatternReference::Type() const
@@ -924,38 +1803,101 @@ TVariantSize CPattern::MinSizePrediction() const
 void CPattern::Build( CPatternBuildContext& context,
 	CPatternVariants& variants, const TVariantSize maxSize ) const
 {
+	CArena::CScope arenaScope( context.Arena() );
 	const TVariantSize correctMaxSize = context.PushMaxSize( reference, maxSize );
-	root->Build( context, variants, correctMaxSize );
-	const TVariantSize topMaxSize = context.PopMaxSize( reference );
-	debug_check_logic( topMaxSize == correctMaxSize );
+	( static_cast<bool>( factoredRoot ) ? factoredRoot : root )->Build(
+		context, variants, correctMaxSize );
+	popMaxSize( context, correctMaxSize );
 
 	if( !variants.empty() && variants.front().empty() ) {
 		variants.erase( variants.begin() );
 	}
 
+	for( CPatternVariant& variant : variants ) {
+		addInstance( context, variant );
+	}
+}
+
+// Passes nonempty variants of the root as instances of the pattern
+class CPattern::CInstanceCallback : public IVariantCallback {
+public:
+	CInstanceCallback( const CPattern& _pattern,
+			CPatternBuildContext& _context, IVariantCallback& _callback ) :
+		pattern( _pattern ),
+		context( _context ),
+		callback( _callback )
+	{
+	}
+
+	void OnVariant( CPatternVariant& variant ) override
+	{
+		if( !variant.empty() ) {
+			pattern.addInstance( context, variant );
+			callback.OnVariant( variant );
+		}
+	}
+
+private:
+	const CPattern& pattern;
+	CPatternBuildContext& context;
+	IVariantCallback& callback;
+};
+
+void CPattern::Stream( CPatternBuildContext& context,
+	IVariantCallback& callback, const TVariantSize maxSize ) const
+{
+	CArena::CScope arenaScope( context.Arena() );
+	const TVariantSize correctMaxSize = context.PushMaxSize( reference, maxSize );
+	CInstanceCallback instanceCallback( *this, context, callback );
+	( static_cast<bool>( factoredRoot ) ? factoredRoot : root )->Stream(
+		context, instanceCallback, correctMaxSize );
+	popMaxSize( context, correctMaxSize );
+}
+
+void CPattern::popMaxSize( CPatternBuildContext& context,
+	const TVariantSize correctMaxSize ) const
+{
+	const TVariantSize topMaxSize = context.PopMaxSize( reference );
+	debug_check_logic( topMaxSize == correctMaxSize );
+	static_cast<void>( topMaxSize );
+}
+
+void CPattern::addInstance( CPatternBuildContext& context,
+	CPatternVariant& variant ) const
+{
 	// correct ids and add first part
 	const TElement mainSize =
 		context.Patterns().Configuration().Attributes().Main().ValuesCount();
-	for( CPatternVariant& variant : variants ) {
-		variant.Parts.push_front( this );
-		variant.Parts.push_back( nullptr );
+	variant.Parts.Enclose( this );
 
-		for( CPatternWord& word : variant ) {
-			if( word.Id.Type != PAT_Element ) {
-				continue;
-			}
-			for( CPatternArguments::size_type i = 0; i < arguments.size(); i++ ) {
-				if( word.Id.Element == arguments[i].Element ) {
-					word.Id.Type = PAT_ReferenceElement;
-					word.Id.Element = word.Id.Element % mainSize + i * mainSize;
-					word.Id.Reference = reference;
-					break;
-				}
+	const auto addArgumentWord = [&]( const CPatternWord* word )
+		-> const CPatternWord*
+	{
+		if( word->Id.Type != PAT_Element ) {
+			return word;
+		}
+		for( CPatternArguments::size_type i = 0; i < arguments.size(); i++ ) {
+			if( word->Id.Element == arguments[i].Element ) {
+				CPatternWord argumentWord = *word;
+				argumentWord.Id.Type = PAT_ReferenceElement;
+				argumentWord.Id.Element =
+					argumentWord.Id.Element % mainSize + i * mainSize;
+				argumentWord.Id.Reference = reference;
+				return context.Words().Add( argumentWord );
 			}
 		}
+		return word;
+	};
+	for( const CPatternWord*& word : variant ) {
+		word = context.Words().Replace( word, addArgumentWord );
 	}
 }
 
+void CPattern::Factor( const CPatterns& context )
+{
+	factoredRoot = root->Factored( context );
+}
+
 TVariantPartType CPattern::Type() const
 {
 	return VPR_Instance;
@@ -1017,7 +1959,11 @@ TReference CPatterns::PatternReference( const string& name,
 ///////////////////////////////////////////////////////////////////////////////
 
 CPatternWord::CPatternWord( const string* const regexp ) :
-	Regexp( regexp )
+	Regexp( regexp ),
+	Span( nullptr ),
+	MinCount( 1 ),
+	MaxCount( 1 ),
+	Text( nullptr )
 {
 	debug_check_logic( Regexp != nullptr );
 }
@@ -1026,42 +1972,346 @@ CPatternWord::CPatternWord( const CPatternArgument id,
 		const CSignRestrictions& signRestrictions ) :
 	Id( id ),
 	Regexp( nullptr ),
-	SignRestrictions( signRestrictions )
+	Span( nullptr ),
+	SignRestrictions( signRestrictions ),
+	MinCount( 1 ),
+	MaxCount( 1 ),
+	Text( nullptr )
 {
 	debug_check_logic( Id.Type == PAT_Element );
 }
 
-void CPatternWord::Build( CPatternBuildContext& context ) const
+CPatternWord::CPatternWord( const CSpanAutomaton* span,
+		const CPatternArgument id ) :
+	Id( id ),
+	Regexp( nullptr ),
+	Span( span ),
+	MinCount( 1 ),
+	MaxCount( 1 ),
+	Text( nullptr )
+{
+	debug_check_logic( Span != nullptr );
+	debug_check_logic( Id.Type == PAT_None || Id.Type == PAT_ReferenceElement );
+}
+
+CPatternWord::CPatternWord( const vector<const CPatternWord*>& group,
+		const TVariantSize minCount, const TVariantSize maxCount ) :
+	Regexp( nullptr ),
+	Span( nullptr ),
+	MinCount( minCount ),
+	MaxCount( maxCount ),
+	Group( group ),
+	Text( nullptr )
 {
-	const TStateIndex state = context.LastVariant.empty()
-		? 0 : context.LastVariant.back().second;
+	debug_check_logic( Group.size() > 1 );
+}
+
+CPatternWord::CPatternWord( const vector<const CPatternWord*>& words,
+		const vector<vector<TVariantSize>>& transposition ) :
+	Regexp( nullptr ),
+	Span( nullptr ),
+	MinCount( 1 ),
+	MaxCount( 1 ),
+	Group( words ),
+	Transposition( transposition ),
+	Text( nullptr )
+{
+	debug_check_logic( !Group.empty() && Transposition.size() > 1 );
+}
+
+size_t CPatternWord::MinSize() const
+{
+	if( !IsTransposition() ) {
+		return MinCount * Size();
+	}
+	// elements are left out all together by another variant
+	size_t minSize = 0;
+	for( const vector<TVariantSize>& sizes : Transposition ) {
+		minSize += *min_element( sizes.cbegin(), sizes.cend() );
+	}
+	return max<size_t>( minSize, 1 );
+}
+
+size_t CPatternWord::MaxSize() const
+{
+	if( !IsTransposition() ) {
+		return MaxCount * Size();
+	}
+	size_t maxSize = 0;
+	for( const vector<TVariantSize>& sizes : Transposition ) {
+		maxSize += *max_element( sizes.cbegin(), sizes.cend() );
+	}
+	return maxSize;
+}
+
+TStateIndex CPatternWord::Build( CPatternBuildContext& context,
+	const TStateIndex state, const TVariantSize slot ) const
+{
+	if( IsTransposition() ) {
+		const auto key = make_pair( state, Text );
+		auto nextState = context.NextStates.find( key );
+		if( nextState == context.NextStates.end() ) {
+			nextState = context.NextStates.insert( make_pair( key,
+				buildTransposition( context, state ) ) ).first;
+		}
+		return nextState->second;
+	}
 
 	const TStateIndex nextStateIndex = context.States.size();
+	const auto nextState = context.NextStates.insert(
+		make_pair( make_pair( state, Text ), nextStateIndex ) );
+	if( !nextState.second ) {
+		return nextState.first->second;
+	}
+
 	context.States.emplace_back();
 	context.States.back().Actions = Actions;
+	context.StateWords.push_back( make_pair( state, this ) );
+	if( IsRepeated() ) {
+		// the state is reached after each repetition of the word
+		CState& loopState = context.States[nextStateIndex];
+		loopState.LoopSlot = slot;
+		loopState.LoopSize = Size();
+		loopState.LoopMinCount = MinCount;
+		loopState.LoopMaxCount = MaxCount;
+	}
 
-	CTransitionPtr transition;
-	if( Regexp != nullptr ) {
-		transition.reset( new CWordTransition(
-			RegexEx( ToStringEx( *Regexp ) ),
-			nextStateIndex ) );
+	if( Group.empty() ) {
+		context.States[state].Transitions.emplace_back(
+			buildTransition( context, nextStateIndex ) );
+		if( IsRepeated() ) {
+			context.States[nextStateIndex].Transitions.emplace_back(
+				buildTransition( context, nextStateIndex ) );
+		}
 	} else {
-		transition.reset( new CAttributesTransition(
-			SignRestrictions.Build( context.Patterns().Configuration() ),
-			nextStateIndex ) );
+		// the first word leads from the state and from the loop state
+		// to the states of the next words of the group,
+		// the last word leads back to the loop state
+		debug_check_logic( Actions.IsEmpty() );
+		context.States[nextStateIndex].Actions = Group.back()->Actions;
+		TStateIndex groupState = nextStateIndex;
+		for( size_t i = 0; i < Group.size(); i++ ) {
+			const CPatternWord* const word = Group[i];
+			TStateIndex wordState = nextStateIndex;
+			if( i + 1 < Group.size() ) {
+				wordState = context.States.size();
+				context.States.emplace_back();
+				context.States.back().Actions = word->Actions;
+				context.StateWords.push_back( make_pair( groupState, word ) );
+			}
+			if( i == 0 ) {
+				context.States[state].Transitions.emplace_back(
+					word->buildTransition( context, wordState ) );
+			}
+			context.States[groupState].Transitions.emplace_back(
+				word->buildTransition( context, wordState ) );
+			groupState = wordState;
+		}
+	}
+
+	debug_check_logic( context.StateWords.size() == context.States.size() );
+	return nextStateIndex;
+}
+
+// States of the transposition are keyed by masks of elements which are
+// matched or left out. Elements are matched in the order of their indices
+// and then in the reverse order, like in CTranspositionSupport, so each
+// sequence of words is matched by one path. An element before the last
+// matched one is matched only if the elements after it which are not matched
+// may be left out, and they are left out by it. States are added in the order
+// of masks, so transitions lead from each state to the states after it.
+TStateIndex CPatternWord::buildTransposition( CPatternBuildContext& context,
+	const TStateIndex state ) const
+{
+	const size_t size = Transposition.size();
+	debug_check_logic( size < numeric_limits<size_t>::digits );
+	typedef size_t TMask;
+	const TMask all = ( TMask( 1 ) << size ) - 1;
+	// elements which may be left out and elements with words
+	TMask optional = 0;
+	TMask nonEmpty = 0;
+	for( size_t element = 0; element < size; element++ ) {
+		for( const TVariantSize variantSize : Transposition[element] ) {
+			( variantSize == 0 ? optional : nonEmpty ) |= TMask( 1 ) << element;
+		}
+	}
+	// returns the mask after the element or 0 if it cannot be matched
+	const auto nextMask = [&]( const TMask mask, const size_t element ) -> TMask
+	{
+		const TMask bit = TMask( 1 ) << element;
+		if( ( mask & bit ) != 0 || ( nonEmpty & bit ) == 0 ) {
+			return 0;
+		}
+		if( ( mask >> element ) == 0 ) {
+			return ( mask | bit );
+		}
+		const TMask after = all & ~( bit - 1 );
+		return ( ( after & ~mask & ~optional & ~bit ) == 0 ? mask | after : 0 );
+	};
+	const auto isFinal = [&]( const TMask mask ) -> bool
+	{
+		return ( ( all & ~mask & ~optional ) == 0 );
+	};
+
+	// transitions are added after the states they lead to,
+	// those by the last words of variants lead to states of masks
+	struct CTransition {
+		TStateIndex State;
+		TTransposedWord Word;
+		TStateIndex NextState;
+		TMask NextMask;
+	};
+	vector<CTransition> transitions;
+	vector<TStateIndex> maskStates( all + 1, 0 );
+	vector<pair<TStateIndex, const CPatternWord*>> maskWords( all + 1,
+		pair<TStateIndex, const CPatternWord*>( 0, nullptr ) );
+	vector<bool> isReached( all + 1, false );
+	isReached[0] = true;
+	// actions of the last words of variants are run by the states of masks
+	vector<CActions> lastActions( Group.size() );
+	bool hasLastActions = false;
+	const auto addState = [&]( const pair<TStateIndex, const CPatternWord*>&
+		stateWord ) -> TStateIndex
+	{
+		context.States.emplace_back();
+		context.StateWords.push_back( stateWord );
+		return ( context.States.size() - 1 );
+	};
+
+	for( TMask mask = 0; mask < all; mask++ ) {
+		if( !isReached[mask] ) {
+			continue;
+		}
+		bool hasNext = false;
+		for( size_t element = 0; element < size; element++ ) {
+			hasNext |= ( nextMask( mask, element ) != 0 );
+		}
+		if( !hasNext ) {
+			continue;
+		}
+		maskStates[mask] = ( mask == 0 ) ? state : addState( maskWords[mask] );
+
+		TTransposedWord variantWord = 0;
+		for( size_t element = 0; element < size; element++ ) {
+			const TMask next = nextMask( mask, element );
+			for( const TVariantSize variantSize : Transposition[element] ) {
+				const TTransposedWord firstWord = variantWord;
+				variantWord += variantSize;
+				if( next == 0 || variantSize == 0 ) {
+					continue;
+				}
+				TStateIndex wordState = maskStates[mask];
+				for( TTransposedWord word = firstWord;
+					word + 1 < variantWord; word++ )
+				{
+					const TStateIndex nextState =
+						addState( make_pair( wordState, Group[word] ) );
+					context.States[nextState].Actions = Group[word]->Actions;
+					transitions.push_back( { wordState, word, nextState, 0 } );
+					wordState = nextState;
+				}
+				const TTransposedWord lastWord = variantWord - 1;
+				transitions.push_back( { wordState, lastWord, 0, next } );
+				if( !isReached[next] ) {
+					isReached[next] = true;
+					maskWords[next] = make_pair( wordState, Group[lastWord] );
+				}
+				lastActions[lastWord] = Group[lastWord]->Actions;
+				hasLastActions |= !Group[lastWord]->Actions.IsEmpty();
+			}
+		}
+	}
+
+	// the state after all the elements
+	pair<TStateIndex, const CPatternWord*> finalWord = maskWords[all];
+	for( const CTransition& transition : transitions ) {
+		if( finalWord.second == nullptr && transition.NextMask != 0
+			&& isFinal( transition.NextMask ) )
+		{
+			finalWord = make_pair( transition.State, Group[transition.Word] );
+		}
+	}
+	const TStateIndex finalState = addState( finalWord );
+	maskStates[all] = finalState;
+
+	if( hasLastActions ) {
+		const CActionPtr action(
+			new CTranspositionActions( move( lastActions ) ) );
+		for( TMask mask = 1; mask <= all; mask++ ) {
+			if( maskStates[mask] != 0 ) {
+				context.States[maskStates[mask]].Actions.Add( action );
+			}
+		}
 	}
 
-	context.States[state].Transitions.emplace_back( transition.release() );
+	const auto addTransition = [&]( const CTransition& transition,
+		const TStateIndex nextState )
+	{
+		CTransitionPtr wordTransition =
+			Group[transition.Word]->buildTransition( context, nextState );
+		wordTransition->SetTransposedWord( transition.Word );
+		context.States[transition.State].Transitions.emplace_back(
+			move( wordTransition ) );
+	};
+	for( const CTransition& transition : transitions ) {
+		if( transition.NextMask == 0 ) {
+			addTransition( transition, transition.NextState );
+			continue;
+		}
+		if( maskStates[transition.NextMask] != 0 ) {
+			addTransition( transition, maskStates[transition.NextMask] );
+		}
+		if( transition.NextMask != all && isFinal( transition.NextMask ) ) {
+			addTransition( transition, finalState );
+		}
+	}
 
-	ostringstream oss;
-	Print( context.Patterns(), oss );
-	context.LastVariant.push_back( make_pair( oss.str(), nextStateIndex ) );
+	debug_check_logic( context.StateWords.size() == context.States.size() );
+	return finalState;
+}
+
+CTransitionPtr CPatternWord::buildTransition( CPatternBuildContext& context,
+	const TStateIndex nextStateIndex ) const
+{
+	if( Span != nullptr ) {
+		return CTransitionPtr( new CSpanTransition( Span->Index, nextStateIndex ) );
+	} else if( Regexp != nullptr ) {
+		return CTransitionPtr( new CWordTransition(
+			RegexEx( ToStringEx( *Regexp ) ), nextStateIndex ) );
+	}
+	return CTransitionPtr( new CAttributesTransition(
+		SignRestrictions.Build( context.Patterns().Configuration() ),
+		context.AttributesTransitions++, nextStateIndex ) );
 }
 
 void CPatternWord::Print( const CPatterns& context, ostream& out ) const
 {
-	if( Regexp != nullptr ) {
+	if( IsTransposition() ) {
+		size_t word = 0;
+		for( size_t element = 0; element < Transposition.size(); element++ ) {
+			out << ( element == 0 ? "(" : " ~ (" );
+			for( size_t i = 0; i < Transposition[element].size(); i++ ) {
+				out << ( i == 0 ? "" : " |" );
+				for( TVariantSize w = 0; w < Transposition[element][i]; w++ ) {
+					out << " " << *Group[word++]->Text;
+				}
+			}
+			out << " )";
+		}
+		return;
+	}
+	if( IsRepeated() ) {
+		out << "{ ";
+	}
+	if( !Group.empty() ) {
+		for( size_t i = 0; i < Group.size(); i++ ) {
+			out << ( i == 0 ? "" : " " ) << *Group[i]->Text;
+		}
+	} else if( Regexp != nullptr ) {
 		out << '"' << *Regexp << '"';
+	} else if( Span != nullptr ) {
+		out << "[" << Span->Name << "]";
+		Actions.Print( context.Configuration(), out );
 	} else {
 		if( Id.Type != PAT_None ) {
 			//debug_check_logic( Id.Type == PAT_ReferenceElement );
@@ -1070,44 +2320,732 @@ void CPatternWord::Print( const CPatterns& context, ostream& out ) const
 		SignRestrictions.Print( context, out );
 		Actions.Print( context.Configuration(), out );
 	}
+	if( IsRepeated() ) {
+		out << " }<"
+			<< static_cast<size_t>( MinCount ) << ","
+			<< static_cast<size_t>( MaxCount ) << ">";
+	}
 }
 
-void CPatternVariant::Build( CPatternBuildContext& context ) const
+///////////////////////////////////////////////////////////////////////////////
+
+CPatternWords::CPatternWords( const CPatterns& _patterns ) :
+	patterns( _patterns )
 {
-	auto i = this->cbegin();
-	auto j = context.LastVariant.begin();
+}
 
-	while( i != this->cend() && j != context.LastVariant.end() ) {
-		ostringstream oss;
-		i->Print( context.Patterns(), oss );
-		if( j->first != oss.str() ) {
+const CPatternWord* CPatternWords::Add( const CPatternWord& word )
+{
+	ostringstream text;
+	word.Print( patterns, text );
+	string key = text.str();
+	if( word.Span != nullptr && word.Id.Defined() ) {
+		ostringstream head;
+		word.Id.Print( patterns, head );
+		key += "\n" + head.str();
+	}
+
+	auto pair = indices.insert( make_pair( key, nullptr ) );
+	if( pair.second ) {
+		words.push_back( word );
+		words.back().Text = &*texts.insert( text.str() ).first;
+		pair.first->second = &words.back();
+	}
+	return pair.first->second;
+}
+
+const CPatternWord* CPatternWords::AddAction( const CPatternWord* word,
+	const CActionPtr& action )
+{
+	const CWordAction wordAction( word, action.get() );
+	auto i = wordsWithActions.find( wordAction );
+	if( i == wordsWithActions.end() ) {
+		CPatternWord wordCopy = *word;
+		wordCopy.Actions.Add( action );
+		i = wordsWithActions.insert( make_pair( wordAction,
+			Add( wordCopy ) ) ).first;
+	}
+	return i->second;
+}
+
+size_t CPatternWords::CWordActionHasher::operator()(
+	const CWordAction& wordAction ) const
+{
+	return ( hash<const CPatternWord*>()( wordAction.first )
+		^ ( hash<const IAction*>()( wordAction.second ) << 1 ) );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const CActionPtr& CConditionActions::StrongAgreement( const TSign sign,
+	const TVariantSize distance )
+{
+	startKey( 's', sign );
+	key.append( reinterpret_cast<const char*>( &distance ), sizeof( distance ) );
+	CActionPtr& action = find();
+	if( !action ) {
+		action.reset( new CAgreementAction( sign, distance ) );
+	}
+	return action;
+}
+
+const CActionPtr& CConditionActions::Agreement( const TSign sign,
+	const TVariantSize offset, const TVariantSize* words, const size_t count )
+{
+	startKey( 'a', sign );
+	addToKey( offset, words, count );
+	CActionPtr& action = find();
+	if( !action ) {
+		action.reset( new CAgreementAction( sign, offset,
+			vector<TVariantSize>( words, words + count ) ) );
+	}
+	return action;
+}
+
+const CActionPtr& CConditionActions::LoopAgreement( const TSign sign,
+	const bool strong, const TVariantSize offset, const TVariantSize loop,
+	const TVariantSize* words, const size_t count )
+{
+	vector<CLoopAgreementAction::CWords> loopWords;
+	for( size_t i = 0; i < count; i++ ) {
+		debug_check_logic( loop <= offset );
+		if( words[i] < loop ) {
+			loopWords.push_back( { CLoopAgreementAction::WT_BeforeLoop,
+				Cast<TVariantSize>( loop - words[i] ) } );
+		} else if( words[i] == loop ) {
+			loopWords.push_back( { CLoopAgreementAction::WT_Loop,
+				Cast<TVariantSize>( offset == loop ? 1 : offset - loop ) } );
+		} else {
+			loopWords.push_back( { CLoopAgreementAction::WT_Current,
+				Cast<TVariantSize>( offset - words[i] ) } );
+		}
+	}
+
+	startKey( strong ? 'L' : 'l', sign );
+	for( const CLoopAgreementAction::CWords& loopWord : loopWords ) {
+		key.push_back( static_cast<char>( loopWord.Type ) );
+		key.append( reinterpret_cast<const char*>( &loopWord.Distance ),
+			sizeof( loopWord.Distance ) );
+	}
+	CActionPtr& action = find();
+	if( !action ) {
+		action.reset( new CLoopAgreementAction( sign, strong, loopWords ) );
+	}
+	return action;
+}
+
+const CActionPtr& CConditionActions::TranspositionAgreement(
+	const TSign sign, const bool strong,
+	const vector<CTranspositionAgreementAction::CWords>& words )
+{
+	startKey( strong ? 'T' : 't', sign );
+	for( const CTranspositionAgreementAction::CWords& word : words ) {
+		key.push_back( static_cast<char>( word.Type ) );
+		key.append( reinterpret_cast<const char*>( &word.Word ),
+			sizeof( word.Word ) );
+	}
+	CActionPtr& action = find();
+	if( !action ) {
+		action.reset( new CTranspositionAgreementAction( sign, strong, words ) );
+	}
+	return action;
+}
+
+const CActionPtr& CConditionActions::Dictionary(
+	const Configuration::TDictionary dictionary, const TVariantSize offset,
+	const TVariantSize* words, const size_t count )
+{
+	startKey( 'd', dictionary );
+	addToKey( offset, words, count );
+	CActionPtr& action = find();
+	if( !action ) {
+		action.reset( new CDictionaryAction( dictionary, offset,
+			vector<TVariantSize>( words, words + count ) ) );
+	}
+	return action;
+}
+
+void CConditionActions::startKey( const char type, const size_t index )
+{
+	key.clear();
+	key.push_back( type );
+	key.append( reinterpret_cast<const char*>( &index ), sizeof( index ) );
+}
+
+// actions depend only on offsets of words relative to the offset
+void CConditionActions::addToKey( const TVariantSize offset,
+	const TVariantSize* words, const size_t count )
+{
+	for( size_t i = 0; i < count; i++ ) {
+		const TVariantSize distance =
+			words[i] < MaxVariantSize ? offset - words[i] : MaxVariantSize;
+		key.append( reinterpret_cast<const char*>( &distance ),
+			sizeof( distance ) );
+	}
+}
+
+CActionPtr& CConditionActions::find()
+{
+	auto i = actions.find( key );
+	if( i == actions.end() ) {
+		i = actions.insert( make_pair( key, CActionPtr() ) ).first;
+	}
+	return i->second;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// The part of a word, the instance enclosing parts Left,
+// the concatenation of Left and Right, Count repetitions of the word Left,
+// parts Left of a group of words, which is one word, or parts Left of
+// a variant of an element of a transposition, which is one word, followed
+// by the transposition node Right of the next variant.
+struct CPatternVariantParts::CNode {
+	enum TType {
+		T_Word,
+		T_Instance,
+		T_Concatenation,
+		T_Repetition,
+		T_Group,
+		T_Transposition
+	};
+
+	TType Type;
+	const CBaseVariantPart* Part;
+	const CNode* Left;
+	const CNode* Right;
+	TVariantSize Count;
+	size_t Size; // number of parts
+	size_t WordsCount; // number of parts of words
+
+	CNode( const TType type, const CBaseVariantPart* part,
+		const CNode* left, const CNode* right, const TVariantSize count = 1 );
+};
+
+CPatternVariantParts::CNode::CNode( const TType type,
+		const CBaseVariantPart* part, const CNode* left, const CNode* right,
+		const TVariantSize count ) :
+	Type( type ),
+	Part( part ),
+	Left( left ),
+	Right( right ),
+	Count( count ),
+	Size( 1 ),
+	WordsCount( 1 )
+{
+	switch( Type ) {
+		case T_Word:
+			break;
+		case T_Instance:
+			Size = ( Left == nullptr ? 0 : Left->Size ) + 2;
+			WordsCount = ( Left == nullptr ? 0 : Left->WordsCount );
+			break;
+		case T_Concatenation:
+			Size = Left->Size + Right->Size;
+			WordsCount = Left->WordsCount + Right->WordsCount;
+			break;
+		case T_Repetition:
+			Size = Count * Left->Size;
+			WordsCount = Count * Left->WordsCount;
+			break;
+		case T_Group:
+			Size = Left->Size;
+			break;
+		case T_Transposition:
+			Size = Left->Size + ( Right == nullptr ? 0 : Right->Size );
+			break;
+	}
+}
+
+CPatternVariantParts::CPatternVariantParts( const CBaseVariantPart* part ) :
+	root( newNode( CNode( CNode::T_Word, part, nullptr, nullptr ) ) )
+{
+}
+
+size_t CPatternVariantParts::Size() const
+{
+	return ( root == nullptr ? 0 : root->Size );
+}
+
+CPatternVariantParts& CPatternVariantParts::operator+=(
+	const CPatternVariantParts& parts )
+{
+	if( root == nullptr ) {
+		root = parts.root;
+	} else if( parts.root != nullptr ) {
+		root = newNode( CNode( CNode::T_Concatenation,
+			nullptr, root, parts.root ) );
+	}
+	return *this;
+}
+
+void CPatternVariantParts::Enclose( const CBaseVariantPart* instance )
+{
+	root = newNode( CNode( CNode::T_Instance, instance, root, nullptr ) );
+}
+
+void CPatternVariantParts::ReplaceInstance( const CBaseVariantPart* instance )
+{
+	check_logic( root != nullptr && root->Type == CNode::T_Instance );
+	root = newNode( CNode( CNode::T_Instance, instance, root->Left, nullptr ) );
+}
+
+void CPatternVariantParts::Group()
+{
+	check_logic( root != nullptr );
+	root = newNode( CNode( CNode::T_Group, nullptr, root, nullptr ) );
+}
+
+void CPatternVariantParts::Repeat( const TVariantSize word,
+	const TVariantSize count )
+{
+	root = replace( root, word, [count]( const CNode* node ) -> const CNode*
+	{
+		switch( node->Type ) {
+			case CNode::T_Word:
+				return newNode( CNode( CNode::T_Repetition,
+					nullptr, node, nullptr, count ) );
+			case CNode::T_Group:
+				return newNode( CNode( CNode::T_Repetition,
+					nullptr, node->Left, nullptr, count ) );
+			default: // repeated words are not repeated again
+				check_logic( false );
+				return nullptr;
+		}
+	} );
+}
+
+void CPatternVariantParts::Transposition(
+	const vector<CPatternVariantParts>& variants )
+{
+	root = nullptr;
+	for( auto variant = variants.crbegin(); variant != variants.crend();
+		++variant )
+	{
+		check_logic( variant->root != nullptr );
+		root = newNode( CNode( CNode::T_Transposition,
+			nullptr, variant->root, root ) );
+	}
+	check_logic( root != nullptr );
+}
+
+void CPatternVariantParts::Transpose( const TVariantSize word,
+	const vector<size_t>& order )
+{
+	root = replace( root, word, [&order]( const CNode* node ) -> const CNode*
+	{
+		check_logic( node->Type == CNode::T_Transposition && !order.empty() );
+		vector<const CNode*> variants;
+		for( ; node != nullptr; node = node->Right ) {
+			variants.push_back( node->Left );
+		}
+		const CNode* transposed = nullptr;
+		for( const size_t variant : order ) {
+			check_logic( variant < variants.size() );
+			transposed = ( transposed == nullptr ) ? variants[variant]
+				: newNode( CNode( CNode::T_Concatenation,
+					nullptr, transposed, variants[variant] ) );
+		}
+		return transposed;
+	} );
+}
+
+size_t CPatternVariantParts::Build( CVariantParts& parts,
+	const TVariantSize word, size_t& wordSize,
+	vector<size_t>& variantSizes ) const
+{
+	parts.clear();
+	parts.reserve( Size() );
+	variantSizes.clear();
+	size_t words = 0;
+	size_t wordPart = Size();
+	wordSize = 0;
+	if( root != nullptr ) {
+		build( root, parts, word, words, wordPart, wordSize, variantSizes );
+	}
+	return wordPart;
+}
+
+// nodes are released only with the arena
+const CPatternVariantParts::CNode* CPatternVariantParts::newNode(
+	const CNode& node )
+{
+	CArena* const arena = CArena::Current();
+	check_logic( arena != nullptr );
+	return new( arena->Allocate( sizeof( CNode ) ) ) CNode( node );
+}
+
+template<typename TReplace>
+const CPatternVariantParts::CNode* CPatternVariantParts::replace(
+	const CNode* node, const TVariantSize word, TReplace replaceNode )
+{
+	check_logic( node != nullptr && word < node->WordsCount );
+	switch( node->Type ) {
+		case CNode::T_Word:
+		case CNode::T_Group:
+		case CNode::T_Transposition:
+			return replaceNode( node );
+		case CNode::T_Instance:
+			return newNode( CNode( CNode::T_Instance, node->Part,
+				replace( node->Left, word, replaceNode ), nullptr ) );
+		case CNode::T_Concatenation:
+			if( word < node->Left->WordsCount ) {
+				return newNode( CNode( CNode::T_Concatenation, nullptr,
+					replace( node->Left, word, replaceNode ), node->Right ) );
+			}
+			return newNode( CNode( CNode::T_Concatenation, nullptr, node->Left,
+				replace( node->Right, word - node->Left->WordsCount,
+					replaceNode ) ) );
+		case CNode::T_Repetition: // repeated words are not replaced again
+			break;
+	}
+	check_logic( false );
+	return nullptr;
+}
+
+void CPatternVariantParts::build( const CNode* node, CVariantParts& parts,
+	const TVariantSize word, size_t& words, size_t& wordPart,
+	size_t& wordSize, vector<size_t>& variantSizes )
+{
+	switch( node->Type ) {
+		case CNode::T_Word:
+			if( words == word ) {
+				wordPart = parts.size();
+				wordSize = 1;
+			}
+			words++;
+			parts.push_back( node->Part );
+			break;
+		case CNode::T_Instance:
+			parts.push_back( node->Part );
+			if( node->Left != nullptr ) {
+				build( node->Left, parts, word, words, wordPart, wordSize,
+					variantSizes );
+			}
+			parts.push_back( nullptr );
+			break;
+		case CNode::T_Concatenation:
+			build( node->Left, parts, word, words, wordPart, wordSize,
+				variantSizes );
+			build( node->Right, parts, word, words, wordPart, wordSize,
+				variantSizes );
+			break;
+		case CNode::T_Repetition:
+			for( TVariantSize i = 0; i < node->Count; i++ ) {
+				build( node->Left, parts, word, words, wordPart, wordSize,
+					variantSizes );
+			}
+			break;
+		case CNode::T_Group:
+		case CNode::T_Transposition:
+		{
+			const bool isWord = ( words == word );
+			if( isWord ) {
+				wordPart = parts.size();
+				wordSize = node->Size;
+			}
+			words++;
+			// words of the group or the variants are not counted
+			size_t groupWords = 0;
+			size_t groupPart = 0;
+			size_t groupSize = 0;
+			vector<size_t> groupVariantSizes;
+			if( node->Type == CNode::T_Group ) {
+				build( node->Left, parts, MaxVariantSize,
+					groupWords, groupPart, groupSize, groupVariantSizes );
+				break;
+			}
+			for( ; node != nullptr; node = node->Right ) {
+				if( isWord ) {
+					variantSizes.push_back( node->Left->Size );
+				}
+				build( node->Left, parts, MaxVariantSize,
+					groupWords, groupPart, groupSize, groupVariantSizes );
+			}
 			break;
 		}
-		++i;
-		++j;
 	}
-	debug_check_logic( i != this->cend() );
-	context.LastVariant.erase( j, context.LastVariant.end() );
+}
+
+///////////////////////////////////////////////////////////////////////////////
 
-	for( ; i != this->cend(); ++i ) {
-		i->Build( context );
+TVariantSize CPatternVariant::RepeatedWord() const
+{
+	for( TVariantSize word = 0; word < this->size(); word++ ) {
+		if( ( *this )[word]->IsRepeated() ) {
+			return word;
+		}
 	}
+	return Cast<TVariantSize>( this->size() );
+}
 
-	context.States[context.LastVariant.back().second].Actions.Add(
-		CActionPtr(
-			new CSaveAction(
-				CVariantParts( Parts.cbegin(), Parts.cend() ) ) ) );
+TVariantSize CPatternVariant::TranspositionWord() const
+{
+	for( TVariantSize word = 0; word < this->size(); word++ ) {
+		if( ( *this )[word]->IsTransposition() ) {
+			return word;
+		}
+	}
+	return Cast<TVariantSize>( this->size() );
 }
 
-void CPatternVariant::Print( const CPatterns& context, ostream& out ) const
+size_t CPatternVariant::MinSize() const
 {
-	for( const CPatternWord& word : *this ) {
-		out << " ";
-		word.Print( context, out );
+	size_t minSize = 0;
+	for( const CPatternWord* word : *this ) {
+		minSize += word->MinSize();
+	}
+	return minSize;
+}
+
+size_t CPatternVariant::MaxSize() const
+{
+	size_t maxSize = 0;
+	for( const CPatternWord* word : *this ) {
+		maxSize += word->MaxSize();
+	}
+	return maxSize;
+}
+
+void CPatternVariant::LimitSize( CPatternWords& words, const size_t maxSize )
+{
+	const TVariantSize word = RepeatedWord();
+	if( word == this->size() ) {
+		return;
+	}
+
+	CPatternWord repeatedWord = *( *this )[word];
+	debug_check_logic( MinSize() <= maxSize );
+	const size_t maxCount =
+		( maxSize - ( this->size() - 1 ) ) / repeatedWord.Size();
+	if( maxCount < repeatedWord.MaxCount ) {
+		repeatedWord.MaxCount = Cast<TVariantSize>( maxCount );
+		( *this )[word] = words.Add( repeatedWord );
+		if( repeatedWord.MinCount == repeatedWord.MaxCount ) {
+			repeat( words, word, repeatedWord.MinCount );
+		}
+	}
+}
+
+void CPatternVariant::Unroll( CPatternWords& words,
+	CPatternVariants& variants ) const
+{
+	if( HasTransposition() ) {
+		unrollTransposition( words, variants );
+		return;
+	}
+	const TVariantSize word = RepeatedWord();
+	if( word == this->size() ) {
+		variants.push_back( *this );
+		return;
+	}
+
+	const CPatternWord& repeatedWord = *( *this )[word];
+	for( TVariantSize count = repeatedWord.MinCount;
+		count <= repeatedWord.MaxCount; count++ )
+	{
+		variants.push_back( *this );
+		variants.back().repeat( words, word, count );
+	}
+}
+
+// replaces the repeated word with count words or groups of words
+void CPatternVariant::repeat( CPatternWords& words, const TVariantSize word,
+	const TVariantSize count )
+{
+	CPatternWord repeatedWord = *( *this )[word];
+	debug_check_logic( repeatedWord.MinCount <= count );
+	debug_check_logic( count <= repeatedWord.MaxCount );
+	if( repeatedWord.Group.empty() ) {
+		repeatedWord.MinCount = 1;
+		repeatedWord.MaxCount = 1;
+		const CPatternWord* const singleWord = words.Add( repeatedWord );
+		( *this )[word] = singleWord;
+		this->insert( this->begin() + word, count - 1, singleWord );
+	} else {
+		const vector<const CPatternWord*>& group = repeatedWord.Group;
+		this->erase( this->begin() + word );
+		for( TVariantSize i = 0; i < count; i++ ) {
+			this->insert( this->begin() + word, group.cbegin(), group.cend() );
+		}
+	}
+	Parts.Repeat( word, count );
+
+	// offsets of words of loop agreements are fixed by unrolling
+	for( size_t i = word; i < this->size(); i++ ) {
+		const CPatternWord* const loopWord = ( *this )[i];
+		if( loopWord->Actions.DependsOnLoop() ) {
+			CPatternWord unrolledWord = *loopWord;
+			unrolledWord.Actions = loopWord->Actions.Unrolled(
+				Cast<TVariantSize>( i - word ) );
+			( *this )[i] = words.Add( unrolledWord );
+		}
+	}
+}
+
+// Variants of elements are combined in each order of CTranspositionSupport,
+// as they are expanded without the transposition word, sequences of the same
+// variants are added once, since elements may be left out.
+void CPatternVariant::unrollTransposition( CPatternWords& words,
+	CPatternVariants& variants ) const
+{
+	const TVariantSize word = TranspositionWord();
+	const vector<vector<TVariantSize>>& transposition =
+		( *this )[word]->Transposition;
+	const size_t size = transposition.size();
+	// index of each variant of each element in the parts of the variants
+	const size_t NoVariant = numeric_limits<size_t>::max();
+	vector<vector<size_t>> indices( size );
+	size_t variantsCount = 0;
+	for( size_t element = 0; element < size; element++ ) {
+		for( const TVariantSize variantSize : transposition[element] ) {
+			indices[element].push_back(
+				variantSize == 0 ? NoVariant : variantsCount++ );
+		}
+	}
+
+	set<vector<size_t>> orders;
+	// variant of the element at each position
+	vector<size_t> choices( size );
+	for( size_t t = 0; t < CTranspositionSupport::Count( size ); t++ ) {
+		fill( choices.begin(), choices.end(), 0 );
+		bool hasNext = true;
+		while( hasNext ) {
+			vector<size_t> order;
+			for( size_t pos = 0; pos < size; pos++ ) {
+				const size_t element = CTranspositionSupport::Element( size, t, pos );
+				if( indices[element][choices[pos]] != NoVariant ) {
+					order.push_back( indices[element][choices[pos]] );
+				}
+			}
+			if( !order.empty() && orders.insert( order ).second ) {
+				variants.push_back( *this );
+				variants.back().transpose( words, word, order );
+			}
+			// the next combination in the lexicographic order
+			hasNext = false;
+			for( size_t pos = size; pos > 0 && !hasNext; pos-- ) {
+				const size_t element =
+					CTranspositionSupport::Element( size, t, pos - 1 );
+				if( ++choices[pos - 1] < indices[element].size() ) {
+					hasNext = true;
+				} else {
+					choices[pos - 1] = 0;
+				}
+			}
+		}
+	}
+}
+
+// replaces the transposition word with the words of its variants in the order
+void CPatternVariant::transpose( CPatternWords& words, const TVariantSize word,
+	const vector<size_t>& order )
+{
+	const CPatternWord& transposedWord = *( *this )[word];
+	// the first word of each variant in the group
+	vector<size_t> firstWords;
+	size_t groupWord = 0;
+	for( const vector<TVariantSize>& sizes : transposedWord.Transposition ) {
+		for( const TVariantSize variantSize : sizes ) {
+			if( variantSize > 0 ) {
+				firstWords.push_back( groupWord );
+				groupWord += variantSize;
+			}
+		}
+	}
+	firstWords.push_back( groupWord );
+
+	// positions of words of the group in the order
+	vector<TVariantSize> positions( transposedWord.Group.size(), MaxVariantSize );
+	vector<const CPatternWord*> orderedWords;
+	for( const size_t variant : order ) {
+		for( size_t w = firstWords[variant]; w < firstWords[variant + 1]; w++ ) {
+			positions[w] = Cast<TVariantSize>( orderedWords.size() );
+			orderedWords.push_back( transposedWord.Group[w] );
+		}
+	}
+	this->erase( this->begin() + word );
+	this->insert( this->begin() + word,
+		orderedWords.cbegin(), orderedWords.cend() );
+	Parts.Transpose( word, order );
+
+	// offsets of words of transposition agreements are fixed by the order
+	for( size_t i = word; i < this->size(); i++ ) {
+		const CPatternWord* const orderedWord = ( *this )[i];
+		if( orderedWord->Actions.DependsOnTransposition() ) {
+			CPatternWord transposed = *orderedWord;
+			transposed.Actions = orderedWord->Actions.Transposed(
+				Cast<TVariantSize>( i - word ), positions );
+			( *this )[i] = words.Add( transposed );
+		}
+	}
+}
+
+bool CPatternVariant::Build( CPatternBuildContext& context ) const
+{
+	debug_check_logic( !this->empty() );
+	TStateIndex state = 0;
+	for( TVariantSize slot = 0; slot < this->size(); slot++ ) {
+		state = ( *this )[slot]->Build( context, state, slot );
+	}
+	CActions& actions = context.States[state].Actions;
+	if( actions.HasSave() ) {
+		return false;
+	}
+
+	CVariantParts parts;
+	size_t repeatedSize;
+	vector<size_t> variantSizes;
+	const TVariantSize variableWord =
+		HasTransposition() ? TranspositionWord() : RepeatedWord();
+	const size_t repeatedPart = Parts.Build( parts, variableWord,
+		repeatedSize, variantSizes );
+	CActionPtr saveAction;
+	if( HasTransposition() ) {
+		// parts of each variant of an element by its first word
+		const CPatternWord& transposedWord = *( *this )[variableWord];
+		vector<pair<size_t, size_t>> transposedParts(
+			transposedWord.Group.size(), pair<size_t, size_t>( 0, 0 ) );
+		size_t word = 0;
+		size_t part = repeatedPart;
+		auto variantSize = variantSizes.cbegin();
+		for( const vector<TVariantSize>& sizes : transposedWord.Transposition ) {
+			for( const TVariantSize size : sizes ) {
+				if( size > 0 ) {
+					check_logic( variantSize != variantSizes.cend() );
+					transposedParts[word] = make_pair( part, *variantSize );
+					word += size;
+					part += *variantSize;
+					++variantSize;
+				}
+			}
+		}
+		saveAction.reset( new CSaveAction( move( parts ), repeatedPart,
+			repeatedSize, move( transposedParts ) ) );
+	} else if( HasRepeatedWord() ) {
+		const CPatternWord& repeatedWord = *( *this )[variableWord];
+		saveAction.reset( new CSaveAction( move( parts ), repeatedPart,
+			repeatedSize, Cast<TVariantSize>( this->size() ),
+			repeatedWord.Size(), repeatedWord.MinCount ) );
+	} else {
+		saveAction.reset( new CSaveAction( move( parts ) ) );
+	}
+	actions.Add( saveAction );
+	return true;
+}
+
+void CPatternVariant::Print( const CPatterns& /*context*/, ostream& out ) const
+{
+	for( const CPatternWord* word : *this ) {
+		out << " " << *word->Text;
 	}
 #if 0
 	out << endl << "   ";
-	for( const CBaseVariantPart* const ve : Parts ) {
+	CVariantParts parts;
+	size_t wordSize;
+	vector<size_t> variantSizes;
+	Parts.Build( parts, 0, wordSize, variantSizes );
+	for( const CBaseVariantPart* const ve : parts ) {
 		if( ve == nullptr ) {
 			out << "} ";
 		} else {
@@ -1137,55 +3075,255 @@ void CPatternVariants::Print( const CPatterns& context, ostream& out ) const
 	}
 }
 
-void CPatternVariants::SortAndRemoveDuplicates( const CPatterns& context )
+void CPatternVariants::SortAndRemoveDuplicates( CPatternWords& words )
+{
+	UnrollOverlapping( words );
+
+	// variants are ordered by texts of words
+	const auto isLess = []( const CPatternVariant& variant1,
+		const CPatternVariant& variant2 ) -> bool
+	{
+		return lexicographical_compare(
+			variant1.cbegin(), variant1.cend(),
+			variant2.cbegin(), variant2.cend(),
+			[]( const CPatternWord* word1, const CPatternWord* word2 ) -> bool
+			{
+				return ( *word1->Text < *word2->Text );
+			} );
+	};
+	sort( this->begin(), this->end(), isLess );
+
+	const auto isEqual = []( const CPatternVariant& variant1,
+		const CPatternVariant& variant2 ) -> bool
+	{
+		return ( variant1.size() == variant2.size()
+			&& equal( variant1.cbegin(), variant1.cend(), variant2.cbegin(),
+				[]( const CPatternWord* word1, const CPatternWord* word2 ) -> bool
+				{
+					return ( word1->Text == word2->Text );
+				} ) );
+	};
+	this->erase( unique( this->begin(), this->end(), isEqual ), this->end() );
+}
+
+void CPatternVariants::Unroll( CPatternWords& words )
+{
+	CPatternVariants variants;
+	for( const CPatternVariant& variant : *this ) {
+		variant.Unroll( words, variants );
+	}
+	this->swap( variants );
+}
+
+void CPatternVariants::UnrollOverlapping( CPatternWords& words,
+	const CPatternBuildContext* context )
 {
-#pragma message( "very inefficient" )
-	typedef pair<string, CPatternVariant> CPair;
-	vector<CPair> pairs;
-	pairs.reserve( this->size() );
-	for( CPatternVariant& variant : *this ) {
-		ostringstream oss1;
-		variant.Print( context, oss1 );
-		pairs.push_back( make_pair( oss1.str(), move( variant ) ) );
+	bool hasRepeatedWords = false;
+	bool hasTranspositions = false;
+	for( const CPatternVariant& variant : *this ) {
+		hasRepeatedWords |= variant.HasRepeatedWord();
+		hasTranspositions |= variant.HasTransposition();
+	}
+	if( !hasRepeatedWords && !hasTranspositions ) {
+		return;
 	}
 
-	struct {
-		bool operator()( const CPair& v1, const CPair& v2 )
-		{
-			return ( v1.first < v2.first );
+	// number of variants matching each unrolled variant,
+	// unrolled variants are keyed by the addresses of texts of their words,
+	// transpositions are not unrolled, they are compared with variants
+	unordered_map<string, size_t> counts;
+	vector<vector<string>> allUnrolled;
+	allUnrolled.reserve( this->size() );
+	for( const CPatternVariant& variant : *this ) {
+		allUnrolled.emplace_back();
+		if( variant.HasTransposition() ) {
+			continue;
 		}
-	} comparatorL;
-	sort( pairs.begin(), pairs.end(), comparatorL );
+		CPatternVariants unrolled;
+		variant.Unroll( words, unrolled );
+		for( const CPatternVariant& unrolledVariant : unrolled ) {
+			string key;
+			for( const CPatternWord* word : unrolledVariant ) {
+				key.append( reinterpret_cast<const char*>( &word->Text ),
+					sizeof( word->Text ) );
+			}
+			allUnrolled.back().push_back( key );
+			counts[key]++;
+		}
+	}
 
-	struct {
-		bool operator()( const CPair& v1, const CPair& v2 )
+	CPatternVariants variants;
+	for( size_t i = 0; i < this->size(); i++ ) {
+		const CPatternVariant& variant = ( *this )[i];
+		const bool isVariable =
+			( variant.HasRepeatedWord() || variant.HasTransposition() );
+		bool overlaps = false;
+		if( variant.HasRepeatedWord() ) {
+			for( const string& unrolled : allUnrolled[i] ) {
+				overlaps |= ( counts[unrolled] > 1 );
+			}
+		}
+		if( isVariable && hasTranspositions ) {
+			for( size_t j = 0; j < this->size() && !overlaps; j++ ) {
+				const CPatternVariant& another = ( *this )[j];
+				overlaps = ( j != i
+					&& ( ( variant.HasTransposition()
+							&& mayOverlap( variant, another ) )
+						|| ( another.HasTransposition()
+							&& mayOverlap( another, variant ) ) ) );
+			}
+		}
+		if( variant.HasTransposition() && !overlaps && context != nullptr ) {
+			overlaps = context->HasVariant( variant );
+		}
+		if( variant.HasRepeatedWord() && !overlaps && context != nullptr ) {
+			CPatternVariants unrolled;
+			variant.Unroll( words, unrolled );
+			for( const CPatternVariant& unrolledVariant : unrolled ) {
+				overlaps |= context->HasVariant( unrolledVariant );
+			}
+		}
+		if( overlaps ) {
+			variant.Unroll( words, variants );
+		} else {
+			variants.push_back( variant );
+		}
+	}
+	this->swap( variants );
+}
+
+// The variants are different if they differ in words before or after
+// the transposition or in the first words, or if their sizes differ.
+bool CPatternVariants::mayOverlap( const CPatternVariant& transposed,
+	const CPatternVariant& variant )
+{
+	if( transposed.MaxSize() < variant.MinSize()
+		|| variant.MaxSize() < transposed.MinSize() )
+	{
+		return false;
+	}
+
+	const TVariantSize word = transposed.TranspositionWord();
+	// words of the variant are compared until its repeated word
+	// or transposition
+	const TVariantSize variableWord =
+		min( variant.RepeatedWord(), variant.TranspositionWord() );
+	for( TVariantSize i = 0; i < word; i++ ) {
+		if( i >= variableWord ) {
+			return true;
+		}
+		if( transposed[i]->Text != variant[i]->Text ) {
+			return false;
+		}
+	}
+	const size_t suffixSize = transposed.size() - word - 1;
+	for( size_t i = 1; i <= suffixSize; i++ ) {
+		if( i > variant.size() || ( variableWord < variant.size()
+			&& variant.size() - i <= variableWord ) )
 		{
-			return ( v1.first == v2.first );
+			return true;
 		}
-	} comparatorEq;
-	auto last = unique( pairs.begin(), pairs.end(), comparatorEq );
-	pairs.erase( last, pairs.end() );
+		if( transposed[transposed.size() - i]->Text
+			!= variant[variant.size() - i]->Text )
+		{
+			return false;
+		}
+	}
+	if( word >= variableWord ) {
+		return true;
+	}
 
-	this->clear();
-	for( CPair& pair : pairs ) {
-		this->emplace_back( move( pair.second ) );
+	// the word of the variant after the words before the transposition
+	// is the first word of a variant of an element
+	const CPatternWord& transposedWord = *transposed[word];
+	size_t groupWord = 0;
+	for( const vector<TVariantSize>& sizes : transposedWord.Transposition ) {
+		for( const TVariantSize size : sizes ) {
+			if( size > 0 ) {
+				if( transposedWord.Group[groupWord]->Text == variant[word]->Text ) {
+					return true;
+				}
+				groupWord += size;
+			}
+		}
 	}
+	return false;
 }
 
 void CPatternVariants::Build( CPatternBuildContext& context ) const
 {
 	for( const CPatternVariant& variant : *this ) {
-		variant.Build( context );
+		// variants are unique
+		check_logic( variant.Build( context ) );
 	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-CPatternBuildContext::CPatternBuildContext( const CPatterns& _patterns ) :
-	patterns( _patterns )
+CSpanAutomata::CSpanAutomata( const TVariantSize _maxSize ) :
+	maxSize( _maxSize )
+{
+}
+
+const CSpanAutomaton& CSpanAutomata::Automaton( const TSpan span ) const
+{
+	debug_check_logic( span < automata.size() );
+	debug_check_logic( statuses[span] == S_Built );
+	return automata[span];
+}
+
+CSpanAutomata::TStatus CSpanAutomata::Find( const string& name,
+	TSpan& span ) const
 {
+	auto i = names.find( name );
+	if( i == names.cend() ) {
+		return S_NotFound;
+	}
+	span = i->second;
+	return statuses[span];
+}
+
+TSpan CSpanAutomata::Add( const string& name )
+{
+	const TSpan span = automata.size();
+	check_logic( names.insert( make_pair( name, span ) ).second );
+	automata.emplace_back();
+	automata.back().Index = span;
+	automata.back().Name = name;
+	automata.back().HasHead = false;
+	automata.back().HeadElement = 0;
+	statuses.push_back( S_Building );
+	return span;
+}
+
+void CSpanAutomata::SetInline( const TSpan span )
+{
+	debug_check_logic( statuses[span] == S_Building );
+	statuses[span] = S_Inline;
+}
+
+void CSpanAutomata::SetBuilt( const TSpan span, const bool hasHead,
+	const TElement headElement, CStates&& states )
+{
+	debug_check_logic( statuses[span] == S_Building );
+	statuses[span] = S_Built;
+	automata[span].HasHead = hasHead;
+	automata[span].HeadElement = headElement;
+	automata[span].States = move( states );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CPatternBuildContext::CPatternBuildContext( const CPatterns& _patterns,
+		CSpanAutomata* _spans ) :
+	patterns( _patterns ),
+	spans( _spans ),
+	words( _patterns )
+{
+	AttributesTransitions = 0;
 	data.resize( patterns.Size() );
 	States.emplace_back();
+	StateWords.emplace_back( 0, nullptr );
 }
 
 TVariantSize CPatternBuildContext::PushMaxSize( const TReference reference,
@@ -1214,35 +3352,281 @@ TVariantSize CPatternBuildContext::PopMaxSize( const TReference reference )
 
 void CPatternBuildContext::AddVariants(
 	const vector<CPatternVariants>& allSubVariants,
-	vector<CPatternVariant>& variants, const size_t maxSize )
+	IVariantCallback& callback, const size_t maxSize )
 {
-	vector<size_t> indices( allSubVariants.size(), 0 );
-	do {
-		CPatternVariant variant;
-		for( size_t i = 0; i < indices.size(); i++ ) {
-			variant += allSubVariants[i][indices[i]];
+	vector<const CPatternVariants*> subVariantsPtrs;
+	subVariantsPtrs.reserve( allSubVariants.size() );
+	for( const CPatternVariants& subVariants : allSubVariants ) {
+		subVariantsPtrs.push_back( &subVariants );
+	}
+	AddVariants( subVariantsPtrs, callback, maxSize );
+}
+
+void CPatternBuildContext::AddVariants(
+	const vector<const CPatternVariants*>& allSubVariants,
+	IVariantCallback& callback, const size_t maxSize )
+{
+	// only sub variants of one position keep repeated words or
+	// transpositions, since a variant has at most one of them
+	vector<const CPatternVariants*> subVariantsPtrs( allSubVariants );
+	vector<CPatternVariants> unrolledSubVariants;
+	unrolledSubVariants.reserve( allSubVariants.size() );
+	bool hasRepeatedWords = false;
+	for( const CPatternVariants*& subVariants : subVariantsPtrs ) {
+		bool repeated = false;
+		for( const CPatternVariant& subVariant : *subVariants ) {
+			repeated |= ( subVariant.HasRepeatedWord()
+				|| subVariant.HasTransposition() );
 		}
-		if( variant.size() <= maxSize ) {
-			variants.push_back( variant );
+		if( repeated && hasRepeatedWords ) {
+			unrolledSubVariants.push_back( *subVariants );
+			unrolledSubVariants.back().Unroll( words );
+			subVariants = &unrolledSubVariants.back();
+		}
+		hasRepeatedWords |= repeated;
+	}
+
+	// minimum number of words of sub variants from each position to the end
+	vector<size_t> minSizes( subVariantsPtrs.size() + 1, 0 );
+	for( size_t pos = subVariantsPtrs.size(); pos > 0; pos-- ) {
+		const CPatternVariants& subVariants = *subVariantsPtrs[pos - 1];
+		if( subVariants.empty() ) {
+			return;
+		}
+		size_t minSize = subVariants.front().MinSize();
+		for( const CPatternVariant& subVariant : subVariants ) {
+			minSize = min( minSize, subVariant.MinSize() );
+		}
+		minSizes[pos - 1] = minSizes[pos] + minSize;
+	}
+
+	CPatternVariant variant;
+	addVariants( subVariantsPtrs, minSizes, 0, variant, callback, maxSize );
+}
+
+bool CPatternBuildContext::HasVariant( const CPatternVariant& variant ) const
+{
+	TStateIndex state = 0;
+	for( const CPatternWord* word : variant ) {
+		if( word->IsTransposition() ) {
+			return mayHaveTransposition( state, *word );
+		}
+		auto nextState = NextStates.find( make_pair( state, word->Text ) );
+		if( nextState == NextStates.cend() ) {
+			return false;
 		}
-	} while( nextIndices( allSubVariants, indices ) );
+		state = nextState->second;
+	}
+	return States[state].Actions.HasSave();
 }
 
-bool CPatternBuildContext::nextIndices(
-	const vector<CPatternVariants>& allSubVariants, vector<size_t>& indices )
+// States of repetitions or transpositions and transitions by the first words
+// of variants of elements may begin words of the transposition.
+bool CPatternBuildContext::mayHaveTransposition( const TStateIndex state,
+	const CPatternWord& transposedWord ) const
 {
-	for( size_t pos = indices.size(); pos > 0; pos-- ) {
-		const size_t realPos = pos - 1;
-		if( indices[realPos] < allSubVariants[realPos].size() - 1 ) {
-			indices[realPos]++;
+	unordered_set<const string*> firstWords;
+	size_t groupWord = 0;
+	for( const vector<TVariantSize>& sizes : transposedWord.Transposition ) {
+		for( const TVariantSize size : sizes ) {
+			if( size > 0 ) {
+				firstWords.insert( transposedWord.Group[groupWord]->Text );
+				groupWord += size;
+			}
+		}
+	}
+	for( const CTransitionPtr& transition : States[state].Transitions ) {
+		const TStateIndex nextState = transition->NextState();
+		const CPatternWord* const word = StateWords[nextState].second;
+		if( States[nextState].IsLoop() || word == nullptr
+			|| transition->TransposedWord() != NoTransposedWord
+			|| firstWords.count( word->Text ) > 0 )
+		{
 			return true;
-		} else {
-			indices[realPos] = 0;
 		}
 	}
 	return false;
 }
 
+// Combinations are enumerated in the lexicographic order of sub variants,
+// the variant is the common prefix of combinations, combinations longer
+// than maxSize are skipped without building.
+void CPatternBuildContext::addVariants(
+	const vector<const CPatternVariants*>& allSubVariants,
+	const vector<size_t>& minSizes, const size_t pos,
+	CPatternVariant& variant, IVariantCallback& callback, const size_t maxSize )
+{
+	if( pos == allSubVariants.size() ) {
+		CPatternVariant fullVariant( variant );
+		if( fullVariant.HasTransposition() && fullVariant.MaxSize() > maxSize ) {
+			// orders of the transposition with more words are left out
+			CPatternVariants unrolled;
+			fullVariant.Unroll( words, unrolled );
+			for( CPatternVariant& unrolledVariant : unrolled ) {
+				if( unrolledVariant.size() <= maxSize ) {
+					callback.OnVariant( unrolledVariant );
+				}
+			}
+			return;
+		}
+		fullVariant.LimitSize( words, maxSize );
+		callback.OnVariant( fullVariant );
+		return;
+	}
+
+	const size_t prefixSize = variant.size();
+	const CPatternVariantParts prefixParts = variant.Parts;
+	const size_t prefixMinSize = variant.MinSize();
+	for( const CPatternVariant& subVariant : *allSubVariants[pos] ) {
+		if( prefixMinSize + subVariant.MinSize() + minSizes[pos + 1] > maxSize ) {
+			continue;
+		}
+		variant += subVariant;
+		addVariants( allSubVariants, minSizes, pos + 1,
+			variant, callback, maxSize );
+		variant.erase( variant.begin() + prefixSize, variant.end() );
+		variant.Parts = prefixParts;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CPatternAutomaton::CPatternAutomaton( CPatternBuildContext& context,
+		const size_t variantsCount, const bool keepStateWords ) :
+	States( move( context.States ) ),
+	VariantsCount( variantsCount )
+{
+	if( keepStateWords ) {
+		StateWords.reserve( context.StateWords.size() );
+		for( const pair<TStateIndex, const CPatternWord*>& stateWord
+			: context.StateWords )
+		{
+			StateWords.emplace_back( stateWord.first, stateWord.second == nullptr
+				? string() : *stateWord.second->Text );
+		}
+	}
+}
+
+string CPatternAutomaton::StateLabel( TStateIndex state ) const
+{
+	debug_check_logic( state < StateWords.size() );
+	vector<const string*> words;
+	for( ; state > 0; state = StateWords[state].first ) {
+		words.push_back( &StateWords[state].second );
+	}
+	string label;
+	for( auto word = words.crbegin(); word != words.crend(); ++word ) {
+		label += ( label.empty() ? "" : " " ) + **word;
+	}
+	return label;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Adds variants to the automaton of the context as they are built,
+// variants with repeated words or transpositions are added last, since
+// they are unrolled if they match the same words as other variants
+class CAutomatonBuilder : public IVariantCallback {
+public:
+	explicit CAutomatonBuilder( CPatternBuildContext& _context ) :
+		context( _context ),
+		variantsCount( 0 )
+	{
+	}
+
+	void OnVariant( CPatternVariant& variant ) override
+	{
+		if( variant.HasRepeatedWord() || variant.HasTransposition() ) {
+			repeatedVariants.push_back( move( variant ) );
+		} else if( variant.Build( context ) ) {
+			variantsCount++;
+		}
+	}
+
+	// returns the number of variants of the automaton
+	size_t Finish()
+	{
+		repeatedVariants.UnrollOverlapping( context.Words(), &context );
+		for( const CPatternVariant& variant : repeatedVariants ) {
+			if( variant.Build( context ) ) {
+				variantsCount++;
+			}
+		}
+		repeatedVariants.clear();
+		return variantsCount;
+	}
+
+private:
+	CPatternBuildContext& context;
+	CPatternVariants repeatedVariants;
+	size_t variantsCount;
+};
+
+void BuildPatterns( const CPatterns& patterns, const TVariantSize maxSize,
+	CSpanAutomata* spans, const size_t threadsCount, CPatternAutomata& automata,
+	const bool keepStateWords, const bool keepPrintedVariants )
+{
+	const TReference count = patterns.Size();
+	automata.clear();
+	automata.resize( count );
+
+	// patterns are taken by threads one by one
+	atomic<TReference> next( 0 );
+	const auto build = [&]()
+	{
+		for( TReference ref = next++; ref < count; ref = next++ ) {
+			// variants are destroyed before the arena of the context
+			CPatternBuildContext buildContext( patterns, spans );
+			if( keepPrintedVariants ) {
+				CPatternVariants variants;
+				patterns.Pattern( ref ).Build( buildContext, variants, maxSize );
+				variants.Build( buildContext );
+				automata[ref] = CPatternAutomaton( buildContext,
+					variants.size(), keepStateWords );
+				ostringstream out;
+				variants.Print( patterns, out );
+				automata[ref].PrintedVariants = out.str();
+			} else {
+				CArena::CScope arenaScope( buildContext.Arena() );
+				CAutomatonBuilder builder( buildContext );
+				patterns.Pattern( ref ).Stream( buildContext, builder, maxSize );
+				const size_t variantsCount = builder.Finish();
+				automata[ref] = CPatternAutomaton( buildContext,
+					variantsCount, keepStateWords );
+			}
+		}
+	};
+
+	size_t threads = ( threadsCount == 0 )
+		? thread::hardware_concurrency() : threadsCount;
+	threads = ( spans == nullptr ) ? min<size_t>( threads, count ) : 1;
+	if( threads <= 1 ) {
+		build();
+		return;
+	}
+
+	vector<exception_ptr> errors( threads );
+	vector<thread> workers;
+	for( size_t t = 0; t < threads; t++ ) {
+		workers.emplace_back( [&build, &errors, t]()
+		{
+			try {
+				build();
+			} catch( ... ) {
+				errors[t] = current_exception();
+			}
+		} );
+	}
+	for( thread& worker : workers ) {
+		worker.join();
+	}
+	for( const exception_ptr& error : errors ) {
+		if( error ) {
+			rethrow_exception( error );
+		}
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 } // end of Pattern namespace
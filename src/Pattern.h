@@ -1,5 +1,6 @@
 #pragma once
 
+#include <Arena.h>
 #include <Configuration.h>
 #include <PatternMatch.h>
 
@@ -15,6 +16,16 @@ class CPatternBuildContext;
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Receives variants one by one as they are built
+class IVariantCallback {
+public:
+	virtual ~IVariantCallback() {}
+	// the variant may be changed by the callback
+	virtual void OnVariant( CPatternVariant& variant ) = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
 typedef size_t TElement;
 typedef size_t TReference;
 typedef Text::TAttribute TSign;
@@ -55,6 +66,10 @@ struct CPatternArgument {
 		bool operator()( const CPatternArgument& arg1,
 			const CPatternArgument& arg2 ) const;
 	};
+	struct Less {
+		bool operator()( const CPatternArgument& arg1,
+			const CPatternArgument& arg2 ) const;
+	};
 };
 
 typedef vector<CPatternArgument> CPatternArguments;
@@ -75,6 +90,13 @@ public:
 	virtual TVariantSize MinSizePrediction() const = 0;
 	virtual void Build( CPatternBuildContext& context,
 		CPatternVariants& variants, const TVariantSize maxSize ) const = 0;
+	// passes variants to the callback as they are built, they are neither
+	// sorted nor unique, by default they are built into a vector first
+	virtual void Stream( CPatternBuildContext& context,
+		IVariantCallback& callback, const TVariantSize maxSize ) const;
+	// copy of the subtree with factored common prefixes and suffixes of
+	// alternatives, leaves of the copy are built by the leaves of the subtree
+	virtual unique_ptr<IPatternBase> Factored( const CPatterns& context ) const;
 };
 
 typedef unique_ptr<IPatternBase> CPatternBasePtr;
@@ -85,7 +107,8 @@ typedef vector<CPatternBasePtr> CPatternBasePtrs;
 enum TVariantPartType {
 	VPR_Word,
 	VPR_Regexp,
-	VPR_Instance
+	VPR_Instance,
+	VPR_Span // replaced with parts of the span recognition in CMatchContext::Save
 };
 
 class CBaseVariantPart {
@@ -100,6 +123,23 @@ public:
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Part of a variant which is matched by a span transition in chart mode
+class CSpanVariantPart : public CBaseVariantPart {
+public:
+	explicit CSpanVariantPart( const CBaseVariantPart* instance );
+
+	// the part of the reference to the pattern
+	const CBaseVariantPart* InstancePart() const { return instance; }
+
+	virtual TVariantPartType Type() const override;
+	virtual TReference Instance() const override;
+
+private:
+	const CBaseVariantPart* const instance;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
 class CPatternSequence : public IPatternBase {
 public:
 	explicit CPatternSequence( CPatternBasePtrs&& elements,
@@ -111,6 +151,12 @@ public:
 	TVariantSize MinSizePrediction() const override;
 	void Build( CPatternBuildContext& context, CPatternVariants& variants,
 		const TVariantSize maxSize ) const override;
+	void Stream( CPatternBuildContext& context, IVariantCallback& callback,
+		const TVariantSize maxSize ) const override;
+	CPatternBasePtr Factored( const CPatterns& context ) const override;
+
+	bool Transposition() const { return transposition; }
+	const CPatternBasePtrs& Elements() const { return elements; }
 
 private:
 	const bool transposition;
@@ -119,6 +165,11 @@ private:
 	void collectAllSubVariants( CPatternBuildContext& context,
 		vector<CPatternVariants>& allSubVariants,
 		const TVariantSize maxSize ) const;
+	// passes the variant with the transposition word of the sub variants,
+	// returns false if the orders of the sub variants must be expanded
+	bool streamTransposition( CPatternBuildContext& context,
+		const vector<CPatternVariants>& allSubVariants,
+		IVariantCallback& callback, const TVariantSize maxSize ) const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -126,39 +177,78 @@ private:
 class CCondition {
 public:
 	CCondition( const bool strong, const CPatternArguments& arguments );
-	CCondition( const string& dictionary, const CPatternArguments& arguments );
+	// arguments of the dictionary are separated by undefined arguments
+	CCondition( const string& dictionary,
+		const Configuration::TDictionary dictionaryIndex,
+		const CPatternArguments& arguments );
 	bool Agreement() const { return dictionary.empty(); }
 	bool SelfAgreement() const { return Agreement() && arguments.size() == 1; }
 	bool Strong() const { return strong; }
 	const string& Dictionary() const { return dictionary; }
+	Configuration::TDictionary DictionaryIndex() const { return dictionaryIndex; }
 	const CPatternArguments& Arguments() const { return arguments; }
 	void Print( const CPatterns& context, ostream& out ) const;
 
 private:
 	bool strong;
 	string dictionary;
+	Configuration::TDictionary dictionaryIndex;
 	CPatternArguments arguments;
 };
 
 class CConditions {
 public:
 	explicit CConditions( vector<CCondition>&& conditions );
-	void Apply( CPatternVariant& variant ) const;
+	// agreements of words after the first repetition of the repeated word
+	// of the variant with it or with words before it are loop agreements,
+	// agreements of words of the transposition and words after it with
+	// words before them are transposition agreements
+	void Apply( CPatternBuildContext& context, CPatternVariant& variant ) const;
+	// the conditions can be applied without unrolling the repeated word,
+	// so they link it and words on both sides of it only by agreements
+	bool CanLoop( const CPatternVariant& variant ) const;
+	// the conditions can be applied without unrolling the transposition,
+	// so they link its words only by agreements and each entry of
+	// a dictionary is before or after it
+	bool CanTranspose( const CPatternVariant& variant ) const;
 	void Print( const CPatterns& context, ostream& out ) const;
 
 private:
 	vector<CCondition> data;
-	typedef unordered_multimap<
-		CPatternArgument, pair<TVariantSize, TVariantSize>,
-		CPatternArgument::Hasher,
-		CPatternArgument::Comparator> CIndices;
-	CIndices indices;
+	// maximum number of arguments of a condition
+	size_t argumentsCount;
+	// arguments without signs and their conditions sorted by arguments
+	struct CIndex {
+		CPatternArgument Argument;
+		TVariantSize Condition;
+		TVariantSize Index;
+	};
+	vector<CIndex> indices;
+	struct CIndexLess;
 
 	// Agreement Link : condition_index, word_index, argument_index
 	// Dictionary Link : condition_index, argument_index, word_index
-	typedef set<array<TVariantSize, 3>> CLinks;
-
-	bool buildLinks( CPatternVariant& variant, CLinks& links ) const;
+	typedef array<TVariantSize, 3> CLink;
+	typedef CFixedSizeArray<CLink, size_t, 32> CLinks;
+
+	size_t countLinks( const CPatternVariant& variant ) const;
+	// links are sorted by conditions
+	void buildLinks( const CPatternVariant& variant, CLinks& links ) const;
+
+	// word of a variant with a transposition linked by a condition,
+	// Word is the word of the transposition if Offset is its offset
+	struct CTransposedLink {
+		TVariantSize Offset;
+		TTransposedWord Word;
+		TVariantSize Argument;
+	};
+	typedef vector<CTransposedLink> CTransposedLinks;
+	// links of each condition in the order of words of the variant
+	// with the words of the transposition in the order of its group
+	void buildTransposedLinks( const CPatternVariant& variant,
+		vector<CTransposedLinks>& links ) const;
+	void applyTransposed( CPatternBuildContext& context,
+		CPatternVariant& variant ) const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -173,10 +263,18 @@ public:
 	TVariantSize MinSizePrediction() const override;
 	void Build( CPatternBuildContext& context, CPatternVariants& variants,
 		const TVariantSize maxSize ) const override;
+	void Stream( CPatternBuildContext& context, IVariantCallback& callback,
+		const TVariantSize maxSize ) const override;
+	CPatternBasePtr Factored( const CPatterns& context ) const override;
+
+	const IPatternBase& Element() const { return *element; }
+	const CConditions& Conditions() const { return conditions; }
 
 private:
 	CPatternBasePtr element;
 	CConditions conditions;
+
+	class CConditionsCallback;
 };
 
 typedef unique_ptr<CPatternAlternative> CPatternAlternativePtr;
@@ -194,9 +292,19 @@ public:
 	TVariantSize MinSizePrediction() const override;
 	void Build( CPatternBuildContext& context, CPatternVariants& variants,
 		const TVariantSize maxSize ) const override;
+	void Stream( CPatternBuildContext& context, IVariantCallback& callback,
+		const TVariantSize maxSize ) const override;
+	CPatternBasePtr Factored( const CPatterns& context ) const override;
 
 private:
 	const CPatternBasePtrs alternatives;
+
+	struct CFactoredAlternative;
+	typedef vector<CFactoredAlternative> CFactoredAlternatives;
+	static CPatternBasePtr factor( const CPatterns& context,
+		CFactoredAlternatives& alternatives );
+	static void factorEdges( const CPatterns& context,
+		CFactoredAlternatives& alternatives, const bool prefixes );
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -212,6 +320,7 @@ public:
 	TVariantSize MinSizePrediction() const override;
 	void Build( CPatternBuildContext& context, CPatternVariants& variants,
 		const TVariantSize maxSize ) const override;
+	CPatternBasePtr Factored( const CPatterns& context ) const override;
 
 private:
 	const CPatternBasePtr element;
@@ -282,7 +391,7 @@ public:
 	void Print( const CPatterns& context, ostream& out ) const;
 
 private:
-	vector<CSignRestriction> data;
+	vector<CSignRestriction, CArenaAllocator<CSignRestriction>> data;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -325,6 +434,12 @@ public:
 private:
 	const TReference reference;
 	const CSignRestrictions signs;
+	const CSpanVariantPart spanPart;
+
+	void buildInline( CPatternBuildContext& context, CPatternVariants& variants,
+		const TVariantSize maxSize ) const;
+	// returns false if the pattern should be expanded inline
+	bool buildSpan( CPatternBuildContext& context, TSpan& span ) const;
 
 	// CBaseVariantPart
 	virtual TVariantPartType Type() const override;
@@ -350,13 +465,26 @@ public:
 	TVariantSize MinSizePrediction() const override;
 	void Build( CPatternBuildContext& context, CPatternVariants& variants,
 		const TVariantSize maxSize ) const override;
+	void Stream( CPatternBuildContext& context, IVariantCallback& callback,
+		const TVariantSize maxSize ) const override;
+	// variants are built from the factored copy of the tree
+	void Factor( const CPatterns& context );
 
 private:
 	string name;
 	TReference reference;
 	CPatternBasePtr root;
+	CPatternBasePtr factoredRoot;
 	CPatternArguments arguments;
 
+	class CInstanceCallback;
+	// pops the maximum size of the pattern pushed by Build or Stream
+	void popMaxSize( CPatternBuildContext& context,
+		const TVariantSize correctMaxSize ) const;
+	// encloses parts of the variant by the pattern and marks its arguments
+	void addInstance( CPatternBuildContext& context,
+		CPatternVariant& variant ) const;
+
 	// CBaseVariantPart
 	virtual TVariantPartType Type() const override;
 	virtual TReference Instance() const override;
@@ -394,44 +522,319 @@ private:
 
 ///////////////////////////////////////////////////////////////////////////////
 
+struct CSpanAutomaton;
+
 struct CPatternWord {
 	CPatternArgument Id;
 	const string* Regexp;
+	const CSpanAutomaton* Span;
 	CSignRestrictions SignRestrictions;
 	CActions Actions;
+	// the word is repeated from MinCount to MaxCount times by a loop state
+	TVariantSize MinCount;
+	TVariantSize MaxCount;
+	// words repeated together if the word is a group of words,
+	// words of variants of elements if the word is a transposition
+	vector<const CPatternWord*> Group;
+	// numbers of words of variants of each element of the transposition,
+	// their words follow each other in Group, an empty variant allows
+	// to leave the element out
+	vector<vector<TVariantSize>> Transposition;
+	// printed word, set when the word is added to CPatternWords,
+	// words with the same text are equal
+	const string* Text;
 
 	explicit CPatternWord( const string* const regexp );
 	CPatternWord( const CPatternArgument id,
 		const CSignRestrictions& signRestrictions );
-
-	void Build( CPatternBuildContext& context ) const;
+	// the word is a span, id is the head of the span
+	CPatternWord( const CSpanAutomaton* span, const CPatternArgument id );
+	// the word is a group of the words repeated from minCount to maxCount times
+	CPatternWord( const vector<const CPatternWord*>& group,
+		const TVariantSize minCount, const TVariantSize maxCount );
+	// the word is a transposition of elements with the variants of words
+	CPatternWord( const vector<const CPatternWord*>& words,
+		const vector<vector<TVariantSize>>& transposition );
+
+	bool IsRepeated() const { return ( MaxCount > 1 ); }
+	bool IsTransposition() const { return !Transposition.empty(); }
+	// number of words of a repetition
+	TVariantSize Size() const
+		{ return ( Group.empty() ? 1 : Cast<TVariantSize>( Group.size() ) ); }
+	// numbers of words of the shortest and the longest recognitions
+	size_t MinSize() const;
+	size_t MaxSize() const;
+	// returns the state reached by the word from the state,
+	// slot is the number of words before the word
+	TStateIndex Build( CPatternBuildContext& context, const TStateIndex state,
+		const TVariantSize slot ) const;
 	void Print( const CPatterns& context, ostream& out ) const;
+
+private:
+	CTransitionPtr buildTransition( CPatternBuildContext& context,
+		const TStateIndex nextStateIndex ) const;
+	// returns the state reached after all the elements
+	TStateIndex buildTransposition( CPatternBuildContext& context,
+		const TStateIndex state ) const;
+};
+
+// Words of variants built with a context. Words are stored once, so variants
+// keep pointers to the words, and texts of words are stored once, so words
+// are compared by pointers to their texts. Heads of spans are not printed,
+// so words of spans with different heads are different words with one text.
+class CPatternWords {
+	CPatternWords( const CPatternWords& ) = delete;
+	CPatternWords& operator=( const CPatternWords& ) = delete;
+
+public:
+	explicit CPatternWords( const CPatterns& patterns );
+
+	size_t Size() const { return words.size(); }
+	// returns the stored word equal to the word
+	const CPatternWord* Add( const CPatternWord& word );
+	// returns the stored word equal to the stored word with the action
+	const CPatternWord* AddAction( const CPatternWord* word,
+		const CActionPtr& action );
+	// returns the word returned by replace for the stored word or, if it is
+	// a group or a transposition, the stored group of words returned by
+	// replace for its words, nullptr if replace returns nullptr
+	template<typename TReplace>
+	const CPatternWord* Replace( const CPatternWord* word, TReplace replace );
+
+private:
+	const CPatterns& patterns;
+	// addresses of words are stable
+	deque<CPatternWord> words;
+	unordered_map<string, const CPatternWord*> indices;
+	unordered_set<string> texts;
+
+	typedef pair<const CPatternWord*, const IAction*> CWordAction;
+	struct CWordActionHasher {
+		size_t operator()( const CWordAction& wordAction ) const;
+	};
+	unordered_map<CWordAction, const CPatternWord*,
+		CWordActionHasher> wordsWithActions;
+};
+
+template<typename TReplace>
+const CPatternWord* CPatternWords::Replace( const CPatternWord* word,
+	TReplace replace )
+{
+	if( word->Group.empty() ) {
+		return replace( word );
+	}
+	CPatternWord group = *word;
+	for( const CPatternWord*& groupWord : group.Group ) {
+		groupWord = replace( groupWord );
+		if( groupWord == nullptr ) {
+			return nullptr;
+		}
+	}
+	return Add( group );
+}
+
+// Actions of conditions built with a context. Equal actions are stored once,
+// so words with equal actions are the same words of CPatternWords.
+// Offsets are offsets of words in the variant, the action is run at offset.
+class CConditionActions {
+	CConditionActions( const CConditionActions& ) = delete;
+	CConditionActions& operator=( const CConditionActions& ) = delete;
+
+public:
+	CConditionActions() = default;
+
+	// strong agreement with the word distance words before
+	const CActionPtr& StrongAgreement( const TSign sign,
+		const TVariantSize distance );
+	const CActionPtr& Agreement( const TSign sign, const TVariantSize offset,
+		const TVariantSize* words, const size_t count );
+	// agreement of the word at offset after the repeated word at loop,
+	// loop in words is for its repetitions before the word
+	const CActionPtr& LoopAgreement( const TSign sign, const bool strong,
+		const TVariantSize offset, const TVariantSize loop,
+		const TVariantSize* words, const size_t count );
+	const CActionPtr& TranspositionAgreement( const TSign sign,
+		const bool strong,
+		const vector<CTranspositionAgreementAction::CWords>& words );
+	// MaxVariantSize separates arguments of the dictionary
+	const CActionPtr& Dictionary( const Configuration::TDictionary dictionary,
+		const TVariantSize offset, const TVariantSize* words, const size_t count );
+
+private:
+	unordered_map<string, CActionPtr> actions;
+	// the key of an action, reused by all searches
+	string key;
+
+	void startKey( const char type, const size_t index );
+	void addToKey( const TVariantSize offset,
+		const TVariantSize* words, const size_t count );
+	CActionPtr& find();
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
-class CPatternVariant : public vector<CPatternWord> {
+// Parts of a variant: the part of each word, the instance of each pattern
+// before the parts of the pattern and nullptr after them. Parts are immutable
+// trees allocated from the current arena and shared by variants, so parts
+// are copied and concatenated in constant time, and the list of parts is
+// built once for the automaton.
+class CPatternVariantParts {
+public:
+	CPatternVariantParts() : root( nullptr ) {}
+	// the part of a word
+	explicit CPatternVariantParts( const CBaseVariantPart* part );
+
+	// number of parts
+	size_t Size() const;
+	CPatternVariantParts& operator+=( const CPatternVariantParts& parts );
+	// encloses the parts by the instance and nullptr
+	void Enclose( const CBaseVariantPart* instance );
+	// replaces the instance enclosing the parts
+	void ReplaceInstance( const CBaseVariantPart* instance );
+	// makes the parts the parts of one word, a group of their words
+	void Group();
+	// replaces the parts of the word with count repetitions of them
+	void Repeat( const TVariantSize word, const TVariantSize count );
+	// makes the parts the parts of one word, a transposition of the parts
+	// of variants of its elements
+	void Transposition( const vector<CPatternVariantParts>& variants );
+	// replaces the parts of the transposition word with the parts of
+	// its variants in the order
+	void Transpose( const TVariantSize word, const vector<size_t>& order );
+	// builds the list of parts, returns the index of the first part
+	// of the word and its number of parts in wordSize,
+	// numbers of parts of variants of a transposition word in variantSizes
+	size_t Build( CVariantParts& parts, const TVariantSize word,
+		size_t& wordSize, vector<size_t>& variantSizes ) const;
+
+private:
+	struct CNode;
+	const CNode* root;
+
+	static const CNode* newNode( const CNode& node );
+	// replaces the node of the word with the node returned by replace
+	template<typename TReplace>
+	static const CNode* replace( const CNode* node,
+		const TVariantSize word, TReplace replaceNode );
+	static void build( const CNode* node, CVariantParts& parts,
+		const TVariantSize word, size_t& words, size_t& wordPart,
+		size_t& wordSize, vector<size_t>& variantSizes );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Variants are allocated from the arena of the build context, their words
+// are stored in the words of the context, so they must not outlive the context.
+class CPatternVariant :
+	public vector<const CPatternWord*, CArenaAllocator<const CPatternWord*>> {
 public:
 	CPatternVariant& operator+=( const CPatternVariant& variant )
 	{
 		this->insert( this->end(), variant.cbegin(), variant.cend() );
-		Parts.insert( Parts.end(), variant.Parts.cbegin(), variant.Parts.cend() );
+		Parts += variant.Parts;
 		return *this;
 	}
 
-	void Build( CPatternBuildContext& context ) const;
+	// a variant has at most one repeated word or group or transposition
+	TVariantSize RepeatedWord() const;
+	bool HasRepeatedWord() const { return ( RepeatedWord() < this->size() ); }
+	TVariantSize TranspositionWord() const;
+	bool HasTransposition() const
+		{ return ( TranspositionWord() < this->size() ); }
+	// number of words of the shortest recognition
+	size_t MinSize() const;
+	// number of words of the longest recognition
+	size_t MaxSize() const;
+	// limits repetitions so recognitions have at most maxSize words
+	void LimitSize( CPatternWords& words, const size_t maxSize );
+	// adds a variant for each number of repetitions of the repeated word
+	// or for each order of variants of elements of the transposition
+	void Unroll( CPatternWords& words, CPatternVariants& variants ) const;
+	// adds the variant to the automaton of the context,
+	// returns false if the automaton already has the variant
+	bool Build( CPatternBuildContext& context ) const;
 	void Print( const CPatterns& context, ostream& out ) const;
 
-	list<const CBaseVariantPart*> Parts;
+	CPatternVariantParts Parts;
+
+private:
+	void repeat( CPatternWords& words, const TVariantSize word,
+		const TVariantSize count );
+	void unrollTransposition( CPatternWords& words,
+		CPatternVariants& variants ) const;
+	void transpose( CPatternWords& words, const TVariantSize word,
+		const vector<size_t>& order );
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
-class CPatternVariants : public vector<CPatternVariant> {
+class CPatternVariants :
+	public vector<CPatternVariant, CArenaAllocator<CPatternVariant>> {
 public:
-	void SortAndRemoveDuplicates( const CPatterns& context );
+	void SortAndRemoveDuplicates( CPatternWords& words );
+	// replaces variants with repeated words or transpositions
+	// with the unrolled variants
+	void Unroll( CPatternWords& words );
+	// unrolls variants with repeated words or transpositions which match
+	// the same words as other variants or as variants of the automaton
+	// of the context, so recognitions are not duplicated
+	void UnrollOverlapping( CPatternWords& words,
+		const CPatternBuildContext* context = nullptr );
 	void Build( CPatternBuildContext& context ) const;
 	void Print( const CPatterns& context, ostream& out ) const;
+
+private:
+	// the variant with the transposition may match the same words
+	// as the other variant, the words are compared around the transposition
+	static bool mayOverlap( const CPatternVariant& transposed,
+		const CPatternVariant& variant );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Automaton of a referenced pattern for chart mode
+struct CSpanAutomaton {
+	TSpan Index;
+	string Name; // printed reference
+	bool HasHead; // the pattern has an argument
+	TElement HeadElement; // the element of the argument
+	CStates States;
+};
+
+// Automata of referenced patterns shared by all patterns in chart mode.
+// A reference is matched as a span if the pattern has at most one argument
+// and each variant of the pattern has exactly one word of the argument.
+// Other references and recursive references are expanded inline.
+class CSpanAutomata {
+	CSpanAutomata( const CSpanAutomata& ) = delete;
+	CSpanAutomata& operator=( const CSpanAutomata& ) = delete;
+
+public:
+	explicit CSpanAutomata( const TVariantSize maxSize );
+
+	TVariantSize MaxSize() const { return maxSize; }
+	TSpan Size() const { return automata.size(); }
+	const CSpanAutomaton& Automaton( const TSpan span ) const;
+
+	enum TStatus {
+		S_NotFound,
+		S_Building,
+		S_Built,
+		S_Inline
+	};
+	TStatus Status( const TSpan span ) const { return statuses[span]; }
+	TStatus Find( const string& name, TSpan& span ) const;
+	TSpan Add( const string& name );
+	void SetInline( const TSpan span );
+	void SetBuilt( const TSpan span, const bool hasHead,
+		const TElement headElement, CStates&& states );
+
+private:
+	const TVariantSize maxSize;
+	// addresses of automata are stable
+	deque<CSpanAutomaton> automata;
+	vector<TStatus> statuses;
+	unordered_map<string, TSpan> names;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -439,31 +842,98 @@ public:
 class CPatternBuildContext {
 public:
 	CStates States;
-	vector<pair<string, TStateIndex>> LastVariant;
-
-	explicit CPatternBuildContext( const CPatterns& patterns );
+	// states reached from states by words keyed by their texts,
+	// so the automaton is a tree of words of variants, states of elements
+	// of a transposition are reached only through the transposition
+	map<pair<TStateIndex, const string*>, TStateIndex> NextStates;
+	// previous state and word of the transition to each state,
+	// states of a repeated group follow its loop state
+	vector<pair<TStateIndex, const CPatternWord*>> StateWords;
+	// number of attribute transitions of the states
+	size_t AttributesTransitions;
+
+	// references are built as spans if automata are set
+	explicit CPatternBuildContext( const CPatterns& patterns,
+		CSpanAutomata* spans = nullptr );
 
 	const CPatterns& Patterns() const { return patterns; }
+	CSpanAutomata* Spans() const { return spans; }
+	// arena of variants built with the context
+	CArena& Arena() { return arena; }
+	// words of variants built with the context
+	CPatternWords& Words() { return words; }
+	// actions of conditions of variants built with the context
+	CConditionActions& ConditionActions() { return conditionActions; }
 
 	TVariantSize PushMaxSize( const TReference reference,
 		const TVariantSize maxSize );
 	TVariantSize PopMaxSize( const TReference reference );
 
-	static void AddVariants( const vector<CPatternVariants>& allSubVariants,
-		vector<CPatternVariant>& variants, const size_t maxSize );
+	// passes each combination of sub variants of at most maxSize words
+	void AddVariants( const vector<CPatternVariants>& allSubVariants,
+		IVariantCallback& callback, const size_t maxSize );
+	void AddVariants( const vector<const CPatternVariants*>& allSubVariants,
+		IVariantCallback& callback, const size_t maxSize );
+	// the automaton has the variant, for a variant with a transposition
+	// the automaton may have one of its orders
+	bool HasVariant( const CPatternVariant& variant ) const;
 
 private:
 	const CPatterns& patterns;
+	CSpanAutomata* const spans;
+	CArena arena;
+	// words are allocated from the arena, so they are destroyed before it
+	CPatternWords words;
+	CConditionActions conditionActions;
 	struct CPatternBuildData {
 		stack<TVariantSize> MaxSizes;
 	};
 	vector<CPatternBuildData> data;
 
-	static bool nextIndices( const vector<CPatternVariants>& allSubVariants,
-		vector<size_t>& indices );
+	bool mayHaveTransposition( const TStateIndex state,
+		const CPatternWord& transposedWord ) const;
+	void addVariants( const vector<const CPatternVariants*>& allSubVariants,
+		const vector<size_t>& minSizes, const size_t pos,
+		CPatternVariant& variant, IVariantCallback& callback,
+		const size_t maxSize );
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Automaton of a pattern with what is needed after its build context
+// (and the arena of its variants) is destroyed.
+struct CPatternAutomaton {
+	CStates States;
+	size_t VariantsCount;
+	// previous state and printed word of the transition to each state,
+	// kept only for profiles
+	vector<pair<TStateIndex, string>> StateWords;
+	// printed variants, kept only if they are printed
+	string PrintedVariants;
+
+	CPatternAutomaton() : VariantsCount( 0 ) {}
+	// moves the states out of the context
+	CPatternAutomaton( CPatternBuildContext& context,
+		const size_t variantsCount, const bool keepStateWords );
+
+	// printed words of the path from the initial state to the state
+	string StateLabel( TStateIndex state ) const;
+};
+
+typedef vector<CPatternAutomaton> CPatternAutomata;
+
+// Builds variants and automaton of each pattern in its own context,
+// the context is destroyed as soon as the automaton is built.
+// Variants are added to the automaton as they are built unless they are
+// printed, so they are not kept all at once.
+// Patterns are built by threadsCount threads (0 for all cores) unless
+// referenced patterns are built as spans, since the automata of spans are
+// shared and the order of building decides which references are inline.
+void BuildPatterns( const CPatterns& patterns, const TVariantSize maxSize,
+	CSpanAutomata* spans, const size_t threadsCount, CPatternAutomata& automata,
+	const bool keepStateWords = false, const bool keepPrintedVariants = false );
+
+///////////////////////////////////////////////////////////////////////////////
+
 } // end of Pattern namespace
 } // end of Lspl namespace
@@ -1,5 +1,9 @@
 #include <common.h>
 #include <PatternMatch.h>
+#include <MatchStatistics.h>
+#include <Pattern.h>
+#include <Chart.h>
+#include <WordClasses.h>
 
 using namespace Lspl::Text;
 using namespace Lspl::Configuration;
@@ -146,16 +150,23 @@ CData::value_type& CDataEditor::GetForEdit( const CData::size_type index ) const
 
 void CDataEditor::Restore()
 {
+	if( dump.empty() ) {
+		return;
+	}
 	for( pair<const CData::size_type, CData::value_type>& key : dump ) {
 		debug_check_logic( key.first < data.size() );
 		data[key.first] = move( key.second );
 	}
+	dump.clear();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-CBaseTransition::CBaseTransition( const TStateIndex _nextState ) :
-	nextState( _nextState )
+CBaseTransition::CBaseTransition( const TType _type,
+		const TStateIndex _nextState ) :
+	type( _type ),
+	nextState( _nextState ),
+	transposedWord( NoTransposedWord )
 {
 	debug_check_logic( nextState > 0 );
 }
@@ -168,36 +179,200 @@ CBaseTransition::~CBaseTransition()
 
 CWordTransition::CWordTransition( RegexEx&& _wordRegex,
 		const TStateIndex nextState ) :
-	CBaseTransition( nextState ),
+	CBaseTransition( T_Word, nextState ),
 	wordRegex( move( _wordRegex ) )
 {
 }
 
-bool CWordTransition::Match( const CWord& word,
+bool CWordTransition::Match( const CText& /*text*/, const CWord& word,
 	CAnnotationIndices& indices ) const
 {
 	if( !word.MatchWord( wordRegex ) ) {
 		return false;
 	}
-	indices = move( word.AnnotationIndices() );
+	indices = word.AnnotationIndices();
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const CAnnotationSetCache::TCell CAnnotationSetCache::KnownCell;
+const size_t CAnnotationSetCache::PageSize;
+
+CAnnotationSetCache::CBinding::CBinding( const uint64_t serial,
+		const size_t pagesCount ) :
+	Serial( serial ),
+	PagesCount( pagesCount ),
+	Pages( new atomic<CPage*>[pagesCount] )
+{
+	for( size_t i = 0; i < PagesCount; i++ ) {
+		Pages[i].store( nullptr, memory_order_relaxed );
+	}
+}
+
+CAnnotationSetCache::CBinding::~CBinding()
+{
+	for( size_t i = 0; i < PagesCount; i++ ) {
+		delete Pages[i].load( memory_order_relaxed );
+	}
+}
+
+// Counts a search or an addition as a user of the current binding.
+// Users load the binding after they are counted, so a binding replaced
+// while the only user is the thread which replaced it is not used by others.
+class CAnnotationSetCache::CUse {
+public:
+	explicit CUse( atomic<size_t>& _users ) :
+		users( _users )
+	{
+		users.fetch_add( 1 );
+	}
+	~CUse()
+	{
+		users.fetch_sub( 1 );
+	}
+
+private:
+	atomic<size_t>& users;
+};
+
+CAnnotationSetCache::CAnnotationSetCache() :
+	binding( nullptr ),
+	users( 0 )
+{
+}
+
+CAnnotationSetCache::~CAnnotationSetCache()
+{
+	delete binding.load( memory_order_relaxed );
+}
+
+bool CAnnotationSetCache::Find( const CAnnotationSets& sets,
+	const TAnnotationSet set, CAnnotationIndices& indices ) const
+{
+	CUse use( users );
+	const CBinding* current = binding.load();
+	if( current == nullptr || current->Serial != sets.Serial()
+		|| set >= current->PagesCount * PageSize )
+	{
+		return false;
+	}
+	const CPage* page = current->Pages[set / PageSize].load( memory_order_acquire );
+	if( page == nullptr ) {
+		return false;
+	}
+	const TCell cell = page->Cells[set % PageSize].load( memory_order_relaxed );
+	if( cell == 0 ) {
+		return false;
+	}
+	indices.Empty();
+	for( TAnnotationIndex index = 0; index < 63; index++ ) {
+		if( ( cell & ( TCell( 1 ) << index ) ) != 0 ) {
+			indices.Add( index );
+		}
+	}
 	return true;
 }
 
+void CAnnotationSetCache::Add( const CAnnotationSets& sets,
+	const TAnnotationSet set, const CAnnotationIndices& indices ) const
+{
+	if( sets[set].size() >= 64 ) {
+		return; // does not fit in a cell
+	}
+	CUse use( users );
+	CBinding* current = binding.load();
+	if( current == nullptr || current->Serial != sets.Serial() ) {
+		current = bind( sets );
+	}
+	if( set >= current->PagesCount * PageSize ) {
+		return; // the set was added after binding
+	}
+
+	atomic<CPage*>& pagePtr = current->Pages[set / PageSize];
+	CPage* page = pagePtr.load( memory_order_acquire );
+	if( page == nullptr ) {
+		CPage* newPage = new CPage;
+		for( atomic<TCell>& cell : newPage->Cells ) {
+			cell.store( 0, memory_order_relaxed );
+		}
+		if( pagePtr.compare_exchange_strong( page, newPage,
+			memory_order_acq_rel ) )
+		{
+			page = newPage;
+		} else {
+			delete newPage; // added by another thread
+		}
+	}
+
+	TCell cell = KnownCell;
+	for( const TAnnotationIndex index : indices ) {
+		cell |= TCell( 1 ) << index;
+	}
+	page->Cells[set % PageSize].store( cell, memory_order_relaxed );
+}
+
+CAnnotationSetCache::CBinding* CAnnotationSetCache::bind(
+	const CAnnotationSets& sets ) const
+{
+	lock_guard<mutex> lock( bindMutex );
+	CBinding* current = binding.load();
+	if( current != nullptr && current->Serial == sets.Serial() ) {
+		return current;
+	}
+
+	CBinding* newBinding = new CBinding( sets.Serial(),
+		( sets.Size() + PageSize - 1 ) / PageSize );
+	binding.store( newBinding );
+	if( current != nullptr ) {
+		retired.emplace_back( current );
+	}
+	// the thread is the only user, others will use the new binding
+	if( users.load() == 1 ) {
+		retired.clear();
+	}
+	return newBinding;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 CAttributesTransition::CAttributesTransition(
-		CAttributesRestriction&& _attributesRestriction,
+		CAttributesRestriction&& _attributesRestriction, const size_t _index,
 		const TStateIndex nextState ) :
-	CBaseTransition( nextState ),
-	attributesRestriction( move( _attributesRestriction ) )
+	CBaseTransition( T_Attributes, nextState ),
+	attributesRestriction( move( _attributesRestriction ) ),
+	index( _index )
 {
 	debug_check_logic( !attributesRestriction.IsEmpty() );
 }
 
-bool CAttributesTransition::Match( const CWord& word,
+bool CAttributesTransition::Match( const CText& text, const CWord& word,
 	CAnnotationIndices& indices ) const
 {
-	return word.MatchAttributes( attributesRestriction, indices );
+	const CAnnotationSets& sets = text.AnnotationSets();
+	if( cache.Find( sets, word.AnnotationSet(), indices ) ) {
+		return !indices.IsEmpty();
+	}
+	const bool success = word.MatchAttributes( attributesRestriction, indices );
+	cache.Add( sets, word.AnnotationSet(), indices );
+	return success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CSpanTransition::CSpanTransition( const TSpan _span,
+		const TStateIndex nextState ) :
+	CBaseTransition( T_Span, nextState ),
+	span( _span )
+{
+	debug_check_logic( span != NoSpan );
+}
+
+bool CSpanTransition::Match( const CText& /*text*/, const CWord& /*word*/,
+	CAnnotationIndices& /*indices*/ ) const
+{
+	check_logic( false ); // span transitions are matched by CMatchContext
+	return false;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -223,6 +398,86 @@ bool CActions::Run( const CMatchContext& context ) const
 	return true;
 }
 
+bool CActions::HasConditions() const
+{
+	for( const CActionPtr& action : actions ) {
+		if( dynamic_cast<const CSaveAction*>( action.get() ) == nullptr ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CActions::HasSave() const
+{
+	for( const CActionPtr& action : actions ) {
+		if( dynamic_cast<const CSaveAction*>( action.get() ) != nullptr ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CActions::DependsOnLoop() const
+{
+	for( const CActionPtr& action : actions ) {
+		if( dynamic_cast<const CLoopAgreementAction*>( action.get() ) != nullptr ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CActions::DependsOnTransposition() const
+{
+	for( const CActionPtr& action : actions ) {
+		if( dynamic_cast<const CTranspositionAgreementAction*>(
+			action.get() ) != nullptr )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+CActions CActions::Transposed( const TVariantSize position,
+	const vector<TVariantSize>& positions ) const
+{
+	CActions transposed;
+	for( const CActionPtr& action : actions ) {
+		const CTranspositionAgreementAction* transpositionAction =
+			dynamic_cast<const CTranspositionAgreementAction*>( action.get() );
+		if( transpositionAction == nullptr ) {
+			transposed.Add( action );
+		} else {
+			CActionPtr transposedAction =
+				transpositionAction->Transposed( position, positions );
+			if( static_cast<bool>( transposedAction ) ) {
+				transposed.Add( transposedAction );
+			}
+		}
+	}
+	return transposed;
+}
+
+CActions CActions::Unrolled( const TVariantSize distance ) const
+{
+	CActions unrolled;
+	for( const CActionPtr& action : actions ) {
+		const CLoopAgreementAction* loopAction =
+			dynamic_cast<const CLoopAgreementAction*>( action.get() );
+		if( loopAction == nullptr ) {
+			unrolled.Add( action );
+		} else {
+			CActionPtr unrolledAction = loopAction->Unrolled( distance );
+			if( static_cast<bool>( unrolledAction ) ) {
+				unrolled.Add( unrolledAction );
+			}
+		}
+	}
+	return unrolled;
+}
+
 void CActions::Print( const CConfiguration& configuration, ostream& out ) const
 {
 	for( const CActionPtr& action : actions ) {
@@ -232,13 +487,44 @@ void CActions::Print( const CConfiguration& configuration, ostream& out ) const
 
 ///////////////////////////////////////////////////////////////////////////////
 
+bool ParseMatchPolicy( const string& name, TMatchPolicy& policy )
+{
+	if( name == "all" ) {
+		policy = MP_All;
+	} else if( name == "longest" ) {
+		policy = MP_Longest;
+	} else if( name == "leftmost-longest" ) {
+		policy = MP_LeftmostLongest;
+	} else if( name == "non-overlapping" ) {
+		policy = MP_NonOverlapping;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 CMatchContext::CMatchContext( const CText& text, const CStates& states ) :
 	text( text ),
 	states( states ),
 	initialWordIndex( 0 ),
-	recognitionCallback( nullptr )
+	spanSlots( 0 ),
+	loopSlot( 0 ),
+	recognitionCallback( nullptr ),
+	statistics( nullptr ),
+	chart( nullptr ),
+	wordClasses( nullptr ),
+	classRestrictions( nullptr ),
+	policy( MP_All ),
+	firstWord( 0 ),
+	recognized( false ),
+	bestEnd( 0 ),
+	limit( 0 ),
+	passedRecognitions( 0 )
 {
 	data.reserve( 32 );
+	slots.reserve( 32 );
 }
 
 const CDataEditor& CMatchContext::DataEditor() const
@@ -255,15 +541,90 @@ const TVariantSize CMatchContext::Shift() const
 
 const Text::TWordIndex CMatchContext::Word() const
 {
-	return ( InitialWord() + Shift() );
+	debug_check_logic( !slots.empty() );
+	return slots.back().End;
+}
+
+const TTransposedWord CMatchContext::TransposedWord(
+	const TVariantSize slot ) const
+{
+	debug_check_logic( slot < slots.size() );
+	return slots[slot].TransposedWord;
+}
+
+const Text::TWordIndex CMatchContext::SlotWord( const TVariantSize slot ) const
+{
+	debug_check_logic( slot < slots.size() );
+	return slots[slot].Word;
 }
 
 void CMatchContext::Match( const TWordIndex _initialWordIndex )
 {
 	debug_check_logic( data.empty() );
+	debug_check_logic( slots.empty() );
 	debug_check_logic( editors.empty() );
+	if( IsFinished() ) {
+		return;
+	}
+	if( policy == MP_All ) {
+		initialWordIndex = _initialWordIndex;
+		match( 0 );
+		return;
+	}
+
+	debug_check_logic( recognitions.empty() );
+	debug_check_logic( _initialWordIndex >= initialWordIndex );
 	initialWordIndex = _initialWordIndex;
+	if( initialWordIndex < firstWord ) {
+		return; // the word of a passed recognition
+	}
+	if( policy != MP_NonOverlapping && maxWords.empty() ) {
+		buildMaxWords();
+	}
+	recognized = false;
 	match( 0 );
+	passRecognitions();
+}
+
+void CMatchContext::Save( const CVariantParts& parts ) const
+{
+	if( recognitionCallback == nullptr && limit == 0 ) {
+		return;
+	}
+	if( spanSlots == 0 ) {
+		addRecognition( Word(), Data(), parts );
+	} else {
+		saveSpans( parts );
+	}
+}
+
+void CMatchContext::SetPolicy( const TMatchPolicy _policy )
+{
+	debug_check_logic( data.empty() );
+	policy = _policy;
+	firstWord = 0;
+	maxWords.clear();
+}
+
+void CMatchContext::SetLimit( const size_t _limit )
+{
+	debug_check_logic( data.empty() );
+	limit = _limit;
+	passedRecognitions = 0;
+}
+
+size_t CMatchContext::SufficientBegins() const
+{
+	// with leftmost policies words of passed recognitions are skipped
+	if( policy == MP_All || policy == MP_Longest ) {
+		return limit;
+	}
+	return 0;
+}
+
+TWordIndex CMatchContext::nextWord() const
+{
+	return ( slots.empty() ? InitialWord() : ( slots.back().End + 1 ) );
 }
 
 void CMatchContext::match( const TStateIndex stateIndex )
@@ -271,24 +632,312 @@ void CMatchContext::match( const TStateIndex stateIndex )
 	const CState& state = states[stateIndex];
 	const CTransitions& transitions = state.Transitions;
 
-	if( !state.Actions.Run( *this ) // conditions are not met
+	// repetitions of the word of the state
+	if( state.IsLoop() ) {
+		loopSlot = state.LoopSlot;
+	}
+	const size_t count = state.IsLoop()
+		? ( slots.size() - state.LoopSlot ) / state.LoopSize : 1;
+	const bool repeated = ( count >= state.LoopMinCount );
+	if( !runActions( stateIndex ) // conditions are not met
+		|| IsFinished()
 		|| transitions.empty() // leaf
-		|| !( ( InitialWord() + data.size() ) < Text().Length() ) )
+		|| !( nextWord() < Text().Length() ) )
 	{
 		return;
 	}
 
+	const TWordIndex word = nextWord();
 	data.emplace_back();
+	slots.push_back( { word, word, nullptr, NoTransposedWord } );
 	editors.emplace( data );
 	for( const CTransitionPtr& transition : transitions ) {
-		if( transition->Match( Text().Word( Word() ), data.back().Indices ) ) {
+		if( IsFinished() ) {
+			break;
+		}
+		const bool repetition =
+			( state.IsLoop() && &transition == &transitions.front() );
+		if( state.IsLoop()
+			&& ( repetition ? ( count >= state.LoopMaxCount ) : !repeated ) )
+		{
+			continue;
+		}
+		if( recognized && isPruned( *transition ) ) {
+			continue;
+		}
+		restoreData();
+		slots.back().TransposedWord = transition->TransposedWord();
+		if( transition->IsSpan() ) {
+			matchSpan( static_cast<const CSpanTransition&>( *transition ),
+				repetition );
+		} else if( matchTransition( *transition, repetition ) ) {
 			match( transition->NextState() );
 		}
 	}
 	editors.pop();
+	slots.pop_back();
 	data.pop_back();
 }
 
+void CMatchContext::restoreData()
+{
+	editors.top().Restore();
+	// the editor does not save the last word, its annotations are set
+	// by the transition, but its edges are left by the previous one
+	data.back().EdgeSet.clear();
+}
+
+bool CMatchContext::runActions( const TStateIndex stateIndex )
+{
+	const CState& state = states[stateIndex];
+	if( statistics == nullptr ) {
+		return state.Actions.Run( *this );
+	}
+
+	CStateStatistics& stateStatistics = statistics->State( stateIndex );
+	stateStatistics.Visits++;
+	const CMatchStatistics::CClock::time_point start
+		= CMatchStatistics::CClock::now();
+	const bool success = state.Actions.Run( *this );
+	stateStatistics.ActionNanoseconds += CMatchStatistics::Nanoseconds( start );
+	if( !success ) {
+		stateStatistics.ActionFailures++;
+	}
+	return success;
+}
+
+bool CMatchContext::matchTransition( const CBaseTransition& transition,
+	const bool repetition )
+{
+	const CWord& word = Text().Word( Word() );
+	if( statistics == nullptr ) {
+		return testTransition( transition, word );
+	}
+
+	CStateStatistics& stateStatistics
+		= statistics->State( transition.NextState() );
+	( repetition ? stateStatistics.LoopTests : stateStatistics.Tests )++;
+	const CMatchStatistics::CClock::time_point start
+		= CMatchStatistics::CClock::now();
+	const bool success = testTransition( transition, word );
+	stateStatistics.TransitionNanoseconds += CMatchStatistics::Nanoseconds( start );
+	if( success ) {
+		( repetition ? stateStatistics.LoopMatches : stateStatistics.Matches )++;
+	}
+	return success;
+}
+
+bool CMatchContext::testTransition( const CBaseTransition& transition,
+	const CWord& word )
+{
+	if( wordClasses != nullptr ) {
+		return wordClasses->MatchTransition( *classRestrictions, transition,
+			Text(), word, data.back().Indices );
+	}
+	return transition.Match( Text(), word, data.back().Indices );
+}
+
+void CMatchContext::matchSpan( const CSpanTransition& transition,
+	const bool repetition )
+{
+	debug_check_logic( chart != nullptr );
+	const TWordIndex begin = slots.back().Word;
+
+	const CMatchStatistics::CClock::time_point start
+		= ( statistics == nullptr ) ? CMatchStatistics::CClock::time_point()
+			: CMatchStatistics::CClock::now();
+	const CSpanRecognitions& recognitions
+		= chart->Recognitions( transition.Span(), begin );
+	if( statistics != nullptr ) {
+		CStateStatistics& stateStatistics
+			= statistics->State( transition.NextState() );
+		( repetition ? stateStatistics.LoopTests : stateStatistics.Tests )++;
+		( repetition ? stateStatistics.LoopMatches : stateStatistics.Matches )
+			+= recognitions.size();
+		stateStatistics.TransitionNanoseconds
+			+= CMatchStatistics::Nanoseconds( start );
+	}
+
+	spanSlots++;
+	for( const CSpanRecognition& recognition : recognitions ) {
+		if( IsFinished() ) {
+			break;
+		}
+		CSlot& slot = slots.back();
+		slot.End = recognition.End;
+		slot.Span = &recognition;
+		restoreData();
+		if( recognition.HasHead() ) {
+			slot.Word = begin + recognition.Head;
+			data.back().Indices = recognition.Indices[recognition.Head];
+		} else {
+			slot.Word = begin;
+			data.back().Indices = CAnnotationIndices();
+		}
+		match( transition.NextState() );
+	}
+	spanSlots--;
+	slots.back() = { begin, begin, nullptr, NoTransposedWord };
+}
+
+void CMatchContext::saveSpans( const CVariantParts& parts ) const
+{
+	debug_check_logic( chart != nullptr );
+	// the recognition with spans replaced can be too long
+	if( ( Word() - InitialWord() ) >= chart->MaxSize() ) {
+		return;
+	}
+
+	CData spanData;
+	CVariantParts spanParts;
+	spanParts.reserve( parts.size() );
+	TVariantSize slot = 0;
+	for( const CBaseVariantPart* const part : parts ) {
+		if( part == nullptr || part->Type() == VPR_Instance ) {
+			spanParts.push_back( part );
+			continue;
+		}
+
+		debug_check_logic( slot < slots.size() );
+		if( part->Type() == VPR_Span ) {
+			debug_check_logic( slots[slot].Span != nullptr );
+			const CSpanRecognition& recognition = *slots[slot].Span;
+			// the first part of the recognition is the referenced pattern
+			spanParts.push_back(
+				static_cast<const CSpanVariantPart*>( part )->InstancePart() );
+			spanParts.insert( spanParts.end(),
+				next( recognition.Parts.cbegin() ), recognition.Parts.cend() );
+			for( size_t i = 0; i < recognition.Indices.size(); i++ ) {
+				spanData.emplace_back();
+				// annotations of the head can be reduced by the agreement
+				spanData.back().Indices = ( i == recognition.Head )
+					? data[slot].Indices : recognition.Indices[i];
+			}
+		} else {
+			spanParts.push_back( part );
+			spanData.emplace_back();
+			spanData.back().Indices = data[slot].Indices;
+		}
+		slot++;
+	}
+	debug_check_logic( slot == slots.size() );
+
+	addRecognition( Word(), spanData, spanParts );
+}
+
+void CMatchContext::buildMaxWords()
+{
+	// transitions lead to states built later except transitions to loop
+	// states which end repetitions, states of a repeated group are built
+	// after its loop state, so they get the words after the loop state
+	// only when it is computed
+	maxWords.assign( states.size(), 0 );
+	for( TStateIndex stateIndex = states.size(); stateIndex-- > 0; ) {
+		const CState& state = states[stateIndex];
+		size_t loopWords = 0;
+		size_t words = 0;
+		for( const CTransitionPtr& transition : state.Transitions ) {
+			const TStateIndex nextState = transition->NextState();
+			if( state.IsLoop() && &transition == &state.Transitions.front() ) {
+				// words of a repetition
+				loopWords = ( transitionWords( *transition )
+					+ ( nextState == stateIndex ? 0 : maxWords[nextState] ) )
+					* ( state.LoopMaxCount - 1u );
+			} else if( nextState < stateIndex ) {
+				debug_check_logic( states[nextState].IsLoop() );
+				words = max( words, transitionWords( *transition ) );
+			} else {
+				words = max( words,
+					transitionWords( *transition ) + maxWords[nextState] );
+			}
+		}
+		maxWords[stateIndex] = loopWords + words;
+
+		if( state.IsLoop() ) {
+			TStateIndex groupState = state.Transitions.front()->NextState();
+			while( groupState != stateIndex ) {
+				maxWords[groupState] += maxWords[stateIndex];
+				groupState = states[groupState].Transitions.front()->NextState();
+			}
+		}
+	}
+}
+
+size_t CMatchContext::transitionWords( const CBaseTransition& transition ) const
+{
+	if( transition.IsSpan() ) {
+		debug_check_logic( chart != nullptr );
+		return chart->MaxSize();
+	}
+	return 1;
+}
+
+bool CMatchContext::isPruned( const CBaseTransition& transition ) const
+{
+	debug_check_logic( recognized );
+	// the first word of the transition
+	const TWordIndex word = slots.back().Word;
+	if( policy == MP_NonOverlapping ) {
+		return ( word > bestEnd );
+	}
+	debug_check_logic( transition.NextState() < maxWords.size() );
+	return ( word + transitionWords( transition ) - 1
+		+ maxWords[transition.NextState()] < bestEnd );
+}
+
+void CMatchContext::addRecognition( const TWordIndex end,
+	const CData& recognitionData, const CVariantParts& parts ) const
+{
+	if( IsFinished() ) {
+		return; // other recognitions of the final state
+	}
+	if( policy == MP_All ) {
+		passRecognition( end, recognitionData, parts );
+		return;
+	}
+
+	if( recognized && end != bestEnd ) {
+		const bool better = ( policy == MP_NonOverlapping )
+			? ( end < bestEnd ) : ( end > bestEnd );
+		if( !better ) {
+			return;
+		}
+		recognitions.clear();
+	}
+	recognized = true;
+	bestEnd = end;
+	recognitions.push_back( { recognitionData, parts } );
+}
+
+void CMatchContext::passRecognitions()
+{
+	if( !recognized ) {
+		return;
+	}
+	if( policy != MP_Longest ) {
+		firstWord = bestEnd + 1;
+	}
+	for( const CRecognition& recognition : recognitions ) {
+		if( IsFinished() ) {
+			break;
+		}
+		passRecognition( bestEnd, recognition.Data, recognition.Parts );
+	}
+	recognitions.clear();
+	recognized = false;
+}
+
+void CMatchContext::passRecognition( const TWordIndex end,
+	const CData& recognitionData, const CVariantParts& parts ) const
+{
+	debug_check_logic( !IsFinished() );
+	passedRecognitions++;
+	if( recognitionCallback != nullptr ) {
+		recognitionCallback->OnRecognized( InitialWord(), end,
+			Text(), recognitionData, parts );
+	}
+}
+
 IRecognitionCallback* CMatchContext::RecognitionCallback() const
 {
 	return recognitionCallback;
@@ -300,6 +949,31 @@ void CMatchContext::SetRecognitionCallback(
 	recognitionCallback = _recognitionCallback;
 }
 
+void CMatchContext::SetChart( CChart* _chart )
+{
+	debug_check_logic( data.empty() );
+	chart = _chart;
+}
+
+void CMatchContext::SetStatistics( CMatchStatistics* _statistics )
+{
+	debug_check_logic( _statistics == nullptr
+		|| _statistics->States().size() == states.size() );
+	statistics = _statistics;
+}
+
+void CMatchContext::SetWordClasses( const CWordClasses* _wordClasses )
+{
+	debug_check_logic( data.empty() );
+	wordClasses = _wordClasses;
+	classRestrictions = nullptr;
+	if( wordClasses != nullptr ) {
+		check_logic( wordClasses->Serial() == text.AnnotationSets().Serial() );
+		classRestrictions = wordClasses->TransitionRestrictions( states );
+		check_logic( classRestrictions != nullptr );
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 CAgreementAction::CAgreementAction( const TAttribute _attribute,
@@ -330,15 +1004,16 @@ bool CAgreementAction::Run( const CMatchContext& context ) const
 	for( TVariantSize i = 0; i < offsets.Size(); i++ ) {
 		debug_check_logic( offsets[i] > 0 );
 		debug_check_logic( offsets[i] <= word2 );
-		if( !agree( context, word2 - offsets[i], word2 ) ) {
+		if( !Agree( context, attribute, strong, word2 - offsets[i], word2 ) ) {
 			return false;
 		}
 	}
 	return true;
 }
 
-bool CAgreementAction::agree( const CMatchContext& context,
-	const TVariantSize word1, const TVariantSize word2 ) const
+bool CAgreementAction::Agree( const CMatchContext& context,
+	const TAttribute attribute, const bool strong,
+	const TVariantSize word1, const TVariantSize word2 )
 {
 	debug_check_logic( word1 < word2 );
 
@@ -346,20 +1021,17 @@ bool CAgreementAction::agree( const CMatchContext& context,
 	CEdges& edges1 = editor.GetForEdit( word1 );
 	CEdges& edges2 = editor.GetForEdit( word2 );
 
-	const CAnnotations wa1
-		= context.Text().Word( context.InitialWord() + word1 ).Annotations();
-	const CAnnotations wa2
-		= context.Text().Word( context.InitialWord() + word2 ).Annotations();
+	const CAnnotations& wa1
+		= context.Text().Word( context.SlotWord( word1 ) ).Annotations();
+	const CAnnotations& wa2
+		= context.Text().Word( context.SlotWord( word2 ) ).Annotations();
 
 	bool added = false;
 	CAnnotationIndices unused1 = edges1.Indices;
 	CAnnotationIndices unused2 = edges2.Indices;
 
-	for( CAnnotationIndices::SizeType i1 = 0; i1 < edges1.Indices.Size(); i1++ ) {
-		for( CAnnotationIndices::SizeType i2 = 0; i2 < edges2.Indices.Size(); i2++ ) {
-			const TAnnotationIndex index1 = edges1.Indices.Value( i1 );
-			const TAnnotationIndex index2 = edges2.Indices.Value( i2 );
-
+	for( const TAnnotationIndex index1 : edges1.Indices ) {
+		for( const TAnnotationIndex index2 : edges2.Indices ) {
 			switch( wa1[index1].Agreement( wa2[index2], attribute ) ) {
 				case AP_None:
 					continue;
@@ -382,13 +1054,13 @@ bool CAgreementAction::agree( const CMatchContext& context,
 		return false;
 	}
 
-	for( TAnnotationIndex i = 0; i < unused1.Size(); i++ ) {
-		if( !CEdges::RemoveVertex( editor, word1, unused1.Value( i ) ) ) {
+	for( const TAnnotationIndex index : unused1 ) {
+		if( !CEdges::RemoveVertex( editor, word1, index ) ) {
 			return false;
 		}
 	}
-	for( TAnnotationIndex i = 0; i < unused2.Size(); i++ ) {
-		if( !CEdges::RemoveVertex( editor, word2, unused2.Value( i ) ) ) {
+	for( const TAnnotationIndex index : unused2 ) {
+		if( !CEdges::RemoveVertex( editor, word2, index ) ) {
 			return false;
 		}
 	}
@@ -413,6 +1085,296 @@ void CAgreementAction::Print( const CConfiguration& configuration,
 
 ///////////////////////////////////////////////////////////////////////////////
 
+CLoopAgreementAction::CLoopAgreementAction( const TAttribute _attribute,
+		const bool _strong, const vector<CWords>& _words ) :
+	strong( _strong ),
+	attribute( _attribute ),
+	words( Cast<TVariantSize>( _words.size() ) )
+{
+	debug_check_logic( !_words.empty() );
+	for( TVariantSize i = 0; i < words.Size(); i++ ) {
+		debug_check_logic( _words[i].Type == WT_BeforeLoop
+			|| _words[i].Distance > 0 );
+		words[i] = _words[i];
+	}
+}
+
+bool CLoopAgreementAction::Run( const CMatchContext& context ) const
+{
+	const TVariantSize word2 = context.Shift();
+	const TVariantSize loopSlot = context.LoopSlot();
+	debug_check_logic( loopSlot <= word2 );
+	// the last of the words for the strong agreement
+	bool hasLast = false;
+	TVariantSize last = 0;
+	for( TVariantSize i = 0; i < words.Size(); i++ ) {
+		TVariantSize begin = 0;
+		TVariantSize end = 0;
+		switch( words[i].Type ) {
+			case WT_Current:
+				begin = word2 - words[i].Distance;
+				end = begin + 1;
+				break;
+			case WT_BeforeLoop:
+				debug_check_logic( words[i].Distance <= loopSlot );
+				begin = loopSlot - words[i].Distance;
+				end = begin + 1;
+				break;
+			case WT_Loop:
+				begin = loopSlot;
+				end = word2 + 1 > loopSlot + words[i].Distance
+					? word2 + 1 - words[i].Distance : loopSlot;
+				break;
+		}
+		for( TVariantSize word1 = begin; word1 < end; word1++ ) {
+			if( strong ) {
+				last = hasLast ? max( last, word1 ) : word1;
+				hasLast = true;
+			} else if( !CAgreementAction::Agree( context, attribute, false,
+				word1, word2 ) )
+			{
+				return false;
+			}
+		}
+	}
+	return ( !hasLast
+		|| CAgreementAction::Agree( context, attribute, true, last, word2 ) );
+}
+
+void CLoopAgreementAction::Print( const CConfiguration& configuration,
+	ostream& out ) const
+{
+	out << "<<"
+		<< configuration.Attributes()[attribute].Name( 0 )
+		<< ( strong ? "==" : "=" );
+	for( TVariantSize i = 0; i < words.Size(); i++ ) {
+		if( i > 0 ) {
+			out << ",";
+		}
+		switch( words[i].Type ) {
+			case WT_Current:
+				break;
+			case WT_BeforeLoop:
+				out << "b";
+				break;
+			case WT_Loop:
+				out << "l";
+				break;
+		}
+		out << Cast<uint32_t>( words[i].Distance );
+	}
+	out << ">>";
+}
+
+CActionPtr CLoopAgreementAction::Unrolled( const TVariantSize distance ) const
+{
+	// positions of words in the unrolled variant,
+	// the first repetition is at the position first
+	TVariantSize first = 0;
+	for( TVariantSize i = 0; i < words.Size(); i++ ) {
+		if( words[i].Type == WT_BeforeLoop ) {
+			first = max( first, words[i].Distance );
+		}
+	}
+	const TVariantSize word2 = first + distance;
+	vector<TVariantSize> positions;
+	for( TVariantSize i = 0; i < words.Size(); i++ ) {
+		switch( words[i].Type ) {
+			case WT_Current:
+				positions.push_back( word2 - words[i].Distance );
+				break;
+			case WT_BeforeLoop:
+				positions.push_back( first - words[i].Distance );
+				break;
+			case WT_Loop:
+				for( TVariantSize word1 = first;
+					word1 + words[i].Distance <= word2; word1++ )
+				{
+					positions.push_back( word1 );
+				}
+				break;
+		}
+	}
+
+	if( positions.empty() ) {
+		return CActionPtr();
+	}
+	if( strong ) {
+		return CActionPtr( new CAgreementAction( attribute,
+			word2 - *max_element( positions.cbegin(), positions.cend() ) ) );
+	}
+	return CActionPtr( new CAgreementAction( attribute, word2, positions ) );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CTranspositionAgreementAction::CTranspositionAgreementAction(
+		const TAttribute _attribute, const bool _strong,
+		const vector<CWords>& _words ) :
+	strong( _strong ),
+	attribute( _attribute ),
+	words( Cast<TVariantSize>( _words.size() ) )
+{
+	debug_check_logic( !_words.empty() );
+	for( TVariantSize i = 0; i < words.Size(); i++ ) {
+		debug_check_logic( _words[i].Type == WT_Transposed
+			|| _words[i].Word > 0 );
+		words[i] = _words[i];
+	}
+}
+
+bool CTranspositionAgreementAction::Run( const CMatchContext& context ) const
+{
+	const TVariantSize word2 = context.Shift();
+	// the first slot of the transposition is the first slot of its words
+	TVariantSize first = 0;
+	while( first < word2
+		&& context.TransposedWord( first ) == NoTransposedWord )
+	{
+		first++;
+	}
+	// words are found in the order of slots, so weak agreements are run
+	// in the order of words of a fixed order of the transposition
+	bool hasLast = false;
+	TVariantSize last = 0;
+	for( TVariantSize word1 = 0; word1 < word2; word1++ ) {
+		if( !isAgreed( context, first, word1, word2 ) ) {
+			continue;
+		}
+		if( strong ) {
+			last = word1;
+			hasLast = true;
+		} else if( !CAgreementAction::Agree( context, attribute, false,
+			word1, word2 ) )
+		{
+			return false;
+		}
+	}
+	return ( !hasLast
+		|| CAgreementAction::Agree( context, attribute, true, last, word2 ) );
+}
+
+bool CTranspositionAgreementAction::isAgreed( const CMatchContext& context,
+	const TVariantSize first, const TVariantSize word1,
+	const TVariantSize word2 ) const
+{
+	for( TVariantSize i = 0; i < words.Size(); i++ ) {
+		switch( words[i].Type ) {
+			case WT_Current:
+				if( word1 + words[i].Word == word2 ) {
+					return true;
+				}
+				break;
+			case WT_BeforeTransposition:
+				if( word1 + words[i].Word == first ) {
+					return true;
+				}
+				break;
+			case WT_Transposed:
+				if( word1 >= first
+					&& context.TransposedWord( word1 ) == words[i].Word )
+				{
+					return true;
+				}
+				break;
+		}
+	}
+	return false;
+}
+
+void CTranspositionAgreementAction::Print( const CConfiguration& configuration,
+	ostream& out ) const
+{
+	out << "<<"
+		<< configuration.Attributes()[attribute].Name( 0 )
+		<< ( strong ? "==" : "=" );
+	for( TVariantSize i = 0; i < words.Size(); i++ ) {
+		if( i > 0 ) {
+			out << ",";
+		}
+		switch( words[i].Type ) {
+			case WT_Current:
+				break;
+			case WT_BeforeTransposition:
+				out << "b";
+				break;
+			case WT_Transposed:
+				out << "t";
+				break;
+		}
+		out << words[i].Word;
+	}
+	out << ">>";
+}
+
+CActionPtr CTranspositionAgreementAction::Transposed(
+	const TVariantSize position, const vector<TVariantSize>& positions ) const
+{
+	// positions of words in the variant with the fixed order,
+	// the first word of the transposition is at the position first
+	TVariantSize first = 0;
+	for( TVariantSize i = 0; i < words.Size(); i++ ) {
+		if( words[i].Type == WT_BeforeTransposition ) {
+			first = max( first, Cast<TVariantSize>( words[i].Word ) );
+		}
+	}
+	const TVariantSize word2 = first + position;
+	vector<TVariantSize> wordPositions;
+	for( TVariantSize i = 0; i < words.Size(); i++ ) {
+		switch( words[i].Type ) {
+			case WT_Current:
+				wordPositions.push_back(
+					word2 - Cast<TVariantSize>( words[i].Word ) );
+				break;
+			case WT_BeforeTransposition:
+				wordPositions.push_back(
+					first - Cast<TVariantSize>( words[i].Word ) );
+				break;
+			case WT_Transposed:
+				debug_check_logic( words[i].Word < positions.size() );
+				if( positions[words[i].Word] < position ) {
+					wordPositions.push_back(
+						first + positions[words[i].Word] );
+				}
+				break;
+		}
+	}
+
+	if( wordPositions.empty() ) {
+		return CActionPtr();
+	}
+	if( strong ) {
+		return CActionPtr( new CAgreementAction( attribute, word2
+			- *max_element( wordPositions.cbegin(), wordPositions.cend() ) ) );
+	}
+	sort( wordPositions.begin(), wordPositions.end() );
+	return CActionPtr( new CAgreementAction( attribute, word2, wordPositions ) );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CTranspositionActions::CTranspositionActions( vector<CActions>&& _actions ) :
+	actions( move( _actions ) )
+{
+}
+
+bool CTranspositionActions::Run( const CMatchContext& context ) const
+{
+	const TTransposedWord word = context.TransposedWord( context.Shift() );
+	debug_check_logic( word < actions.size() );
+	return actions[word].Run( context );
+}
+
+void CTranspositionActions::Print( const CConfiguration& configuration,
+	ostream& out ) const
+{
+	for( const CActions& wordActions : actions ) {
+		wordActions.Print( configuration, out );
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 CDictionaryAction::CDictionaryAction( const TDictionary _dictionary,
 		const TVariantSize offset, const vector<TVariantSize>& words ) :
 	dictionary( _dictionary ),
@@ -431,40 +1393,111 @@ CDictionaryAction::CDictionaryAction( const TDictionary _dictionary,
 
 bool CDictionaryAction::Run( const CMatchContext& context ) const
 {
-	vector<string> words;
-	words.emplace_back();
+	const CDictionary& dict
+		= context.Text().Configuration().Dictionaries()[dictionary];
+	const CWordAttribute& wordAttribute
+		= context.Text().Configuration().Attributes()[dict.Attribute()];
+	const CDataEditor& editor = context.DataEditor();
+
+	size_t valuesCount = 0;
 	for( TVariantSize i = 0; i < offsets.Size(); i++ ) {
-		const TVariantSize offset = offsets[i];
-		if( offset == MaxVariantSize ) {
-			debug_check_logic( !words.back().empty() );
-			words.back().erase( prev( words.back().end() ) ); // words.back().pop_back();
-			words.emplace_back();
-		} else {
-			debug_check_logic( offset <= context.Shift() );
-			const TWordIndex word = context.Word() - offset;
-			words.back() += context.Text().Word( word ).text + " ";
+		if( offsets[i] != MaxVariantSize ) {
+			debug_check_logic( offsets[i] <= context.Shift() );
+			valuesCount += editor.Get( context.Shift() - offsets[i] ).Indices.Size();
 		}
 	}
-	debug_check_logic( !words.back().empty() );
-	words.back().erase( prev( words.back().end() ) ); // words.back().pop_back();
 
-#ifdef _DEBUG
-	cout << "dictionary{" << dictionary << "}(";
-	bool first = true;
-	for( const string& word : words ) {
-		if( first ) {
-			first = false;
-		} else {
-			cout << ",";
+	// distinct values of the attribute of the remaining annotations
+	CValues values( valuesCount );
+	CBegins begins( offsets.Size() + 1 );
+	size_t end = 0;
+	for( TVariantSize i = 0; i < offsets.Size(); i++ ) {
+		begins[i] = end;
+		if( offsets[i] == MaxVariantSize ) {
+			continue;
+		}
+		const TVariantSize slot = context.Shift() - offsets[i];
+		const CAnnotations& annotations
+			= context.Text().Word( context.SlotWord( slot ) ).Annotations();
+		for( const TAnnotationIndex index : editor.Get( slot ).Indices ) {
+			const TAttributeValue value
+				= annotations[index].Attributes().Get( dict.Attribute() );
+			if( value == NullAttributeValue ) {
+				continue;
+			}
+			size_t v = begins[i];
+			while( v < end && values[v].Value != value ) {
+				v++;
+			}
+			if( v == end ) {
+				CValue& newValue = values[end++];
+				newValue.Value = value;
+				dict.FindToken( wordAttribute, value, newValue.Token );
+				newValue.Found = false;
+			}
+		}
+	}
+	begins[offsets.Size()] = end;
+
+	if( !match( dict, values, begins, 0, CDictionary::RootNode ) ) {
+		return false;
+	}
+
+	// remove annotations which are not a part of any entry
+	for( TVariantSize i = 0; i < offsets.Size(); i++ ) {
+		if( offsets[i] == MaxVariantSize ) {
+			continue;
+		}
+		const TVariantSize slot = context.Shift() - offsets[i];
+		const CAnnotations& annotations
+			= context.Text().Word( context.SlotWord( slot ) ).Annotations();
+		// annotations are removed during iteration
+		const CAnnotationIndices indices = editor.Get( slot ).Indices;
+		for( const TAnnotationIndex index : indices ) {
+			const TAttributeValue value
+				= annotations[index].Attributes().Get( dict.Attribute() );
+			size_t v = begins[i];
+			while( v < begins[i + 1] && values[v].Value != value ) {
+				v++;
+			}
+			if( v == begins[i + 1] || !values[v].Found ) {
+				if( !CEdges::RemoveVertex( editor, slot, index ) ) {
+					return false;
+				}
+			}
 		}
-		cout << word;
 	}
-	cout << ");" << endl;
-#endif
 
 	return true;
 }
 
+bool CDictionaryAction::match( const CDictionary& dict, CValues& values,
+	const CBegins& begins, const TVariantSize position,
+	const CDictionary::TNode node ) const
+{
+	if( position == offsets.Size() ) {
+		return dict.IsFinal( node );
+	}
+
+	CDictionary::TNode next;
+	if( offsets[position] == MaxVariantSize ) {
+		return ( dict.Next( node, CDictionary::Separator, next )
+			&& match( dict, values, begins, position + 1, next ) );
+	}
+
+	bool matched = false;
+	for( size_t v = begins[position]; v < begins[position + 1]; v++ ) {
+		if( values[v].Token != CDictionary::Separator
+			&& dict.Next( node, values[v].Token, next )
+			&& match( dict, values, begins, position + 1, next ) )
+		{
+			values[v].Found = true;
+			matched = true;
+		}
+	}
+	return matched;
+}
+
 void CDictionaryAction::Print(
 	const Configuration::CConfiguration& /*configuration*/,
 	ostream& out ) const
@@ -490,22 +1523,99 @@ void CDictionaryAction::Print(
 ///////////////////////////////////////////////////////////////////////////////
 
 CSaveAction::CSaveAction( CVariantParts&& _parts ) :
-	parts( move( _parts ) )
+	parts( move( _parts ) ),
+	repeatedPart( parts.size() ),
+	repeatedSize( 0 ),
+	size( 0 ),
+	loopSize( 1 ),
+	minCount( 0 )
 {
 	check_logic( !parts.empty() );
 }
 
+CSaveAction::CSaveAction( CVariantParts&& _parts, const size_t _repeatedPart,
+		const size_t _repeatedSize, const TVariantSize _size,
+		const TVariantSize _loopSize, const TVariantSize _minCount ) :
+	parts( move( _parts ) ),
+	repeatedPart( _repeatedPart ),
+	repeatedSize( _repeatedSize ),
+	size( _size ),
+	loopSize( _loopSize ),
+	minCount( _minCount )
+{
+	check_logic( repeatedPart < parts.size() );
+	check_logic( repeatedSize > 0 && repeatedPart + repeatedSize <= parts.size() );
+	check_logic( size > 0 && loopSize > 0 );
+}
+
+CSaveAction::CSaveAction( CVariantParts&& _parts, const size_t _repeatedPart,
+		const size_t _repeatedSize,
+		vector<pair<size_t, size_t>>&& _transposedParts ) :
+	parts( move( _parts ) ),
+	repeatedPart( _repeatedPart ),
+	repeatedSize( _repeatedSize ),
+	size( 0 ),
+	loopSize( 1 ),
+	minCount( 0 ),
+	transposedParts( move( _transposedParts ) )
+{
+	check_logic( repeatedPart < parts.size() );
+	check_logic( repeatedSize > 0 && repeatedPart + repeatedSize <= parts.size() );
+	check_logic( !transposedParts.empty() );
+}
+
 bool CSaveAction::Run( const CMatchContext& context ) const
 {
-	IRecognitionCallback* const callback = context.RecognitionCallback();
-	if( callback != nullptr ) {
-		callback->OnRecognized( context.InitialWord(), context.Word(),
-			context.Text(), context.Data(), parts );
+	if( repeatedPart == parts.size() ) {
+		context.Save( parts );
+		return true;
+	}
+	if( !transposedParts.empty() ) {
+		saveTransposed( context );
+		return true;
 	}
 
+	// slots of the variant except the other words are its repetitions
+	debug_check_logic( context.Shift() + 1u >= size );
+	const size_t count = ( context.Shift() + 2u - size ) / loopSize;
+	if( count < minCount ) {
+		return true; // actions of a loop state are run after each repetition
+	}
+	const auto repetition = parts.cbegin() + repeatedPart;
+	CVariantParts repeatedParts;
+	repeatedParts.reserve( parts.size() + ( count - 1 ) * repeatedSize );
+	repeatedParts.insert( repeatedParts.end(), parts.cbegin(), repetition );
+	for( size_t i = 0; i < count; i++ ) {
+		repeatedParts.insert( repeatedParts.end(),
+			repetition, repetition + repeatedSize );
+	}
+	repeatedParts.insert( repeatedParts.end(),
+		repetition + repeatedSize, parts.cend() );
+	context.Save( repeatedParts );
 	return true;
 }
 
+void CSaveAction::saveTransposed( const CMatchContext& context ) const
+{
+	const auto transposition = parts.cbegin() + repeatedPart;
+	CVariantParts orderedParts;
+	orderedParts.reserve( parts.size() );
+	orderedParts.insert( orderedParts.end(),
+		parts.cbegin(), transposition );
+	for( TVariantSize slot = 0; slot <= context.Shift(); slot++ ) {
+		const TTransposedWord word = context.TransposedWord( slot );
+		if( word != NoTransposedWord && transposedParts[word].second > 0 ) {
+			const auto variant =
+				parts.cbegin() + transposedParts[word].first;
+			orderedParts.insert( orderedParts.end(),
+				variant, variant + transposedParts[word].second );
+		}
+	}
+	orderedParts.insert( orderedParts.end(),
+		transposition + repeatedSize, parts.cend() );
+	context.Save( orderedParts );
+}
+
 void CSaveAction::Print( const Configuration::CConfiguration& /*configuration*/,
 	ostream& out ) const
 {
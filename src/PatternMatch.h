@@ -79,19 +79,38 @@ struct CState;
 typedef vector<CState> CStates;
 typedef CStates::size_type TStateIndex;
 
+// Index of a word of a transposition in the group of its words
+typedef size_t TTransposedWord;
+const TTransposedWord NoTransposedWord = numeric_limits<TTransposedWord>::max();
+
 ///////////////////////////////////////////////////////////////////////////////
 
 class CBaseTransition {
 public:
-	explicit CBaseTransition( const TStateIndex nextState );
+	enum TType {
+		T_Word,
+		T_Attributes,
+		T_Span
+	};
+
+	CBaseTransition( const TType type, const TStateIndex nextState );
 	virtual ~CBaseTransition();
 
+	const TType Type() const { return type; }
 	const TStateIndex NextState() const { return nextState; }
-	virtual bool Match( const Text::CWord& word,
+	// span transitions are matched by CMatchContext using a chart
+	const bool IsSpan() const { return ( type == T_Span ); }
+	// the word of a transposition matched by the transition
+	const TTransposedWord TransposedWord() const { return transposedWord; }
+	void SetTransposedWord( const TTransposedWord word )
+		{ transposedWord = word; }
+	virtual bool Match( const Text::CText& text, const Text::CWord& word,
 		/* out */ Text::CAnnotationIndices& indices ) const = 0;
 
 private:
+	const TType type;
 	const TStateIndex nextState;
+	TTransposedWord transposedWord;
 };
 
 typedef unique_ptr<CBaseTransition> CTransitionPtr;
@@ -104,7 +123,7 @@ public:
 	CWordTransition( Text::RegexEx&& wordRegex, const TStateIndex nextState );
 	~CWordTransition() override {}
 
-	bool Match( const Text::CWord& word,
+	bool Match( const Text::CText& text, const Text::CWord& word,
 		/* out */ Text::CAnnotationIndices& indices ) const override;
 
 private:
@@ -113,17 +132,98 @@ private:
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Lazily filled results of a transition for annotation sets of a text.
+// Cells are atomic, so several threads may match the same text,
+// the cache is bound to another text when a word of the text is matched.
+// Pages of the previous texts are freed only when no thread uses them,
+// so several threads may match different texts too.
+class CAnnotationSetCache {
+	CAnnotationSetCache( const CAnnotationSetCache& ) = delete;
+	CAnnotationSetCache& operator=( const CAnnotationSetCache& ) = delete;
+
+public:
+	CAnnotationSetCache();
+	~CAnnotationSetCache();
+
+	// returns false if the result for the set is unknown
+	bool Find( const Text::CAnnotationSets& sets, const Text::TAnnotationSet set,
+		/* out */ Text::CAnnotationIndices& indices ) const;
+	void Add( const Text::CAnnotationSets& sets, const Text::TAnnotationSet set,
+		const Text::CAnnotationIndices& indices ) const;
+
+private:
+	// bit of a known result, other bits are indices of annotations
+	typedef uint64_t TCell;
+	static const TCell KnownCell = TCell( 1 ) << 63;
+	static const size_t PageSize = 512;
+	struct CPage {
+		atomic<TCell> Cells[PageSize];
+	};
+
+	// pages of the results for the annotation sets of a text
+	struct CBinding {
+		uint64_t Serial;
+		size_t PagesCount;
+		unique_ptr<atomic<CPage*>[]> Pages;
+
+		CBinding( const uint64_t serial, const size_t pagesCount );
+		~CBinding();
+	};
+	class CUse;
+
+	mutable mutex bindMutex;
+	mutable atomic<CBinding*> binding;
+	// number of running searches and additions
+	mutable atomic<size_t> users;
+	// replaced bindings which may be used by other threads
+	mutable vector<unique_ptr<CBinding>> retired;
+
+	CBinding* bind( const Text::CAnnotationSets& sets ) const;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Transitions are matched by the restriction with the cache of results,
+// CMatchContext with word classes matches them by the classes instead.
 class CAttributesTransition : public CBaseTransition {
 public:
+	// index is the number of attribute transitions of the automaton
+	// built before the transition
 	CAttributesTransition( Text::CAttributesRestriction&& attributesRestriction,
-		const TStateIndex nextState );
+		const size_t index, const TStateIndex nextState );
 	~CAttributesTransition() override {}
 
-	bool Match( const Text::CWord& word,
+	const Text::CAttributesRestriction& Restriction() const
+		{ return attributesRestriction; }
+	size_t Index() const { return index; }
+
+	bool Match( const Text::CText& text, const Text::CWord& word,
 		/* out */ Text::CAnnotationIndices& indices ) const override;
 
 private:
 	const Text::CAttributesRestriction attributesRestriction;
+	const size_t index;
+	CAnnotationSetCache cache;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Index of an automaton of a referenced pattern in chart mode
+typedef size_t TSpan;
+const TSpan NoSpan = numeric_limits<TSpan>::max();
+
+// Transition over recognitions of a referenced pattern from the current word
+class CSpanTransition : public CBaseTransition {
+public:
+	CSpanTransition( const TSpan span, const TStateIndex nextState );
+	~CSpanTransition() override {}
+
+	TSpan Span() const { return span; }
+	bool Match( const Text::CText& text, const Text::CWord& word,
+		/* out */ Text::CAnnotationIndices& indices ) const override;
+
+private:
+	const TSpan span;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -145,8 +245,26 @@ typedef shared_ptr<IAction> CActionPtr;
 class CActions {
 public:
 	CActions() = default;
+	bool IsEmpty() const { return actions.empty(); }
 	void Add( const CActionPtr action );
 	bool Run( const CMatchContext& context ) const;
+	// has actions which can reject the recognition (agreements, dictionaries)
+	bool HasConditions() const;
+	// has actions which save recognitions
+	bool HasSave() const;
+	// has agreements with repetitions of a word matched by a loop state
+	bool DependsOnLoop() const;
+	// actions of the word distance words after the first repetition
+	// of the repeated word, when the repetitions are unrolled
+	CActions Unrolled( const TVariantSize distance ) const;
+	// has agreements with words of a transposition matched by the states
+	// of its elements
+	bool DependsOnTransposition() const;
+	// actions of the word position words after the first word of the
+	// transposition, when its order is fixed, positions are the positions of
+	// its words in the order or MaxVariantSize for words left out
+	CActions Transposed( const TVariantSize position,
+		const vector<TVariantSize>& positions ) const;
 	void Print( const Configuration::CConfiguration& configuration,
 		ostream& out ) const;
 
@@ -156,13 +274,47 @@ private:
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// The state of a repeated word or group of LoopSize words is reached after
+// each repetition, its first transition begins a repetition: it leads to
+// the state itself for a word and to states of the next words of a group
+// for a group, the last of them leads back to the state. Repetitions begin
+// at slot LoopSlot, actions are run after each repetition, other transitions
+// are used after LoopMinCount repetitions.
 struct CState {
 	CActions Actions;
 	CTransitions Transitions;
+	TVariantSize LoopSlot = 0;
+	TVariantSize LoopSize = 1;
+	TVariantSize LoopMinCount = 1;
+	TVariantSize LoopMaxCount = 1;
+
+	bool IsLoop() const { return ( LoopMaxCount > 1 ); }
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Recognitions of a pattern passed to the recognition callback
+enum TMatchPolicy {
+	MP_All, // all recognitions
+	MP_Longest, // the longest recognitions from each word
+	// the longest recognitions from the leftmost words,
+	// words of a passed recognition do not begin recognitions
+	MP_LeftmostLongest,
+	// the shortest recognitions from the leftmost words,
+	// words of a passed recognition do not begin recognitions
+	MP_NonOverlapping
+};
+
+// names are all, longest, leftmost-longest and non-overlapping
+bool ParseMatchPolicy( const string& name, TMatchPolicy& policy );
+
+///////////////////////////////////////////////////////////////////////////////
+
+class CMatchStatistics;
+class CChart;
+struct CSpanRecognition;
+class CWordClasses;
+
 class CMatchContext {
 	CMatchContext( const CMatchContext& ) = delete;
 	CMatchContext& operator=( const CMatchContext& ) = delete;
@@ -171,14 +323,48 @@ public:
 	CMatchContext( const Text::CText& text, const CStates& states );
 
 	const Text::CText& Text() const { return text; }
+	const CStates& States() const { return states; }
 	const CData& Data() const { return data; }
 	const CDataEditor& DataEditor() const;
 	const Text::TWordIndex InitialWord() const { return initialWordIndex; }
+	// the last word of the current slot
 	const Text::TWordIndex Word() const;
+	// the word of the slot, for span slots it is the head word of the span
+	const Text::TWordIndex SlotWord( const TVariantSize slot ) const;
 	const TVariantSize Shift() const;
+	// the first slot of repetitions of the last loop state of the path
+	const TVariantSize LoopSlot() const { return loopSlot; }
+	// the word of a transposition matched in the slot or NoTransposedWord
+	const TTransposedWord TransposedWord( const TVariantSize slot ) const;
+	// initial words must increase with policies other than MP_All
 	void Match( const Text::TWordIndex initialWordIndex );
+	// passes the recognition to the recognition callback,
+	// spans are replaced with their words and parts
+	void Save( const CVariantParts& parts ) const;
+	TMatchPolicy Policy() const { return policy; }
+	void SetPolicy( const TMatchPolicy policy );
+	// matching is finished after limit recognitions are passed
+	// to the recognition callback, 0 if recognitions are not limited
+	size_t Limit() const { return limit; }
+	void SetLimit( const size_t limit );
+	size_t PassedRecognitions() const { return passedRecognitions; }
+	bool IsFinished() const
+		{ return ( limit > 0 && passedRecognitions >= limit ); }
+	// number of first words where recognitions begin which are enough
+	// to finish matching from the start, 0 if all the words are needed
+	size_t SufficientBegins() const;
 	IRecognitionCallback* RecognitionCallback() const;
 	void SetRecognitionCallback( IRecognitionCallback* recognitionCallback );
+	// chart is required to match span transitions
+	CChart* Chart() const { return chart; }
+	void SetChart( CChart* chart );
+	// statistics are collected only if they are set
+	CMatchStatistics* Statistics() const { return statistics; }
+	void SetStatistics( CMatchStatistics* statistics );
+	// attribute transitions are matched by the classes if they are set,
+	// the classes must be built for the text with the states registered
+	const CWordClasses* WordClasses() const { return wordClasses; }
+	void SetWordClasses( const CWordClasses* wordClasses );
 
 private:
 	const Text::CText& text;
@@ -186,9 +372,62 @@ private:
 	Text::TWordIndex initialWordIndex;
 	CData data;
 	stack<CDataEditor> editors;
+	// words of slots of data, each slot is a word or a span of words
+	struct CSlot {
+		Text::TWordIndex Word;
+		Text::TWordIndex End;
+		const CSpanRecognition* Span;
+		TTransposedWord TransposedWord;
+	};
+	vector<CSlot> slots;
+	size_t spanSlots;
+	// a path has at most one loop state, so the slot is not restored
+	TVariantSize loopSlot;
 	IRecognitionCallback* recognitionCallback;
-
+	CMatchStatistics* statistics;
+	CChart* chart;
+	const CWordClasses* wordClasses;
+	// restrictions of the classes indexed by attribute transitions
+	const vector<size_t>* classRestrictions;
+
+	TMatchPolicy policy;
+	// words before it do not begin recognitions
+	Text::TWordIndex firstWord;
+	// maximum numbers of words from states to final states
+	vector<size_t> maxWords;
+	// recognitions from the initial word passed after its matching,
+	// only recognitions with the best end are kept
+	struct CRecognition {
+		CData Data;
+		CVariantParts Parts;
+	};
+	mutable vector<CRecognition> recognitions;
+	mutable bool recognized;
+	mutable Text::TWordIndex bestEnd;
+	size_t limit;
+	mutable size_t passedRecognitions;
+
+	Text::TWordIndex nextWord() const;
+	void buildMaxWords();
+	size_t transitionWords( const CBaseTransition& transition ) const;
+	// paths of the transition cannot end at the best end
+	bool isPruned( const CBaseTransition& transition ) const;
+	void addRecognition( const Text::TWordIndex end,
+		const CData& recognitionData, const CVariantParts& parts ) const;
+	void passRecognitions();
+	void passRecognition( const Text::TWordIndex end,
+		const CData& recognitionData, const CVariantParts& parts ) const;
 	void match( const TStateIndex stateIndex );
+	// every transition from a state starts from the same data
+	void restoreData();
+	bool runActions( const TStateIndex stateIndex );
+	// repetition is set for the first transition of a loop state
+	bool matchTransition( const CBaseTransition& transition,
+		const bool repetition );
+	bool testTransition( const CBaseTransition& transition,
+		const Text::CWord& word );
+	void matchSpan( const CSpanTransition& transition, const bool repetition );
+	void saveSpans( const CVariantParts& parts ) const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -205,17 +444,115 @@ public:
 	void Print( const Configuration::CConfiguration& configuration,
 		ostream& out ) const override;
 
+	static bool Agree( const CMatchContext& context,
+		const Text::TAttribute attribute, const bool strong,
+		const TVariantSize word1, const TVariantSize word2 );
+
+private:
+	const bool strong;
+	const Text::TAttribute attribute;
+	CFixedSizeArray<TVariantSize, TVariantSize, 8> offsets;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Agreement of a word with words before it in a variant with a repeated word
+// matched by a loop state. Number of repetitions is known only when matching,
+// so words are found relative to the slot of the loop and the current slot.
+// Strong agreement is with the last of the words, weak one is with all.
+class CLoopAgreementAction : public IAction {
+public:
+	enum TWordsType {
+		WT_Current, // the word Distance slots before the current one
+		WT_BeforeLoop, // the word Distance slots before the loop slot
+		// repetitions from the loop slot to Distance slots before the current
+		WT_Loop
+	};
+	struct CWords {
+		TWordsType Type;
+		TVariantSize Distance;
+	};
+
+	CLoopAgreementAction( const Text::TAttribute attribute, const bool strong,
+		const vector<CWords>& words );
+
+	~CLoopAgreementAction() override {}
+	bool Run( const CMatchContext& context ) const override;
+	void Print( const Configuration::CConfiguration& configuration,
+		ostream& out ) const override;
+	// agreement of the word distance words after the first repetition
+	// of the unrolled repeated word, nullptr if the word has no words before
+	CActionPtr Unrolled( const TVariantSize distance ) const;
+
+private:
+	const bool strong;
+	const Text::TAttribute attribute;
+	CFixedSizeArray<CWords, TVariantSize, 4> words;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Agreement of a word after the first word of a transposition matched by
+// the states of its elements. Order of the elements is known only when
+// matching, so words of the transposition are found by the words matched in
+// slots, other words are found relative to the first slot of the transposition
+// and the current slot. Strong agreement is with the last of the words,
+// weak one is with all.
+class CTranspositionAgreementAction : public IAction {
+public:
+	enum TWordsType {
+		WT_Current, // the word Word slots before the current one
+		// the word Word slots before the first slot of the transposition
+		WT_BeforeTransposition,
+		WT_Transposed // the slot before the current one matched by word Word
+	};
+	struct CWords {
+		TWordsType Type;
+		TTransposedWord Word;
+	};
+
+	CTranspositionAgreementAction( const Text::TAttribute attribute,
+		const bool strong, const vector<CWords>& words );
+
+	~CTranspositionAgreementAction() override {}
+	bool Run( const CMatchContext& context ) const override;
+	void Print( const Configuration::CConfiguration& configuration,
+		ostream& out ) const override;
+	// agreement of the word position words after the first word of the
+	// transposition in a fixed order, positions are the positions of its
+	// words in the order or MaxVariantSize, nullptr if the word has no words
+	// before
+	CActionPtr Transposed( const TVariantSize position,
+		const vector<TVariantSize>& positions ) const;
+
 private:
 	const bool strong;
 	const Text::TAttribute attribute;
-	CFixedSizeArray<TVariantSize, TVariantSize> offsets;
+	CFixedSizeArray<CWords, TVariantSize, 4> words;
 
-	bool agree( const CMatchContext& context,
+	bool isAgreed( const CMatchContext& context, const TVariantSize first,
 		const TVariantSize word1, const TVariantSize word2 ) const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Actions of the last words of variants of elements of a transposition,
+// they are run by the states of elements for the word matched in the last slot
+class CTranspositionActions : public IAction {
+public:
+	explicit CTranspositionActions( vector<CActions>&& actions );
+
+	~CTranspositionActions() override {}
+	bool Run( const CMatchContext& context ) const override;
+	void Print( const Configuration::CConfiguration& configuration,
+		ostream& out ) const override;
+
+private:
+	const vector<CActions> actions;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
 class CDictionaryAction : public IAction {
 public:
 	CDictionaryAction( const Configuration::TDictionary dictionary,
@@ -228,7 +565,23 @@ public:
 
 private:
 	const Configuration::TDictionary dictionary;
-	CFixedSizeArray<TVariantSize, TVariantSize> offsets;
+	// MaxVariantSize separates arguments of the dictionary
+	CFixedSizeArray<TVariantSize, TVariantSize, 8> offsets;
+
+	// distinct values of the attribute of the annotations of a word
+	struct CValue {
+		Text::TAttributeValue Value;
+		// Separator if the dictionary has no such word
+		Configuration::CDictionary::TToken Token;
+		bool Found; // the value is a part of an entry
+	};
+	typedef CFixedSizeArray<CValue, size_t, 32> CValues;
+	// values of offsets[i] are values[begins[i]] .. values[begins[i + 1] - 1]
+	typedef CFixedSizeArray<size_t, TVariantSize, 9> CBegins;
+	// marks values of all paths from the node to final nodes
+	bool match( const Configuration::CDictionary& dict, CValues& values,
+		const CBegins& begins, const TVariantSize position,
+		const Configuration::CDictionary::TNode node ) const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -236,6 +589,19 @@ private:
 class CSaveAction : public IAction {
 public:
 	explicit CSaveAction( CVariantParts&& parts );
+	// repeatedSize parts from the part of the repeated word or group of
+	// loopSize words are saved for each repetition, size is the number of
+	// words of the variant with the group counted once,
+	// at least minCount repetitions are saved
+	CSaveAction( CVariantParts&& parts, const size_t repeatedPart,
+		const size_t repeatedSize, const TVariantSize size,
+		const TVariantSize loopSize, const TVariantSize minCount );
+	// repeatedSize parts from the part of the transposition are saved in the
+	// order of its matched words, transposedParts are the first part and
+	// the number of parts of the variant of an element by its first word
+	CSaveAction( CVariantParts&& parts, const size_t repeatedPart,
+		const size_t repeatedSize,
+		vector<pair<size_t, size_t>>&& transposedParts );
 	~CSaveAction() override {}
 	bool Run( const CMatchContext& context ) const override;
 	void Print( const Configuration::CConfiguration& configuration,
@@ -243,6 +609,14 @@ public:
 
 private:
 	const CVariantParts parts;
+	const size_t repeatedPart;
+	const size_t repeatedSize;
+	const TVariantSize size;
+	const TVariantSize loopSize;
+	const TVariantSize minCount;
+	const vector<pair<size_t, size_t>> transposedParts;
+
+	void saveTransposed( const CMatchContext& context ) const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,277 @@
+#include <common.h>
+#include <PatternScanner.h>
+#include <MatchStatistics.h>
+
+using namespace Lspl::Text;
+
+namespace Lspl {
+namespace Pattern {
+
+///////////////////////////////////////////////////////////////////////////////
+
+const CPatternScanner::TSymbol CPatternScanner::NoSymbol;
+const size_t CPatternScanner::DefaultMaxDfaStates;
+
+bool CPatternScanner::CanScan( const CStates& states )
+{
+	// automaton must be a tree, so each state has a fixed depth,
+	// parents must precede children to compute depths in one pass
+	vector<bool> reached( states.size(), false );
+	for( TStateIndex s = 0; s < states.size(); s++ ) {
+		const CState& state = states[s];
+		if( state.Actions.HasConditions() || ( s == 0 && state.Actions.HasSave() ) ) {
+			return false;
+		}
+		for( const CTransitionPtr& transition : state.Transitions ) {
+			if( transition->IsSpan() || transition->NextState() <= s
+				|| reached[transition->NextState()] )
+			{
+				return false;
+			}
+			reached[transition->NextState()] = true;
+		}
+	}
+	return true;
+}
+
+CPatternScanner::CPatternScanner( const CText& _text, const CStates& _states,
+		const size_t _maxDfaStates ) :
+	text( _text ),
+	states( _states ),
+	maxDfaStates( _maxDfaStates ),
+	depths( states.size(), 0 ),
+	hasWordTransitions( false ),
+	wordClasses( nullptr ),
+	classRestrictions( nullptr ),
+	statistics( nullptr )
+{
+	debug_check_logic( CanScan( states ) );
+
+	for( TStateIndex s = 0; s < states.size(); s++ ) {
+		for( const CTransitionPtr& transition : states[s].Transitions ) {
+			depths[transition->NextState()] = depths[s] + 1;
+			if( transition->Type() == CBaseTransition::T_Word ) {
+				hasWordTransitions = true;
+			}
+		}
+	}
+}
+
+void CPatternScanner::SetWordClasses( const CWordClasses* _wordClasses )
+{
+	wordClasses = _wordClasses;
+	classRestrictions = nullptr;
+	if( wordClasses != nullptr ) {
+		check_logic( wordClasses->Serial() == text.AnnotationSets().Serial() );
+		classRestrictions = wordClasses->TransitionRestrictions( states );
+		check_logic( classRestrictions != nullptr );
+	}
+	// symbols are different with and without the classes
+	classSymbols.clear();
+	setSymbols.clear();
+	clear();
+}
+
+void CPatternScanner::SetStatistics( CMatchStatistics* _statistics )
+{
+	debug_check_logic( _statistics == nullptr
+		|| _statistics->States().size() == states.size() );
+	statistics = _statistics;
+}
+
+void CPatternScanner::Scan( vector<TWordIndex>& begins, const size_t maxBegins )
+{
+	begins.clear();
+	vector<bool> isBegin( text.Length(), false );
+	// recognitions ending after the current word begin after
+	// the current word minus maxDepth, so earlier begins are known
+	const TWordIndex maxDepth = *max_element( depths.cbegin(), depths.cend() );
+	TWordIndex known = 0;
+	const auto addBegins = [&]( const TWordIndex end ) -> bool
+	{
+		for( ; known < end; known++ ) {
+			if( isBegin[known] ) {
+				begins.push_back( known );
+				if( begins.size() == maxBegins ) {
+					return false;
+				}
+			}
+		}
+		return true;
+	};
+
+	clear();
+	TDfaState dfaState = addDfaState( vector<TStateIndex>() );
+	for( TWordIndex wi = 0; wi < text.Length(); wi++ ) {
+		if( dfaStates.size() > maxDfaStates ) {
+			// automaton states active before the word are kept
+			vector<TStateIndex> activeStates = dfaStates[dfaState].States;
+			clear();
+			dfaState = addDfaState( move( activeStates ) );
+		}
+		dfaState = step( dfaState, text.Word( wi ) );
+		for( const TVariantSize depth : dfaStates[dfaState].FinalDepths ) {
+			isBegin[wi + 1 - depth] = true;
+		}
+		if( maxBegins > 0 && maxDepth > 0 && wi + 1 >= maxDepth
+			&& !addBegins( wi + 2 - maxDepth ) )
+		{
+			return;
+		}
+	}
+	addBegins( text.Length() );
+}
+
+CPatternScanner::TSymbol CPatternScanner::symbol( const CWord& word )
+{
+	if( hasWordTransitions ) {
+		return NoSymbol;
+	}
+	const TAnnotationSet set = word.AnnotationSet();
+	if( wordClasses == nullptr ) {
+		return set;
+	}
+
+	if( setSymbols.empty() ) {
+		setSymbols.resize( text.AnnotationSets().Size(), NoSymbol );
+	}
+	if( setSymbols[set] == NoSymbol ) {
+		const TWordClass* annotationClasses = wordClasses->AnnotationClasses( set );
+		vector<TWordClass> classes( annotationClasses,
+			annotationClasses + word.Annotations().size() );
+		sort( classes.begin(), classes.end() );
+		classes.erase( unique( classes.begin(), classes.end() ), classes.end() );
+		const TSymbol newSymbol = Cast<TSymbol>( classSymbols.size() );
+		setSymbols[set] = classSymbols.insert(
+			make_pair( move( classes ), newSymbol ) ).first->second;
+	}
+	return setSymbols[set];
+}
+
+CPatternScanner::TDfaState CPatternScanner::step( const TDfaState dfaState,
+	const CWord& word )
+{
+	const TSymbol wordSymbol = symbol( word );
+	const uint64_t key = ( static_cast<uint64_t>( dfaState ) << 32 ) | wordSymbol;
+	if( wordSymbol != NoSymbol ) {
+		auto i = steps.find( key );
+		if( i != steps.end() ) {
+			return i->second;
+		}
+	}
+
+	// the initial state is active at every word
+	vector<TStateIndex> nextStates;
+	addNextStates( 0, word, nextStates );
+	for( const TStateIndex state : dfaStates[dfaState].States ) {
+		addNextStates( state, word, nextStates );
+	}
+	sort( nextStates.begin(), nextStates.end() );
+
+	const TDfaState next = addDfaState( move( nextStates ) );
+	if( wordSymbol != NoSymbol ) {
+		steps.insert( make_pair( key, next ) );
+	}
+	return next;
+}
+
+void CPatternScanner::addNextStates( const TStateIndex state,
+	const CWord& word, vector<TStateIndex>& nextStates )
+{
+	for( const CTransitionPtr& transition : states[state].Transitions ) {
+		if( matchTransition( *transition, word ) ) {
+			nextStates.push_back( transition->NextState() );
+		}
+	}
+}
+
+bool CPatternScanner::matchTransition( const CBaseTransition& transition,
+	const CWord& word )
+{
+	CAnnotationIndices indices;
+	const bool success = ( wordClasses != nullptr )
+		? wordClasses->MatchTransition( *classRestrictions, transition,
+			text, word, indices )
+		: transition.Match( text, word, indices );
+	if( statistics != nullptr ) {
+		// the time of tests is a part of the time of the scan
+		CStateStatistics& stateStatistics
+			= statistics->State( transition.NextState() );
+		stateStatistics.Tests++;
+		if( success ) {
+			stateStatistics.Matches++;
+		}
+	}
+	return success;
+}
+
+CPatternScanner::TDfaState CPatternScanner::addDfaState(
+	vector<TStateIndex>&& nextStates )
+{
+	auto pair = dfaStateIndices.insert(
+		make_pair( nextStates, Cast<TDfaState>( dfaStates.size() ) ) );
+	if( pair.second ) {
+		dfaStates.emplace_back();
+		CDfaState& dfaState = dfaStates.back();
+		for( const TStateIndex state : nextStates ) {
+			if( states[state].Actions.HasSave() ) {
+				dfaState.FinalDepths.push_back( depths[state] );
+			}
+		}
+		// leaves are not needed to continue
+		for( const TStateIndex state : nextStates ) {
+			if( !states[state].Transitions.empty() ) {
+				dfaState.States.push_back( state );
+			}
+		}
+	}
+	return pair.first->second;
+}
+
+void CPatternScanner::clear()
+{
+	dfaStates.clear();
+	dfaStateIndices.clear();
+	steps.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MatchText( CMatchContext& context )
+{
+	const CText& text = context.Text();
+	if( !CPatternScanner::CanScan( context.States() ) ) {
+		for( TWordIndex wi = 0; wi < text.Length()
+			&& !context.IsFinished(); wi++ )
+		{
+			context.Match( wi );
+		}
+		return false;
+	}
+
+	// recognitions are built only from words where they begin
+	CMatchStatistics* statistics = context.Statistics();
+	const CMatchStatistics::CClock::time_point start
+		= ( statistics == nullptr ) ? CMatchStatistics::CClock::time_point()
+			: CMatchStatistics::CClock::now();
+	CPatternScanner scanner( text, context.States() );
+	scanner.SetWordClasses( context.WordClasses() );
+	scanner.SetStatistics( statistics );
+	vector<TWordIndex> begins;
+	scanner.Scan( begins, context.SufficientBegins() );
+	if( statistics != nullptr ) {
+		statistics->AddScanNanoseconds( CMatchStatistics::Nanoseconds( start ) );
+	}
+	for( const TWordIndex wi : begins ) {
+		if( context.IsFinished() ) {
+			break;
+		}
+		context.Match( wi );
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Pattern namespace
+} // end of Lspl namespace
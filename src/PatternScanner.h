@@ -0,0 +1,92 @@
+#pragma once
+
+#include <PatternMatch.h>
+#include <WordClasses.h>
+
+namespace Lspl {
+namespace Pattern {
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Single left to right pass over the text for automata without conditions
+// and spans. Such an automaton started at every word is simulated by
+// a lazily built DFA: a DFA state is the set of automaton states reached
+// from the preceding words. A step of the DFA tests only the transitions
+// from these states and from the initial state. Steps are cached by
+// symbols of words: the set of word classes of the annotations of a word,
+// or its annotation set without word classes. Steps depend on word forms
+// if the automaton has word transitions, so then they are not cached.
+// The scan finds words where recognitions begin, CMatchContext builds
+// the recognitions only from these words.
+class CPatternScanner {
+	CPatternScanner( const CPatternScanner& ) = delete;
+	CPatternScanner& operator=( const CPatternScanner& ) = delete;
+
+public:
+	// returns false if the automaton has conditions or span transitions
+	static bool CanScan( const CStates& states );
+
+	static const size_t DefaultMaxDfaStates = 10000;
+	// DFA is rebuilt from scratch if it grows larger than maxDfaStates
+	CPatternScanner( const Text::CText& text, const CStates& states,
+		const size_t maxDfaStates = DefaultMaxDfaStates );
+
+	// words where at least one recognition begins, in increasing order,
+	// the scan stops after maxBegins first words are found (0 for all words)
+	void Scan( vector<Text::TWordIndex>& begins, const size_t maxBegins = 0 );
+	// number of DFA states built by scans
+	size_t Size() const { return dfaStates.size(); }
+	// attribute transitions are matched by the classes if they are set,
+	// the classes must be built for the text with the states registered
+	void SetWordClasses( const CWordClasses* wordClasses );
+	// tests of transitions are counted if the statistics are set
+	void SetStatistics( CMatchStatistics* statistics );
+
+private:
+	typedef uint32_t TDfaState;
+	typedef uint32_t TSymbol;
+	static const TSymbol NoSymbol = numeric_limits<TSymbol>::max();
+
+	struct CDfaState {
+		vector<TStateIndex> States; // sorted, the initial state is implied
+		vector<TVariantSize> FinalDepths; // words of recognitions ending here
+	};
+
+	const Text::CText& text;
+	const CStates& states;
+	const size_t maxDfaStates;
+	vector<TVariantSize> depths; // number of words from the initial state
+	// transitions depend on word forms, so steps are not cached
+	bool hasWordTransitions;
+	const CWordClasses* wordClasses;
+	// restrictions of the classes indexed by attribute transitions
+	const vector<size_t>* classRestrictions;
+	CMatchStatistics* statistics;
+	map<vector<TWordClass>, TSymbol> classSymbols;
+	vector<TSymbol> setSymbols; // indexed by annotation sets
+	deque<CDfaState> dfaStates;
+	map<vector<TStateIndex>, TDfaState> dfaStateIndices;
+	// next DFA states by DFA states and symbols, built lazily
+	unordered_map<uint64_t, TDfaState> steps;
+
+	TSymbol symbol( const Text::CWord& word );
+	TDfaState step( const TDfaState dfaState, const Text::CWord& word );
+	void addNextStates( const TStateIndex state, const Text::CWord& word,
+		vector<TStateIndex>& nextStates );
+	bool matchTransition( const CBaseTransition& transition,
+		const Text::CWord& word );
+	TDfaState addDfaState( vector<TStateIndex>&& nextStates );
+	void clear();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Matches the automaton of the context from each word of the text
+// until matching is finished. If the automaton can be scanned, only words
+// where recognitions begin are matched. Returns true if it was scanned.
+bool MatchText( CMatchContext& context );
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Pattern namespace
+} // end of Lspl namespace
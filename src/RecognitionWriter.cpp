@@ -0,0 +1,506 @@
+#include <common.h>
+#include <RecognitionWriter.h>
+
+#define RAPIDJSON_ASSERT debug_check_logic
+#include <rapidjson/rapidjson.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+
+using namespace Lspl::Text;
+
+namespace Lspl {
+namespace Pattern {
+
+///////////////////////////////////////////////////////////////////////////////
+
+CBufferedFileWriter::CBufferedFileWriter( const string& filename ) :
+	file( filename, ios::out | ios::binary | ios::trunc ),
+	closed( false ),
+	failed( false )
+{
+	if( IsOpen() ) {
+		buffer.reserve( BufferSize );
+		writerThread = thread( &CBufferedFileWriter::writeQueue, this );
+	}
+}
+
+CBufferedFileWriter::~CBufferedFileWriter()
+{
+	Close();
+}
+
+void CBufferedFileWriter::Write( const char* data, const size_t size )
+{
+	debug_check_logic( IsOpen() && !closed );
+	buffer.append( data, size );
+	if( buffer.size() >= BufferSize ) {
+		flush();
+	}
+}
+
+void CBufferedFileWriter::Put( const char c )
+{
+	debug_check_logic( IsOpen() && !closed );
+	buffer.push_back( c );
+	if( buffer.size() >= BufferSize ) {
+		flush();
+	}
+}
+
+bool CBufferedFileWriter::Close()
+{
+	if( !writerThread.joinable() ) {
+		return !failed;
+	}
+
+	flush();
+	{
+		lock_guard<mutex> lock( queueMutex );
+		closed = true;
+	}
+	queueCondition.notify_all();
+	writerThread.join();
+
+	file.close();
+	return !failed;
+}
+
+void CBufferedFileWriter::flush()
+{
+	if( buffer.empty() ) {
+		return;
+	}
+
+	string data;
+	data.reserve( BufferSize );
+	swap( data, buffer );
+	{
+		unique_lock<mutex> lock( queueMutex );
+		queueCondition.wait( lock, [this] { return queue.size() < MaxQueueSize; } );
+		queue.emplace_back( move( data ) );
+	}
+	queueCondition.notify_all();
+}
+
+void CBufferedFileWriter::writeQueue()
+{
+	unique_lock<mutex> lock( queueMutex );
+	while( true ) {
+		queueCondition.wait( lock, [this] { return closed || !queue.empty(); } );
+		if( queue.empty() ) {
+			break; // closed
+		}
+
+		string data = move( queue.front() );
+		queue.pop_front();
+		lock.unlock();
+		queueCondition.notify_all();
+
+		if( !file.write( data.data(), data.size() ) ) {
+			failed = true;
+		}
+
+		lock.lock();
+	}
+	file.flush();
+	if( !file ) {
+		failed = true;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+class CTextRecognitionWriter : public CRecognitionWriter {
+public:
+	explicit CTextRecognitionWriter( const CPatterns& patterns );
+	~CTextRecognitionWriter() override {}
+
+	void OnRecognized( const TWordIndex begin, const TWordIndex end,
+		const CText& text, const CData& data,
+		const CVariantParts& parts ) override;
+	void Start( const CPattern& pattern ) override;
+	bool Finish() override;
+
+private:
+	bool started;
+};
+
+CTextRecognitionWriter::CTextRecognitionWriter( const CPatterns& patterns ) :
+	CRecognitionWriter( patterns, RF_Text ),
+	started( false )
+{
+}
+
+void CTextRecognitionWriter::OnRecognized(
+	const TWordIndex begin, const TWordIndex end,
+	const CText& text, const CData& /*data*/,
+	const CVariantParts& parts )
+{
+	TWordIndex wi = begin;
+	for( const CBaseVariantPart* const vp : parts ) {
+		if( vp == nullptr ) {
+			cout << "} ";
+		} else {
+			switch( vp->Type() ) {
+				case VPR_Word:
+					cout << patterns.Element( vp->Word() ) << ":"
+						<< text.Word( wi ).text << " ";
+					wi++;
+					break;
+				case VPR_Regexp:
+					cout << vp->Regexp() << ":"
+						<< text.Word( wi ).text << " ";
+					wi++;
+					break;
+				case VPR_Instance:
+					cout << patterns.Reference( vp->Instance() ) << "{ ";
+					break;
+				case VPR_Span: // spans are replaced in CMatchContext::Save
+					check_logic( false );
+					break;
+			}
+		}
+	}
+	check_logic( ( end + 1 ) == wi );
+	cout << endl;
+}
+
+void CTextRecognitionWriter::Start( const CPattern& pattern )
+{
+	if( started ) {
+		cout << endl;
+	}
+	started = true;
+	cout << pattern.Name() << endl;
+}
+
+bool CTextRecognitionWriter::Finish()
+{
+	if( started ) {
+		cout << endl;
+	}
+	cout.flush();
+	return static_cast<bool>( cout );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// {"pattern":"AdjNoun","begin":3,"end":4,
+//  "words":[{"index":3,"text":"...","element":"A1","annotations":[1]},...],
+//  "instances":[{"instance":"AdjNoun0","begin":3,"end":4}]}
+class CJsonLinesRecognitionWriter : public CRecognitionWriter {
+public:
+	CJsonLinesRecognitionWriter( const CPatterns& patterns,
+		const string& filename );
+	~CJsonLinesRecognitionWriter() override {}
+
+	bool IsOpen() const { return file.IsOpen(); }
+
+	void OnRecognized( const TWordIndex begin, const TWordIndex end,
+		const CText& text, const CData& data,
+		const CVariantParts& parts ) override;
+	bool Finish() override;
+
+private:
+	CBufferedFileWriter file;
+	rapidjson::StringBuffer buffer;
+	vector<CRecognitionWord> words;
+	vector<CRecognitionInstance> instances;
+};
+
+CJsonLinesRecognitionWriter::CJsonLinesRecognitionWriter(
+		const CPatterns& patterns, const string& filename ) :
+	CRecognitionWriter( patterns, RF_JsonLines ),
+	file( filename )
+{
+}
+
+void CJsonLinesRecognitionWriter::OnRecognized(
+	const TWordIndex begin, const TWordIndex end,
+	const CText& text, const CData& data,
+	const CVariantParts& parts )
+{
+	using rapidjson::SizeType;
+
+	Collect( begin, end, parts, words, instances );
+	check_logic( data.size() == words.size() );
+
+	buffer.Clear();
+	rapidjson::Writer<rapidjson::StringBuffer> writer( buffer );
+	writer.StartObject();
+	writer.Key( "pattern" );
+	const string& name = patterns.Pattern( parts.front()->Instance() ).Name();
+	writer.String( name.data(), static_cast<SizeType>( name.length() ) );
+	writer.Key( "begin" );
+	writer.Uint64( begin );
+	writer.Key( "end" );
+	writer.Uint64( end );
+
+	writer.Key( "words" );
+	writer.StartArray();
+	for( CData::size_type i = 0; i < words.size(); i++ ) {
+		const CRecognitionWord& word = words[i];
+		writer.StartObject();
+		writer.Key( "index" );
+		writer.Uint64( word.Index );
+		writer.Key( "text" );
+		const string& wordText = text.Word( word.Index ).text;
+		writer.String( wordText.data(),
+			static_cast<SizeType>( wordText.length() ) );
+		if( word.Part->Type() == VPR_Word ) {
+			writer.Key( "element" );
+			const string element = patterns.Element( word.Part->Word() );
+			writer.String( element.data(),
+				static_cast<SizeType>( element.length() ) );
+		} else {
+			writer.Key( "regexp" );
+			const string regexp = word.Part->Regexp();
+			writer.String( regexp.data(),
+				static_cast<SizeType>( regexp.length() ) );
+		}
+		writer.Key( "annotations" );
+		writer.StartArray();
+		for( const TAnnotationIndex index : data[i].Indices ) {
+			writer.Uint( index );
+		}
+		writer.EndArray();
+		writer.EndObject();
+	}
+	writer.EndArray();
+
+	writer.Key( "instances" );
+	writer.StartArray();
+	for( const CRecognitionInstance& instance : instances ) {
+		writer.StartObject();
+		writer.Key( "instance" );
+		const string reference = patterns.Reference( instance.Reference );
+		writer.String( reference.data(),
+			static_cast<SizeType>( reference.length() ) );
+		writer.Key( "begin" );
+		writer.Uint64( instance.Begin );
+		writer.Key( "end" );
+		writer.Uint64( instance.End );
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	file.Write( buffer.GetString(), buffer.GetSize() );
+	file.Put( '\n' );
+}
+
+bool CJsonLinesRecognitionWriter::Finish()
+{
+	return file.Close();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// All integers are unsigned LEB128 varints, strings are length prefixed.
+// Header:
+//   "LSPR" version:1 patternCount { name }
+// Record:
+//   pattern begin wordCount
+//   { kind:0 element | kind:1 regexp } indexCount { index:1 }
+//   instanceCount { reference firstWordOffset lastWordOffset }
+// element = main attribute value + element index * main values count
+class CBinaryRecognitionWriter : public CRecognitionWriter {
+public:
+	static const uint8_t Version = 1;
+
+	CBinaryRecognitionWriter( const CPatterns& patterns,
+		const string& filename );
+	~CBinaryRecognitionWriter() override {}
+
+	bool IsOpen() const { return file.IsOpen(); }
+
+	void OnRecognized( const TWordIndex begin, const TWordIndex end,
+		const CText& text, const CData& data,
+		const CVariantParts& parts ) override;
+	bool Finish() override;
+
+private:
+	CBufferedFileWriter file;
+	string record;
+	vector<CRecognitionWord> words;
+	vector<CRecognitionInstance> instances;
+
+	void writeNumber( uint64_t number );
+	void writeString( const string& str );
+};
+
+CBinaryRecognitionWriter::CBinaryRecognitionWriter(
+		const CPatterns& patterns, const string& filename ) :
+	CRecognitionWriter( patterns, RF_Binary ),
+	file( filename )
+{
+	if( !IsOpen() ) {
+		return;
+	}
+
+	record = "LSPR";
+	record.push_back( static_cast<char>( Version ) );
+	writeNumber( patterns.Size() );
+	for( TReference ref = 0; ref < patterns.Size(); ref++ ) {
+		writeString( patterns.Pattern( ref ).Name() );
+	}
+	file.Write( record );
+}
+
+void CBinaryRecognitionWriter::OnRecognized(
+	const TWordIndex begin, const TWordIndex end,
+	const CText& /*text*/, const CData& data,
+	const CVariantParts& parts )
+{
+	Collect( begin, end, parts, words, instances );
+	check_logic( data.size() == words.size() );
+
+	record.clear();
+	writeNumber( parts.front()->Instance() % patterns.Size() );
+	writeNumber( begin );
+	writeNumber( words.size() );
+	for( CData::size_type i = 0; i < words.size(); i++ ) {
+		const CBaseVariantPart* const part = words[i].Part;
+		if( part->Type() == VPR_Word ) {
+			record.push_back( 0 );
+			writeNumber( part->Word() );
+		} else {
+			record.push_back( 1 );
+			writeString( part->Regexp() );
+		}
+		const CAnnotationIndices& indices = data[i].Indices;
+		writeNumber( indices.Size() );
+		for( const TAnnotationIndex index : indices ) {
+			record.push_back( static_cast<char>( index ) );
+		}
+	}
+	writeNumber( instances.size() );
+	for( const CRecognitionInstance& instance : instances ) {
+		writeNumber( instance.Reference );
+		writeNumber( instance.Begin - begin );
+		writeNumber( instance.End - begin );
+	}
+	file.Write( record );
+}
+
+bool CBinaryRecognitionWriter::Finish()
+{
+	return file.Close();
+}
+
+void CBinaryRecognitionWriter::writeNumber( uint64_t number )
+{
+	while( number >= 0x80 ) {
+		record.push_back( static_cast<char>( ( number & 0x7F ) | 0x80 ) );
+		number >>= 7;
+	}
+	record.push_back( static_cast<char>( number ) );
+}
+
+void CBinaryRecognitionWriter::writeString( const string& str )
+{
+	writeNumber( str.length() );
+	record += str;
+}
+
+} // end of anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+TRecognitionFormat CRecognitionWriter::Format( const string& result )
+{
+	if( result.empty() || result == "cout" ) {
+		return RF_Text;
+	}
+	const string extension = ".jsonl";
+	if( result.length() > extension.length()
+		&& result.compare( result.length() - extension.length(),
+			extension.length(), extension ) == 0 )
+	{
+		return RF_JsonLines;
+	}
+	return RF_Binary;
+}
+
+CRecognitionWriterPtr CRecognitionWriter::Create( const CPatterns& patterns,
+	const string& result, ostream& err )
+{
+	switch( Format( result ) ) {
+		case RF_Text:
+			return CRecognitionWriterPtr(
+				new CTextRecognitionWriter( patterns ) );
+		case RF_JsonLines:
+		{
+			unique_ptr<CJsonLinesRecognitionWriter> writer(
+				new CJsonLinesRecognitionWriter( patterns, result ) );
+			if( writer->IsOpen() ) {
+				return CRecognitionWriterPtr( writer.release() );
+			}
+			break;
+		}
+		case RF_Binary:
+		{
+			unique_ptr<CBinaryRecognitionWriter> writer(
+				new CBinaryRecognitionWriter( patterns, result ) );
+			if( writer->IsOpen() ) {
+				return CRecognitionWriterPtr( writer.release() );
+			}
+			break;
+		}
+	}
+	err << "Cannot create result file '" << result << "'" << endl;
+	return CRecognitionWriterPtr();
+}
+
+CRecognitionWriter::CRecognitionWriter( const CPatterns& _patterns,
+		const TRecognitionFormat _format ) :
+	patterns( _patterns ),
+	format( _format )
+{
+}
+
+CRecognitionWriter::~CRecognitionWriter()
+{
+}
+
+void CRecognitionWriter::Start( const CPattern& /*pattern*/ )
+{
+}
+
+bool CRecognitionWriter::Finish()
+{
+	return true;
+}
+
+void CRecognitionWriter::Collect( const TWordIndex begin, const TWordIndex end,
+	const CVariantParts& parts, vector<CRecognitionWord>& words,
+	vector<CRecognitionInstance>& instances )
+{
+	words.clear();
+	instances.clear();
+	stack<size_t> opened;
+	TWordIndex wi = begin;
+	for( const CBaseVariantPart* const vp : parts ) {
+		if( vp == nullptr ) {
+			check_logic( !opened.empty() );
+			check_logic( wi > instances[opened.top()].Begin );
+			instances[opened.top()].End = wi - 1;
+			opened.pop();
+		} else if( vp->Type() == VPR_Instance ) {
+			opened.push( instances.size() );
+			instances.push_back( { vp->Instance(), wi, wi } );
+		} else {
+			words.push_back( { wi, vp } );
+			wi++;
+		}
+	}
+	check_logic( opened.empty() );
+	check_logic( ( end + 1 ) == wi );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Pattern namespace
+} // end of Lspl namespace
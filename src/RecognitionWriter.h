@@ -0,0 +1,104 @@
+#pragma once
+
+#include <Pattern.h>
+#include <PatternMatch.h>
+
+namespace Lspl {
+namespace Pattern {
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Output file which is written by a background thread.
+// Data is collected in a buffer, full buffers are passed to the thread.
+class CBufferedFileWriter {
+	CBufferedFileWriter( const CBufferedFileWriter& ) = delete;
+	CBufferedFileWriter& operator=( const CBufferedFileWriter& ) = delete;
+
+public:
+	static const size_t BufferSize = 1 << 20;
+	static const size_t MaxQueueSize = 8;
+
+	explicit CBufferedFileWriter( const string& filename );
+	~CBufferedFileWriter();
+
+	bool IsOpen() const { return file.is_open(); }
+	void Write( const char* data, const size_t size );
+	void Write( const string& data ) { Write( data.data(), data.size() ); }
+	void Put( const char c );
+	// flushes all buffered data and waits for the thread
+	// returns false if there were any output errors
+	bool Close();
+
+private:
+	ofstream file;
+	string buffer;
+	deque<string> queue;
+	bool closed;
+	bool failed;
+	mutex queueMutex;
+	condition_variable queueCondition;
+	thread writerThread;
+
+	void flush();
+	void writeQueue();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+enum TRecognitionFormat {
+	RF_Text, // human readable text on the standard output
+	RF_JsonLines, // one JSON object per recognition
+	RF_Binary // compact binary records
+};
+
+class CRecognitionWriter : public IRecognitionCallback {
+	CRecognitionWriter( const CRecognitionWriter& ) = delete;
+	CRecognitionWriter& operator=( const CRecognitionWriter& ) = delete;
+
+public:
+	// RESULT "" or "cout" selects text, "*.jsonl" selects JSON Lines,
+	// any other file name selects binary records
+	static TRecognitionFormat Format( const string& result );
+	// returns nullptr if the output file cannot be created
+	static unique_ptr<CRecognitionWriter> Create( const CPatterns& patterns,
+		const string& result, ostream& err );
+
+	~CRecognitionWriter() override;
+
+	TRecognitionFormat Format() const { return format; }
+	// called before matching of the pattern
+	virtual void Start( const CPattern& pattern );
+	// returns false if there were any output errors
+	virtual bool Finish();
+
+protected:
+	const CPatterns& patterns;
+
+	CRecognitionWriter( const CPatterns& patterns,
+		const TRecognitionFormat format );
+
+	// word parts and nested instances of a recognition
+	struct CRecognitionWord {
+		Text::TWordIndex Index;
+		const CBaseVariantPart* Part;
+	};
+	struct CRecognitionInstance {
+		TReference Reference;
+		Text::TWordIndex Begin;
+		Text::TWordIndex End;
+	};
+	static void Collect( const Text::TWordIndex begin,
+		const Text::TWordIndex end, const CVariantParts& parts,
+		vector<CRecognitionWord>& words,
+		vector<CRecognitionInstance>& instances );
+
+private:
+	const TRecognitionFormat format;
+};
+
+typedef unique_ptr<CRecognitionWriter> CRecognitionWriterPtr;
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Pattern namespace
+} // end of Lspl namespace
@@ -123,15 +123,105 @@ void CAnnotation::SetArgreementBegin( const TAttribute attribute )
 	agreementBegin = attribute;
 }
 
+void CAnnotation::SetArgreementBegin(
+	const Configuration::CWordAttributes& attributes )
+{
+	agreementBegin = attributes.Size();
+	for( TAttribute a = 0; a < attributes.Size(); a++ ) {
+		if( attributes[a].Agreement() ) {
+			agreementBegin = a;
+			break;
+		}
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
-CAnnotationIndices CWord::AnnotationIndices() const
+CAnnotationSets::CAnnotationSets() :
+	serial( nextSerial() )
 {
-	CAnnotationIndices indices;
-	for( TAnnotationIndex i = 0; i < annotations.size(); i++ ) {
-		indices.Add( i );
+}
+
+TAnnotationSet CAnnotationSets::Add( CAnnotations&& annotations )
+{
+	const size_t annotationsHash = hash( annotations );
+	auto range = setIndices.equal_range( annotationsHash );
+	for( auto i = range.first; i != range.second; ++i ) {
+		if( equal( sets[i->second], annotations ) ) {
+			return i->second;
+		}
+	}
+
+	const TAnnotationSet index = Size();
+	check_logic( index < numeric_limits<TAnnotationSet>::max() );
+	sets.emplace_back( move( annotations ) );
+	setIndices.insert( make_pair( annotationsHash, index ) );
+	return index;
+}
+
+void CAnnotationSets::Clear()
+{
+	serial = nextSerial();
+	sets.clear();
+	setIndices.clear();
+}
+
+const CAnnotations& CAnnotationSets::operator[](
+	const TAnnotationSet index ) const
+{
+	debug_check_logic( index < sets.size() );
+	return sets[index];
+}
+
+uint64_t CAnnotationSets::nextSerial()
+{
+	static atomic<uint64_t> lastSerial( 0 );
+	return ++lastSerial;
+}
+
+size_t CAnnotationSets::hash( const CAnnotations& annotations )
+{
+	size_t result = annotations.size();
+	for( const CAnnotation& annotation : annotations ) {
+		const CAttributes& attributes = annotation.Attributes();
+		for( TAttribute a = 0; a < attributes.Size(); a++ ) {
+			result = result * 31 + attributes.Get( a );
+		}
+	}
+	return result;
+}
+
+bool CAnnotationSets::equal( const CAnnotations& annotations1,
+	const CAnnotations& annotations2 )
+{
+	if( annotations1.size() != annotations2.size() ) {
+		return false;
+	}
+	for( size_t i = 0; i < annotations1.size(); i++ ) {
+		const CAttributes& attributes1 = annotations1[i].Attributes();
+		const CAttributes& attributes2 = annotations2[i].Attributes();
+		if( attributes1.Size() != attributes2.Size() ) {
+			return false;
+		}
+		for( TAttribute a = 0; a < attributes1.Size(); a++ ) {
+			if( attributes1.Get( a ) != attributes2.Get( a ) ) {
+				return false;
+			}
+		}
 	}
-	return indices;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const size_t CAnnotationIndices::BlockSize;
+const size_t CAnnotationIndices::BlocksCount;
+
+///////////////////////////////////////////////////////////////////////////////
+
+CAnnotationIndices CWord::AnnotationIndices() const
+{
+	return CAnnotationIndices( Annotations().size() );
 }
 
 bool CWord::MatchWord( const RegexEx& wordRegex ) const
@@ -143,6 +233,7 @@ bool CWord::MatchWord( const RegexEx& wordRegex ) const
 bool CWord::MatchAttributes( const CAttributesRestriction& attributesRestriction,
 	CAnnotationIndices& indices ) const
 {
+	const CAnnotations& annotations = Annotations();
 	indices.Empty();
 	for( TAnnotationIndex i = 0; i < annotations.size(); i++ ) {
 		if( attributesRestriction.Check( annotations[i].Attributes() ) ) {
@@ -166,6 +257,12 @@ const CWord& CText::Word( const TWordIndex index ) const
 	return words[index];
 }
 
+void CText::setAnnotations( CWord& word, CAnnotations&& annotations )
+{
+	word.annotationSet = annotationSets.Add( move( annotations ) );
+	word.annotations = &annotationSets[word.annotationSet];
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 } // end of Text namespace
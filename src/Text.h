@@ -53,6 +53,9 @@ public:
 
 	// sets interval for agreement as [index, attributes.size()]
 	static void SetArgreementBegin( const TAttribute attribute );
+	// sets interval for agreement from the first agreement attribute
+	static void SetArgreementBegin(
+		const Configuration::CWordAttributes& attributes );
 
 private:
 	CAttributes attributes;
@@ -64,16 +67,211 @@ typedef uint8_t TAnnotationIndex;
 const TAnnotationIndex MaxAnnotation = numeric_limits<TAnnotationIndex>::max();
 
 typedef vector<CAnnotation> CAnnotations;
-typedef COrderedList<TAnnotationIndex> CAnnotationIndices;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Set of annotation indices of a word as a fixed bitset without allocations,
+// indices are iterated in increasing order.
+class CAnnotationIndices {
+public:
+	class CIterator {
+	public:
+		CIterator( const uint64_t* _blocks, const size_t _block );
+		TAnnotationIndex operator*() const;
+		CIterator& operator++();
+		bool operator!=( const CIterator& other ) const;
+
+	private:
+		const uint64_t* blocks;
+		size_t block;
+		uint64_t rest; // not iterated bits of the block
+	};
+
+	CAnnotationIndices();
+	// indices from 0 to count - 1
+	explicit CAnnotationIndices( const size_t count );
+
+	void Empty();
+	bool IsEmpty() const;
+	size_t Size() const;
+	bool Add( const TAnnotationIndex index );
+	bool Has( const TAnnotationIndex index ) const;
+	bool Erase( const TAnnotationIndex index );
+
+	CIterator begin() const { return CIterator( blocks, 0 ); }
+	CIterator end() const { return CIterator( blocks, BlocksCount ); }
+
+private:
+	static const size_t BlockSize = 64;
+	static const size_t BlocksCount = ( MaxAnnotation + BlockSize ) / BlockSize;
+
+	uint64_t blocks[BlocksCount];
+
+	static uint64_t bit( const TAnnotationIndex index );
+};
+
+inline CAnnotationIndices::CIterator::CIterator( const uint64_t* _blocks,
+		const size_t _block ) :
+	blocks( _blocks ),
+	block( _block ),
+	rest( 0 )
+{
+	while( block < BlocksCount && ( rest = blocks[block] ) == 0 ) {
+		block++;
+	}
+}
+
+inline TAnnotationIndex CAnnotationIndices::CIterator::operator*() const
+{
+	debug_check_logic( rest != 0 );
+	uint64_t lowest = rest & ( ~rest + 1 );
+	size_t index = block * BlockSize;
+	// binary search of the lowest bit
+	for( size_t shift = BlockSize / 2; shift > 0; shift /= 2 ) {
+		if( ( lowest >> shift ) != 0 ) {
+			lowest >>= shift;
+			index += shift;
+		}
+	}
+	return static_cast<TAnnotationIndex>( index );
+}
+
+inline CAnnotationIndices::CIterator& CAnnotationIndices::CIterator::operator++()
+{
+	rest &= rest - 1;
+	while( rest == 0 && ++block < BlocksCount ) {
+		rest = blocks[block];
+	}
+	return *this;
+}
+
+inline bool CAnnotationIndices::CIterator::operator!=(
+	const CIterator& other ) const
+{
+	return ( block != other.block || rest != other.rest );
+}
+
+inline CAnnotationIndices::CAnnotationIndices()
+{
+	Empty();
+}
+
+inline CAnnotationIndices::CAnnotationIndices( const size_t count )
+{
+	debug_check_logic( count <= MaxAnnotation );
+	for( size_t b = 0; b < BlocksCount; b++ ) {
+		const size_t first = b * BlockSize;
+		if( count >= first + BlockSize ) {
+			blocks[b] = ~uint64_t( 0 );
+		} else if( count > first ) {
+			blocks[b] = ( uint64_t( 1 ) << ( count - first ) ) - 1;
+		} else {
+			blocks[b] = 0;
+		}
+	}
+}
+
+inline void CAnnotationIndices::Empty()
+{
+	for( uint64_t& block : blocks ) {
+		block = 0;
+	}
+}
+
+inline bool CAnnotationIndices::IsEmpty() const
+{
+	uint64_t any = 0;
+	for( const uint64_t block : blocks ) {
+		any |= block;
+	}
+	return ( any == 0 );
+}
+
+inline size_t CAnnotationIndices::Size() const
+{
+	size_t size = 0;
+	for( const uint64_t block : blocks ) {
+		size += bitset<BlockSize>( block ).count();
+	}
+	return size;
+}
+
+inline bool CAnnotationIndices::Add( const TAnnotationIndex index )
+{
+	uint64_t& block = blocks[index / BlockSize];
+	const bool added = ( block & bit( index ) ) == 0;
+	block |= bit( index );
+	return added;
+}
+
+inline bool CAnnotationIndices::Has( const TAnnotationIndex index ) const
+{
+	return ( ( blocks[index / BlockSize] & bit( index ) ) != 0 );
+}
+
+inline bool CAnnotationIndices::Erase( const TAnnotationIndex index )
+{
+	uint64_t& block = blocks[index / BlockSize];
+	const bool erased = ( block & bit( index ) ) != 0;
+	block &= ~bit( index );
+	return erased;
+}
+
+inline uint64_t CAnnotationIndices::bit( const TAnnotationIndex index )
+{
+	return ( uint64_t( 1 ) << ( index % BlockSize ) );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef uint32_t TAnnotationSet;
+
+// Immutable annotation sets of a text, equal sets are stored once.
+// Addresses of sets are stable while the sets are not cleared.
+class CAnnotationSets {
+	CAnnotationSets( const CAnnotationSets& ) = delete;
+	CAnnotationSets& operator=( const CAnnotationSets& ) = delete;
+
+public:
+	CAnnotationSets();
+
+	// returns index of the set equal to the annotations
+	TAnnotationSet Add( CAnnotations&& annotations );
+	void Clear();
+
+	TAnnotationSet Size() const { return Cast<TAnnotationSet>( sets.size() ); }
+	const CAnnotations& operator[]( const TAnnotationSet index ) const;
+	// unique number of the sets, changed by Clear
+	uint64_t Serial() const { return serial; }
+
+private:
+	uint64_t serial;
+	deque<CAnnotations> sets;
+	// hash of annotations -> index of the set
+	unordered_multimap<size_t, TAnnotationSet> setIndices;
+
+	static uint64_t nextSerial();
+	static size_t hash( const CAnnotations& annotations );
+	static bool equal( const CAnnotations& annotations1,
+		const CAnnotations& annotations2 );
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 
 struct CWord {
 	string text;
 	StringEx word;
-	CAnnotations annotations;
+	TAnnotationSet annotationSet;
+	const CAnnotations* annotations; // shared set of the text
 
-	const CAnnotations& Annotations() const { return annotations; }
+	CWord() :
+		annotationSet( 0 ),
+		annotations( nullptr )
+	{
+	}
+
+	const CAnnotations& Annotations() const { return *annotations; }
+	TAnnotationSet AnnotationSet() const { return annotationSet; }
 	CAnnotationIndices AnnotationIndices() const;
 	bool MatchWord( const RegexEx& wordRegex ) const;
 	bool MatchAttributes( const CAttributesRestriction& attributesRestriction,
@@ -87,6 +285,16 @@ typedef CWords::size_type TWordIndex;
 
 ///////////////////////////////////////////////////////////////////////////////
 
+enum TTextFileFormat {
+	TFF_Json, // { "text": [ { "word":"...", "annotations" : [ {...} ] } ] }
+	TFF_Tsv // one word per line: word<TAB>sp=N;c=nom<TAB>sp=A;c=nom
+};
+
+// "*.tsv" selects TSV, any other file name selects JSON
+TTextFileFormat TextFileFormat( const string& filename );
+
+///////////////////////////////////////////////////////////////////////////////
+
 class CText {
 	CText( const CText& ) = delete;
 	CText& operator=( const CText& ) = delete;
@@ -96,10 +304,21 @@ public:
 	bool LoadFromFile( const string& filename, ostream& errStream );
 	const TWordIndex Length() const { return words.size(); }
 	const CWord& Word( const TWordIndex index ) const;
+	const CAnnotationSets& AnnotationSets() const { return annotationSets; }
+	const Configuration::CConfiguration& Configuration() const
+		{ return *configuration; }
 
 private:
 	Configuration::CConfigurationPtr configuration;
 	CWords words;
+	CAnnotationSets annotationSets;
+
+	void setAnnotations( CWord& word, CAnnotations&& annotations );
+	// returns false if the value of the attribute is already set
+	bool setAttributeValue( CAttributes& attributes,
+		const string& name, const string& value ) const;
+	bool loadFromJsonFile( const string& filename, ostream& errStream );
+	bool loadFromTsvFile( const string& filename, ostream& errStream );
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -18,9 +18,48 @@ namespace Text {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+TTextFileFormat TextFileFormat( const string& filename )
+{
+	const string tsv = ".tsv";
+	if( filename.size() >= tsv.size()
+		&& filename.compare( filename.size() - tsv.size(), tsv.size(), tsv ) == 0 )
+	{
+		return TFF_Tsv;
+	}
+	return TFF_Json;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 bool CText::LoadFromFile( const string& filename, ostream& err )
 {
 	words.clear();
+	annotationSets.Clear();
+	if( TextFileFormat( filename ) == TFF_Tsv ) {
+		return loadFromTsvFile( filename, err );
+	}
+	return loadFromJsonFile( filename, err );
+}
+
+bool CText::setAttributeValue( CAttributes& attributes,
+	const string& name, const string& value ) const
+{
+	const CWordAttributes& wordAttributes = configuration->Attributes();
+	TAttribute index;
+	if( wordAttributes.Find( name, index ) ) {
+		TAttributeValue attrValue = NullAttributeValue;
+		if( wordAttributes[index].FindValue( value, attrValue ) ) {
+			if( attributes.Get( index ) != NullAttributeValue ) {
+				return false;
+			}
+			attributes.Set( index, attrValue );
+		}
+	}
+	return true;
+}
+
+bool CText::loadFromJsonFile( const string& filename, ostream& err )
+{
 
 	Document textDocument;
 	{
@@ -72,7 +111,8 @@ bool CText::LoadFromFile( const string& filename, ostream& err )
 				<< " too much annotations" << endl;
 			return false;
 		}
-		tempWords.back().annotations.reserve( annotations.Size() );
+		CAnnotations wordAnnotations;
+		wordAnnotations.reserve( annotations.Size() );
 
 		for( rapidjson::SizeType ai = 0; ai < annotations.Size(); ai++ ) {
 			if( !annotations[ai].IsObject() ) {
@@ -95,21 +135,13 @@ bool CText::LoadFromFile( const string& filename, ostream& err )
 					return false;
 				}
 
-				TAttribute index;
-				if( wordAttributes.Find( attr->name.GetString(), index ) ) {
-					const CWordAttribute& attribute = wordAttributes[index];
-					const string value = attr->value.GetString();
-					TAttributeValue attrValue = NullAttributeValue;
-					if( attribute.FindValue( value, attrValue ) ) {
-						if( attributes.Get( index ) == NullAttributeValue ) {
-							attributes.Set( index, attrValue );
-						} else {
-							err << "bad 'word' #" << wi
-								<< " 'annotation' #" << ai
-								<< " redefinition of value" << endl;
-							return false;
-						}
-					}
+				if( !setAttributeValue( attributes,
+					attr->name.GetString(), attr->value.GetString() ) )
+				{
+					err << "bad 'word' #" << wi
+						<< " 'annotation' #" << ai
+						<< " redefinition of value" << endl;
+					return false;
 				}
 			}
 
@@ -120,8 +152,94 @@ bool CText::LoadFromFile( const string& filename, ostream& err )
 				return false;
 			}
 
-			tempWords.back().annotations.emplace_back( move( attributes ) );
+			wordAnnotations.emplace_back( move( attributes ) );
+		}
+		setAnnotations( tempWords.back(), move( wordAnnotations ) );
+	}
+
+	words = move( tempWords );
+	return true;
+}
+
+// Text is read line by line without building of a document in memory.
+bool CText::loadFromTsvFile( const string& filename, ostream& err )
+{
+	ifstream file( filename );
+	if( !file.is_open() ) {
+		err << "Cannot open text '" << filename << "'" << endl;
+		return false;
+	}
+
+	const TAttribute attributesCount = configuration->Attributes().Size();
+
+	CWords tempWords;
+	string line;
+	size_t lineNumber = 0;
+	while( getline( file, line ) ) {
+		lineNumber++;
+		if( !line.empty() && line.back() == '\r' ) {
+			line.pop_back();
+		}
+		if( line.empty() ) {
+			continue;
+		}
+
+		size_t tab = line.find( '\t' );
+		if( tab == 0 || tab == string::npos ) {
+			err << "bad word at line " << lineNumber << endl;
+			return false;
+		}
+
+		tempWords.emplace_back();
+		CWord& word = tempWords.back();
+		word.text = line.substr( 0, tab );
+		word.word = ToStringEx( word.text );
+
+		CAnnotations annotations;
+		while( tab != string::npos ) {
+			const size_t begin = tab + 1;
+			tab = line.find( '\t', begin );
+			const size_t end = ( tab == string::npos ) ? line.size() : tab;
+			if( annotations.size() == MaxAnnotation ) {
+				err << "bad word at line " << lineNumber
+					<< " too much annotations" << endl;
+				return false;
+			}
+
+			CAttributes attributes( attributesCount );
+			size_t pos = begin;
+			while( pos < end ) {
+				size_t next = line.find( ';', pos );
+				if( next == string::npos || next > end ) {
+					next = end;
+				}
+				const size_t equal = line.find( '=', pos );
+				if( equal == string::npos || equal >= next ) {
+					err << "bad word at line " << lineNumber
+						<< " 'annotation' #" << annotations.size()
+						<< " attribute value" << endl;
+					return false;
+				}
+				if( !setAttributeValue( attributes, line.substr( pos, equal - pos ),
+					line.substr( equal + 1, next - equal - 1 ) ) )
+				{
+					err << "bad word at line " << lineNumber
+						<< " 'annotation' #" << annotations.size()
+						<< " redefinition of value" << endl;
+					return false;
+				}
+				pos = next + 1;
+			}
+
+			if( attributes.Get( MainAttribute ) == NullAttributeValue ) {
+				err << "bad word at line " << lineNumber
+					<< " 'annotation' #" << annotations.size()
+					<< " has no main attribute" << endl;
+				return false;
+			}
+			annotations.emplace_back( move( attributes ) );
 		}
+		setAnnotations( word, move( annotations ) );
 	}
 
 	words = move( tempWords );
@@ -4,41 +4,42 @@ namespace Lspl {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Each element of a transposition is placed either before or after
+// the transposition of the following elements, so there are 2^(size - 1)
+// transpositions. Bit (size - 2 - i) of the index of a transposition
+// places element i after the following elements, so transpositions
+// are computed from their indices without tables and shared state.
 class CTranspositionSupport {
-	CTranspositionSupport( const CTranspositionSupport& ) = delete;
-	CTranspositionSupport& operator=( const CTranspositionSupport& ) = delete;
+	CTranspositionSupport() = delete;
 
 public:
-	static const size_t MaxTranspositionSize = 9;
-
-	struct CSwap : public pair<size_t, size_t> {
-		template<typename ValueType>
-		void Apply( vector<ValueType>& vect ) const
-		{
-			debug_check_logic( first < second );
-			debug_check_logic( second < vect.size() );
-			ValueType tmp = move( vect[first] );
-			vect[first] = move( vect[second] );
-			vect[second] = move( tmp );
-		}
-	};
-	typedef vector<CSwap> CSwaps;
-
-	static const CTranspositionSupport& Instance();
-	const CSwaps& Swaps( const size_t transpositionSize ) const;
+	// orders are matched by up to 2^size states of matched elements and
+	// expanded into variants when they cannot be, so the size is limited
+	static const size_t MaxTranspositionSize = 12;
+
+	static constexpr size_t Count( const size_t size )
+	{
+		return ( size == 0 ? 0 : ( size_t( 1 ) << ( size - 1 ) ) );
+	}
+
+	// index of the element at the position of the transposition
+	static constexpr size_t Element( const size_t size,
+		const size_t transposition, const size_t position )
+	{
+		return element( size, transposition, position, 0 );
+	}
 
 private:
-	static unique_ptr<CTranspositionSupport> instance; // singleton
-	mutable unordered_map<size_t, CSwaps> allSwaps;
-
-	CTranspositionSupport() = default;
-	static void fillSwaps( CSwaps& swaps, const size_t size );
-
-	typedef basic_string<unsigned char> CTransposition;
-	typedef list<CTransposition> CTranspositions;
-	static CTranspositions generate( const CTransposition& first );
-	static bool connect( const CTransposition& first,
-		const CTransposition& second, CSwaps& swaps );
+	static constexpr size_t element( const size_t size,
+		const size_t transposition, const size_t position, const size_t first )
+	{
+		return ( size == 1 ? first
+			: ( ( ( transposition >> ( size - 2 ) ) & 1 ) == 0
+				? ( position == 0 ? first : element( size - 1,
+					transposition, position - 1, first + 1 ) )
+				: ( position == size - 1 ? first : element( size - 1,
+					transposition, position, first + 1 ) ) ) );
+	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
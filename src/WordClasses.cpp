@@ -0,0 +1,172 @@
+#include <common.h>
+#include <WordClasses.h>
+
+using namespace Lspl::Text;
+
+namespace Lspl {
+namespace Pattern {
+
+///////////////////////////////////////////////////////////////////////////////
+
+CWordClasses::CWordClasses() :
+	serial( 0 ),
+	classesCount( 0 ),
+	rowSize( 0 )
+{
+}
+
+void CWordClasses::AddStates( const CStates& states )
+{
+	vector<size_t>& statesRestrictions = transitionRestrictions[&states];
+	for( const CState& state : states ) {
+		for( const CTransitionPtr& transition : state.Transitions ) {
+			if( transition->Type() != CBaseTransition::T_Attributes ) {
+				continue;
+			}
+			const CAttributesTransition* attributesTransition
+				= static_cast<const CAttributesTransition*>( transition.get() );
+
+			const CAttributesRestriction& restriction
+				= attributesTransition->Restriction();
+			auto pair = restrictionIndices.insert(
+				make_pair( restriction.Key(), restrictions.size() ) );
+			if( pair.second ) {
+				restrictions.push_back( &restriction );
+				serial = 0; // the text must be built again
+			}
+			const size_t index = attributesTransition->Index();
+			if( index >= statesRestrictions.size() ) {
+				statesRestrictions.resize( index + 1 );
+			}
+			statesRestrictions[index] = pair.first->second;
+		}
+	}
+}
+
+const vector<size_t>* CWordClasses::TransitionRestrictions(
+	const CStates& states ) const
+{
+	auto i = transitionRestrictions.find( &states );
+	return ( i == transitionRestrictions.end() ) ? nullptr : &i->second;
+}
+
+void CWordClasses::Build( const CText& text )
+{
+	serial = 0;
+	classes.clear();
+	setOffsets.clear();
+
+	// class of each distinct annotation and signature of each class
+	unordered_map<string, TWordClass> annotationClasses;
+	unordered_map<string, TWordClass> signatureClasses;
+	vector<vector<uint64_t>> signatures;
+
+	const size_t signatureSize = ( restrictions.size() + 63 ) / 64;
+	vector<uint64_t> signature( signatureSize );
+	const CAnnotationSets& sets = text.AnnotationSets();
+	for( TAnnotationSet set = 0; set < sets.Size(); set++ ) {
+		setOffsets.push_back( classes.size() );
+		for( const CAnnotation& annotation : sets[set] ) {
+			const CAttributes& attributes = annotation.Attributes();
+			string annotationKey;
+			for( TAttribute a = 0; a < attributes.Size(); a++ ) {
+				const TAttributeValue value = attributes.Get( a );
+				annotationKey.append( reinterpret_cast<const char*>( &value ),
+					sizeof( value ) );
+			}
+
+			auto annotationPair = annotationClasses.insert(
+				make_pair( annotationKey, TWordClass() ) );
+			if( annotationPair.second ) {
+				fill( signature.begin(), signature.end(), 0 );
+				for( size_t r = 0; r < restrictions.size(); r++ ) {
+					if( restrictions[r]->Check( attributes ) ) {
+						signature[r / 64] |= uint64_t( 1 ) << ( r % 64 );
+					}
+				}
+				const string signatureKey(
+					reinterpret_cast<const char*>( signature.data() ),
+					signatureSize * sizeof( uint64_t ) );
+				auto signaturePair = signatureClasses.insert( make_pair(
+					signatureKey, Cast<TWordClass>( signatures.size() ) ) );
+				if( signaturePair.second ) {
+					signatures.push_back( signature );
+				}
+				annotationPair.first->second = signaturePair.first->second;
+			}
+			classes.push_back( annotationPair.first->second );
+		}
+	}
+
+	classesCount = Cast<TWordClass>( signatures.size() );
+	rowSize = ( classesCount + 63 ) / 64;
+	table.assign( restrictions.size() * rowSize, 0 );
+	for( TWordClass c = 0; c < classesCount; c++ ) {
+		for( size_t r = 0; r < restrictions.size(); r++ ) {
+			if( ( ( signatures[c][r / 64] >> ( r % 64 ) ) & 1 ) != 0 ) {
+				table[r * rowSize + c / 64] |= uint64_t( 1 ) << ( c % 64 );
+			}
+		}
+	}
+	serial = sets.Serial();
+}
+
+const TWordClass* CWordClasses::AnnotationClasses(
+	const TAnnotationSet set ) const
+{
+	debug_check_logic( serial != 0 );
+	debug_check_logic( set < setOffsets.size() );
+	return ( classes.data() + setOffsets[set] );
+}
+
+bool CWordClasses::Match( const size_t restriction, const CWord& word,
+	CAnnotationIndices& indices ) const
+{
+	debug_check_logic( restriction < restrictions.size() );
+	const TWordClass* wordClasses = AnnotationClasses( word.AnnotationSet() );
+	const uint64_t* row = table.data() + restriction * rowSize;
+
+	indices.Empty();
+	const size_t annotationsCount = word.Annotations().size();
+	for( TAnnotationIndex i = 0; i < annotationsCount; i++ ) {
+		const TWordClass wordClass = wordClasses[i];
+		if( ( ( row[wordClass / 64] >> ( wordClass % 64 ) ) & 1 ) != 0 ) {
+			indices.Add( i );
+		}
+	}
+	return !indices.IsEmpty();
+}
+
+bool CWordClasses::MatchTransition( const vector<size_t>& transitionRestrictions,
+	const CBaseTransition& transition, const CText& text, const CWord& word,
+	CAnnotationIndices& indices ) const
+{
+	if( transition.Type() != CBaseTransition::T_Attributes ) {
+		return transition.Match( text, word, indices );
+	}
+	const size_t index
+		= static_cast<const CAttributesTransition&>( transition ).Index();
+	debug_check_logic( index < transitionRestrictions.size() );
+	return Match( transitionRestrictions[index], word, indices );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void BuildWordClasses( const CPatternAutomata& automata,
+	const CSpanAutomata& spans, const CText& text, CWordClasses& wordClasses )
+{
+	for( const CPatternAutomaton& automaton : automata ) {
+		wordClasses.AddStates( automaton.States );
+	}
+	for( TSpan span = 0; span < spans.Size(); span++ ) {
+		if( spans.Status( span ) == CSpanAutomata::S_Built ) {
+			wordClasses.AddStates( spans.Automaton( span ).States );
+		}
+	}
+	wordClasses.Build( text );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Pattern namespace
+} // end of Lspl namespace
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Pattern.h>
+#include <PatternMatch.h>
+
+namespace Lspl {
+namespace Pattern {
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef uint32_t TWordClass;
+
+// Alphabet of a text for a set of automata. Annotations which satisfy
+// the same attribute restrictions of all registered transitions belong
+// to the same class, so an attribute transition is a lookup of classes
+// of annotations of the word in a bit table instead of checking the
+// restriction for each annotation. The classes are not referenced by
+// the automata, so automata are shared by threads matching different
+// texts, each CMatchContext is given the classes of its text.
+class CWordClasses {
+	CWordClasses( const CWordClasses& ) = delete;
+	CWordClasses& operator=( const CWordClasses& ) = delete;
+
+public:
+	CWordClasses();
+
+	// registers attribute transitions of the states,
+	// the states must not be destroyed before the classes
+	void AddStates( const CStates& states );
+	// classifies annotations of the text by the registered restrictions
+	void Build( const Text::CText& text );
+
+	size_t Restrictions() const { return restrictions.size(); }
+	// restrictions indexed by attribute transitions of the states,
+	// nullptr if the states are not registered
+	const vector<size_t>* TransitionRestrictions( const CStates& states ) const;
+	TWordClass Size() const { return classesCount; }
+	// serial of annotation sets of the built text, 0 if the text is not built
+	uint64_t Serial() const { return serial; }
+
+	// classes of the annotations of words of the annotation set
+	const TWordClass* AnnotationClasses( const Text::TAnnotationSet set ) const;
+	bool Match( const size_t restriction, const Text::CWord& word,
+		/* out */ Text::CAnnotationIndices& indices ) const;
+	// attribute transitions are matched by the restrictions of the classes
+	// from TransitionRestrictions, other transitions are matched by themselves
+	bool MatchTransition( const vector<size_t>& transitionRestrictions,
+		const CBaseTransition& transition,
+		const Text::CText& text, const Text::CWord& word,
+		/* out */ Text::CAnnotationIndices& indices ) const;
+
+private:
+	vector<const Text::CAttributesRestriction*> restrictions;
+	unordered_map<string, size_t> restrictionIndices;
+	unordered_map<const CStates*, vector<size_t>> transitionRestrictions;
+	uint64_t serial;
+	TWordClass classesCount;
+	size_t rowSize;
+	// bit per class in the row of each restriction
+	vector<uint64_t> table;
+	// classes of annotations of all annotation sets of the text
+	vector<TWordClass> classes;
+	vector<size_t> setOffsets;
+};
+
+// Registers the automata of the patterns and the built automata
+// of referenced patterns and classifies annotations of the text,
+// so the classes are built once for all patterns.
+void BuildWordClasses( const CPatternAutomata& automata,
+	const CSpanAutomata& spans, const Text::CText& text,
+	CWordClasses& wordClasses );
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end of Pattern namespace
+} // end of Lspl namespace
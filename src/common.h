@@ -4,25 +4,36 @@
 #include <set>
 #include <list>
 #include <array>
+#include <deque>
+#include <mutex>
 #include <regex>
 #include <stack>
 #include <tuple>
+#include <atomic>
+#include <random>
 #include <bitset>
+#include <chrono>
+#include <limits>
 #include <locale>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 #ifdef _WIN32
 #include <codecvt>
 #endif
+#include <cstdio>
 #include <fstream>
+#include <iomanip>
 #include <sstream>
 #include <iostream>
 #include <algorithm>
 #include <exception>
+#include <condition_variable>
 #include <forward_list>
 #include <unordered_map>
 #include <unordered_set>
+#include <cmath>
 #include <cassert>
 
 using namespace std;
@@ -1,14 +1,18 @@
 #include <common.h>
-#include <Parser.h>
+#include <Chart.h>
 #include <Tokenizer.h>
+#include <WordClasses.h>
 #include <PatternMatch.h>
+#include <PatternScanner.h>
 #include <Configuration.h>
-#include <ErrorProcessor.h>
+#include <MatchStatistics.h>
+#include <RecognitionWriter.h>
 #include <PatternsFileProcessor.h>
+#include <ToolInput.h>
+#include <ToolOptions.h>
 
 using namespace Lspl;
 using namespace Lspl::Text;
-using namespace Lspl::Parser;
 using namespace Lspl::Pattern;
 using namespace Lspl::Configuration;
 
@@ -16,117 +20,175 @@ using namespace Lspl::Configuration;
 
 namespace {
 
-class CRecognitionCallback : public IRecognitionCallback {
-public:
-	explicit CRecognitionCallback( const CPatterns& patterns );
-
-	void OnRecognized(
-		const Text::TWordIndex begin, const Text::TWordIndex end,
-		const Text::CText& text, const CData& data,
-		const CVariantParts& parts ) override;
-
-private:
-	const CPatterns& patterns;
+const char* const Usage =
+	"Usage: lspl3 [OPTIONS] CONFIGURATION PATTERNS TEXT RESULT\n"
+	"Options:\n"
+	"  --profile[=N]   print N (20 by default) most expensive patterns\n"
+	"                  and automaton states to the standard error\n"
+	"  --chart         match referenced patterns once per word and reuse\n"
+	"                  their recognitions in all enclosing patterns\n"
+	"  --threads=N     build patterns by N threads (0 for all cores),\n"
+	"                  patterns are built by one thread with --chart\n"
+	"  --match=POLICY  recognitions of each pattern: all (by default),\n"
+	"                  longest (from each word), leftmost-longest\n"
+	"                  or non-overlapping (leftmost shortest)\n"
+	"  --count=N       stop matching a pattern after N recognitions\n"
+	"  --exists        stop matching a pattern after its first recognition\n"
+	"  --no-classes    match attributes of words by cached results for\n"
+	"                  annotation sets instead of classes of annotations\n";
+
+struct CMainOptions {
+	size_t Profile; // 0 if profiling is disabled
+	bool Chart;
+	size_t Threads; // 0 for all cores
+	TMatchPolicy Policy;
+	size_t Limit; // 0 if recognitions are not limited
+	bool Classes; // match attributes by word classes
+
+	CMainOptions() :
+		Profile( 0 ),
+		Chart( false ),
+		Threads( 1 ),
+		Policy( MP_All ),
+		Limit( 0 ),
+		Classes( true )
+	{
+	}
 };
 
-CRecognitionCallback::CRecognitionCallback( const CPatterns& _patterns ) :
-	patterns( _patterns )
-{
-}
-
-void CRecognitionCallback::OnRecognized(
-	const TWordIndex begin, const TWordIndex end,
-	const CText& text, const CData& /*data*/,
-	const CVariantParts& parts )
+// Parses options --name[=value] which precede positional arguments.
+// Returns index of the first positional argument or 0 in case of error.
+int ParseOptions( int argc, const char* argv[],
+	CMainOptions& options, ostream& err )
 {
-	TWordIndex wi = begin;
-	for( const CBaseVariantPart* const vp : parts ) {
-		if( vp == nullptr ) {
-			cout << "} ";
+	int i = 1;
+	for( ; i < argc; i++ ) {
+		const string arg = argv[i];
+		string name;
+		string value;
+		if( !SplitOption( arg, name, value ) ) {
+			break;
+		}
+		// options without values
+		const bool flag = ( arg.find( '=' ) == string::npos );
+
+		size_t size = 0;
+		if( name == "profile" && ( flag || ParseSize( value, size ) ) ) {
+			options.Profile = flag ? 20 : size;
+		} else if( name == "chart" && flag ) {
+			options.Chart = true;
+		} else if( name == "threads" && ParseSize( value, options.Threads ) ) {
+			// the number of threads is set
+		} else if( name == "match" && ParseMatchPolicy( value, options.Policy ) ) {
+			// the policy is set
+		} else if( name == "count" && ParseSize( value, size ) && size > 0 ) {
+			options.Limit = size;
+		} else if( name == "exists" && flag ) {
+			options.Limit = 1;
+		} else if( name == "no-classes" && flag ) {
+			options.Classes = false;
 		} else {
-			switch( vp->Type() ) {
-				case VPR_Word:
-					cout << patterns.Element( vp->Word() ) << ":"
-						<< text.Word( wi ).text << " ";
-					wi++;
-					break;
-				case VPR_Regexp:
-					cout << vp->Regexp() << ":"
-						<< text.Word( wi ).text << " ";
-					wi++;
-					break;
-				case VPR_Instance:
-					cout << patterns.Reference( vp->Instance() ) << "{ ";
-					break;
-			}
+			err << "Invalid option '" << arg << "'" << endl;
+			return 0;
 		}
 	}
-	check_logic( ( end + 1 ) == wi );
-	cout << endl;
+	return i;
 }
 
-}
+} // end of anonymous namespace
 
 ///////////////////////////////////////////////////////////////////////////////
 
 int main( int argc, const char* argv[] )
 {
 	try {
-		if( argc != 5 ) {
-			cerr << "Usage: lspl2 CONFIGURATION PATTERNS TEXT RESULT" << endl;
+		CMainOptions options;
+		const int first = ParseOptions( argc, argv, options, cerr );
+		if( first == 0 || argc - first != 4 ) {
+			cerr << Usage;
 			return 1;
 		}
+		argv += first - 1;
 
-		CConfigurationPtr conf( new CConfiguration );
-		if( !conf->LoadFromFile( argv[1], cout, cerr ) ) {
+		const CConfigurationPtr conf = LoadConfiguration( argv[1], cout, cerr );
+		if( !static_cast<bool>( conf ) ) {
 			return 1;
 		}
 
-		CAnnotation::SetArgreementBegin( conf->Attributes().Size() );
-		for( TAttribute a = 0; a < conf->Attributes().Size(); a++ ) {
-			if( conf->Attributes()[a].Agreement() ) {
-				CAnnotation::SetArgreementBegin( a );
-				break;
-			}
+		const unique_ptr<const CPatterns> loadedPatterns
+			= LoadPatterns( conf, argv[2], cerr );
+		if( !static_cast<bool>( loadedPatterns ) ) {
+			return 1;
 		}
+		const CPatterns& patterns = *loadedPatterns;
 
-		CErrorProcessor errorProcessor;
-		CPatternsBuilder patternsBuilder( conf, errorProcessor );
-		patternsBuilder.ReadFromFile( argv[2] );
-		patternsBuilder.CheckAndBuildIfPossible();
-
-		if( errorProcessor.HasAnyErrors() ) {
-			errorProcessor.PrintErrors( cerr, argv[2] );
+		CRecognitionWriterPtr writer
+			= CRecognitionWriter::Create( patterns, argv[4], cerr );
+		if( !static_cast<bool>( writer ) ) {
 			return 1;
 		}
-
-		const CPatterns patterns = patternsBuilder.GetResult();
-		patterns.Print( cout );
+		const bool verbose = ( writer->Format() == RF_Text );
+		if( verbose ) {
+			patterns.Print( cout );
+		}
 
 		CText text( conf );
 		if( !text.LoadFromFile( argv[3], cerr ) ) {
 			return 1;
 		}
 
-		CRecognitionCallback recognitionCallback( patterns );
+		const TVariantSize maxSize = 12;
+		// automata and recognitions of referenced patterns are shared
+		CSpanAutomata spans( maxSize );
+		CChart chart( text, spans );
+
+		// automata of all patterns are built before matching,
+		// so annotations of the text are classified once for all of them
+		CPatternAutomata automata;
+		BuildPatterns( patterns, maxSize, options.Chart ? &spans : nullptr,
+			options.Threads, automata, options.Profile > 0, verbose );
+
+		CWordClasses wordClasses;
+		if( options.Classes ) {
+			BuildWordClasses( automata, spans, text, wordClasses );
+			chart.SetWordClasses( &wordClasses );
+		}
 
+		CMatchProfile profile( options.Profile );
 		for( TReference ref = 0; ref < patterns.Size(); ref++ ) {
 			const CPattern& pattern = patterns.Pattern( ref );
-			cout << pattern.Name() << endl;
-
-			CPatternBuildContext buildContext( patterns );
-			CPatternVariants variants;
-			pattern.Build( buildContext, variants, 12 );
-			variants.Print( patterns, cout );
-			variants.Build( buildContext );
-
-			CMatchContext matchContext( text, buildContext.States );
-			matchContext.SetRecognitionCallback( &recognitionCallback );
-			for( TWordIndex wi = 0; wi < text.Length(); wi++ ) {
-				matchContext.Match( wi );
+			const CPatternAutomaton& automaton = automata[ref];
+			writer->Start( pattern );
+			if( verbose ) {
+				cout << automaton.PrintedVariants;
 			}
 
-			cout << endl;
+			CMatchContext matchContext( text, automaton.States );
+			matchContext.SetRecognitionCallback( writer.get() );
+			matchContext.SetPolicy( options.Policy );
+			matchContext.SetLimit( options.Limit );
+			matchContext.SetWordClasses(
+				options.Classes ? &wordClasses : nullptr );
+			if( options.Chart ) {
+				matchContext.SetChart( &chart );
+			}
+			CMatchStatistics statistics( automaton.States );
+			if( options.Profile > 0 ) {
+				matchContext.SetStatistics( &statistics );
+			}
+			MatchText( matchContext );
+			if( options.Profile > 0 ) {
+				profile.Add( pattern, automaton, statistics );
+			}
+		}
+
+		if( options.Profile > 0 ) {
+			profile.Print( cerr );
+		}
+
+		if( !writer->Finish() ) {
+			cerr << "Cannot write result file '" << argv[4] << "'" << endl;
+			return 1;
 		}
 	} catch( exception& e ) {
 		cerr << e.what() << endl;
@@ -0,0 +1,189 @@
+#include <common.h>
+#include <Dictionary.h>
+#include <PatternMatch.h>
+#include <PatternScanner.h>
+#include <ToolInput.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/ostreamwrapper.h>
+
+using namespace Lspl;
+using namespace Lspl::Text;
+using namespace Lspl::Pattern;
+using namespace Lspl::Configuration;
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+typedef vector<string> CRecognitions;
+
+// Collects names and words of recognitions
+class CRecognitionsCollector : public IRecognitionCallback {
+public:
+	CRecognitionsCollector( const string& _name, CRecognitions& _recognitions ) :
+		name( _name ),
+		recognitions( _recognitions )
+	{
+	}
+
+	void OnRecognized( const TWordIndex begin, const TWordIndex end,
+		const CText& /*text*/, const CData& /*data*/,
+		const CVariantParts& /*parts*/ ) override
+	{
+		recognitions.push_back( name + " " + to_string( begin ) + "-"
+			+ to_string( end ) );
+	}
+
+private:
+	const string name;
+	CRecognitions& recognitions;
+};
+
+// writes the configuration with dictionary 'Test' of the file
+bool WriteConfiguration( const string& configuration,
+	const string& dictionary, const string& filename )
+{
+	ifstream in( configuration );
+	rapidjson::IStreamWrapper inWrapper( in );
+	rapidjson::Document document;
+	if( document.ParseStream( inWrapper ).HasParseError() ) {
+		return false;
+	}
+	rapidjson::Document::AllocatorType& allocator = document.GetAllocator();
+	rapidjson::Value entry( rapidjson::kObjectType );
+	entry.AddMember( "name", "Test", allocator );
+	entry.AddMember( "file", rapidjson::Value( dictionary.c_str(), allocator ),
+		allocator );
+	rapidjson::Value dictionaries( rapidjson::kArrayType );
+	dictionaries.PushBack( entry, allocator );
+	document.RemoveMember( "dictionaries" );
+	document.AddMember( "dictionaries", dictionaries, allocator );
+
+	ofstream out( filename, ios::out | ios::trunc );
+	rapidjson::OStreamWrapper outWrapper( out );
+	rapidjson::Writer<rapidjson::OStreamWrapper> writer( outWrapper );
+	document.Accept( writer );
+	out.close();
+	return out.good();
+}
+
+bool WriteImage( const string& source, const string& filename )
+{
+	vector<uint64_t> image;
+	if( !CDictionary::Compile( source, image, cerr ) ) {
+		return false;
+	}
+	ofstream out( filename, ios::out | ios::binary | ios::trunc );
+	out.write( reinterpret_cast<const char*>( image.data() ),
+		image.size() * sizeof( uint64_t ) );
+	out.close();
+	return out.good();
+}
+
+// recognitions of all patterns sorted by patterns, returns false on errors
+bool MatchPatterns( const string& configuration, const string& patternsFile,
+	const string& textFile, const bool mapped, CRecognitions& recognitions )
+{
+	ostringstream log;
+	const CConfigurationPtr conf = LoadConfiguration( configuration, log, cerr );
+	if( !static_cast<bool>( conf ) ) {
+		return false;
+	}
+	TDictionary dictionary;
+	if( !conf->Dictionaries().Find( "Test", dictionary )
+		|| conf->Dictionaries()[dictionary].Mapped() != mapped )
+	{
+		cerr << "Dictionary 'Test' of '" << configuration << "' is "
+			<< ( mapped ? "not " : "" ) << "a mapped image" << endl;
+		return false;
+	}
+	const unique_ptr<const CPatterns> loadedPatterns
+		= LoadPatterns( conf, patternsFile, cerr );
+	if( !static_cast<bool>( loadedPatterns ) ) {
+		return false;
+	}
+	const CPatterns& patterns = *loadedPatterns;
+
+	CText text( conf );
+	if( !text.LoadFromFile( textFile, cerr ) ) {
+		return false;
+	}
+
+	const TVariantSize maxSize = 12;
+	CPatternAutomata automata;
+	BuildPatterns( patterns, maxSize, nullptr, 1, automata );
+	for( TReference ref = 0; ref < patterns.Size(); ref++ ) {
+		CRecognitionsCollector collector( patterns.Pattern( ref ).Name(),
+			recognitions );
+		CMatchContext context( text, automata[ref].States );
+		context.SetRecognitionCallback( &collector );
+		MatchText( context );
+	}
+	return true;
+}
+
+} // end of anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Patterns with dictionary conditions must find the same entries of the text
+// whether the dictionary is loaded from its source or mapped from its image:
+// entries of one and several words in an argument and no pairs of words
+// which are not entries of the dictionary.
+int main( int argc, const char* argv[] )
+{
+	if( argc != 6 ) {
+		cerr << "Usage: lspl3-dictionary-match-test CONFIGURATION DICTIONARY"
+			" PATTERNS TEXT IMAGE" << endl;
+		return 1;
+	}
+
+	try {
+		const string imageFilename = argv[5];
+		const string sourceConfiguration = imageFilename + ".source.json";
+		const string imageConfiguration = imageFilename + ".image.json";
+		if( !WriteImage( argv[2], imageFilename )
+			|| !WriteConfiguration( argv[1], argv[2], sourceConfiguration )
+			|| !WriteConfiguration( argv[1], imageFilename, imageConfiguration ) )
+		{
+			cerr << "Cannot write dictionary image '" << imageFilename
+				<< "' and its configurations" << endl;
+			return 1;
+		}
+
+		// red apple, green apple tree, big green tree and red wine,
+		// but not red tree, green apples or blue apple
+		const CRecognitions expected = { "Pair 0-1", "Pair 10-11",
+			"Phrase 2-4", "Big 7-9" };
+		size_t failed = 0;
+		for( const bool mapped : { false, true } ) {
+			CRecognitions recognitions;
+			if( !MatchPatterns( mapped ? imageConfiguration : sourceConfiguration,
+				argv[3], argv[4], mapped, recognitions ) )
+			{
+				failed++;
+				continue;
+			}
+			if( recognitions != expected ) {
+				cerr << "Recognitions with the dictionary "
+					<< ( mapped ? "image" : "source" ) << ":";
+				for( const string& recognition : recognitions ) {
+					cerr << " '" << recognition << "'";
+				}
+				cerr << endl;
+				failed++;
+			}
+		}
+
+		remove( sourceConfiguration.c_str() );
+		remove( imageConfiguration.c_str() );
+		remove( imageFilename.c_str() );
+		return ( failed == 0 ? 0 : 1 );
+	} catch( exception& e ) {
+		cerr << e.what() << endl;
+		return 1;
+	}
+}
@@ -0,0 +1,192 @@
+#include <common.h>
+#include <Dictionary.h>
+
+using namespace Lspl;
+using namespace Lspl::Configuration;
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+typedef CDictionary::TNode TNode;
+typedef CDictionary::TToken TToken;
+
+// entry has arguments separated by tabs and words separated by spaces
+bool HasEntry( const CDictionary& dictionary, const string& entry )
+{
+	TNode node = CDictionary::RootNode;
+	istringstream entryStream( entry );
+	string argument;
+	for( size_t arguments = 0; getline( entryStream, argument, '\t' );
+		arguments++ )
+	{
+		if( arguments > 0
+			&& !dictionary.Next( node, CDictionary::Separator, node ) )
+		{
+			return false;
+		}
+		istringstream argumentStream( argument );
+		string word;
+		while( argumentStream >> word ) {
+			TToken token;
+			if( !dictionary.FindToken( word, token )
+				|| !dictionary.Next( node, token, node ) )
+			{
+				return false;
+			}
+		}
+	}
+	return dictionary.IsFinal( node );
+}
+
+bool WriteImage( const string& filename, const vector<uint64_t>& image,
+	const size_t size )
+{
+	ofstream out( filename, ios::out | ios::binary | ios::trunc );
+	out.write( reinterpret_cast<const char*>( image.data() ), size );
+	out.close();
+	return out.good();
+}
+
+// tokens of the words and nodes reachable from the root
+// must be in the dictionary
+bool IsInside( const CDictionary& dictionary, const vector<string>& words )
+{
+	for( const string& word : words ) {
+		TToken token;
+		if( dictionary.FindToken( word, token )
+			&& token >= dictionary.Tokens() )
+		{
+			return false;
+		}
+	}
+
+	vector<TNode> nodes( 1, CDictionary::RootNode );
+	set<TNode> visited( nodes.cbegin(), nodes.cend() );
+	while( !nodes.empty() ) {
+		const TNode node = nodes.back();
+		nodes.pop_back();
+		for( size_t token = 0; token <= dictionary.Tokens(); token++ ) {
+			TNode next;
+			const TToken nextToken = ( token == dictionary.Tokens() )
+				? CDictionary::Separator : static_cast<TToken>( token );
+			if( !dictionary.Next( node, nextToken, next ) ) {
+				continue;
+			}
+			if( next >= dictionary.Nodes() ) {
+				return false;
+			}
+			if( visited.insert( next ).second ) {
+				nodes.push_back( next );
+			}
+		}
+	}
+	return true;
+}
+
+} // end of anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Dictionary compiled from the source and mapped from its image must have
+// all entries of the source and no other entries. Images which are
+// truncated or have a corrupted value must either be rejected or have
+// all lookups inside the image.
+int main( int argc, const char* argv[] )
+{
+	if( argc != 3 ) {
+		cerr << "Usage: lspl3-dictionary-test SOURCE IMAGE" << endl;
+		return 1;
+	}
+
+	try {
+		const string imageFilename = argv[2];
+		vector<uint64_t> image;
+		if( !CDictionary::Compile( argv[1], image, cerr ) ) {
+			return 1;
+		}
+		const size_t imageSize = image.size() * sizeof( uint64_t );
+		if( !WriteImage( imageFilename, image, imageSize ) ) {
+			cerr << "Cannot write dictionary image '"
+				<< imageFilename << "'" << endl;
+			return 1;
+		}
+
+		size_t failed = 0;
+		{
+			CDictionary dictionary( "test", 0 );
+			if( !dictionary.LoadFromFile( imageFilename, cerr ) ) {
+				return 1;
+			}
+			const vector<string> entries = { "red\tapple", "red\twine",
+				"green\tapple tree", "big green\ttree" };
+			const vector<string> otherEntries = { "red\ttree", "green\tapple",
+				"blue\tapple", "red", "big\ttree", "red\tapple\tred" };
+			if( !dictionary.Mapped() || dictionary.Size() != entries.size()
+				|| dictionary.Arguments() != 2 )
+			{
+				cerr << "Invalid image of " << dictionary.Size()
+					<< " entries of " << dictionary.Arguments()
+					<< " arguments" << endl;
+				failed++;
+			}
+			for( const string& entry : entries ) {
+				if( !HasEntry( dictionary, entry ) ) {
+					cerr << "Entry '" << entry << "' was not found" << endl;
+					failed++;
+				}
+			}
+			for( const string& entry : otherEntries ) {
+				if( HasEntry( dictionary, entry ) ) {
+					cerr << "Entry '" << entry << "' was found" << endl;
+					failed++;
+				}
+			}
+		}
+
+		// words of the entries and words which are not in the dictionary
+		vector<string> words = { "red", "apple", "wine", "green", "tree",
+			"big" };
+		for( size_t i = 0; i < 100; i++ ) {
+			words.push_back( "w" + to_string( i ) );
+		}
+
+		ostringstream log;
+		if( !WriteImage( imageFilename, image, imageSize - sizeof( uint64_t ) )
+			|| CDictionary( "test", 0 ).LoadFromFile( imageFilename, log ) )
+		{
+			cerr << "Truncated image was not rejected" << endl;
+			failed++;
+		}
+
+		// each 32-bit value after the magic is replaced with the maximum value
+		const size_t values = imageSize / sizeof( uint32_t );
+		size_t rejected = 0;
+		for( size_t i = 2; i < values; i++ ) {
+			vector<uint64_t> corrupted = image;
+			reinterpret_cast<uint32_t*>( corrupted.data() )[i]
+				= numeric_limits<uint32_t>::max();
+			if( !WriteImage( imageFilename, corrupted, imageSize ) ) {
+				return 1;
+			}
+			CDictionary dictionary( "test", 0 );
+			if( !dictionary.LoadFromFile( imageFilename, log ) ) {
+				rejected++;
+			} else if( !IsInside( dictionary, words ) ) {
+				cerr << "Image with corrupted value " << i
+					<< " has tokens or nodes outside of the dictionary" << endl;
+				failed++;
+			}
+		}
+		if( rejected == 0 ) {
+			cerr << "No corrupted images were rejected" << endl;
+			failed++;
+		}
+
+		remove( imageFilename.c_str() );
+		return ( failed == 0 ? 0 : 1 );
+	} catch( exception& e ) {
+		cerr << e.what() << endl;
+		return 1;
+	}
+}
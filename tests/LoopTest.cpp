@@ -0,0 +1,151 @@
+#include <common.h>
+#include <Pattern.h>
+#include <PatternMatch.h>
+#include <PatternScanner.h>
+#include <ToolInput.h>
+
+using namespace Lspl;
+using namespace Lspl::Text;
+using namespace Lspl::Pattern;
+using namespace Lspl::Configuration;
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+typedef vector<string> CRecognitions;
+
+// Collects words, annotations and parts of recognitions
+class CRecognitionsCollector : public IRecognitionCallback {
+public:
+	explicit CRecognitionsCollector( CRecognitions& _recognitions ) :
+		recognitions( _recognitions )
+	{
+	}
+
+	void OnRecognized( const TWordIndex begin, const TWordIndex end,
+		const CText& /*text*/, const CData& data,
+		const CVariantParts& parts ) override
+	{
+		ostringstream out;
+		out << begin << "-" << end << ":";
+		for( const CEdges& edges : data ) {
+			out << " ";
+			for( const TAnnotationIndex index : edges.Indices ) {
+				out << index << ",";
+			}
+		}
+		out << " " << parts.size();
+		recognitions.push_back( out.str() );
+	}
+
+private:
+	CRecognitions& recognitions;
+};
+
+// recognitions are sorted, since paths of automata are in different orders
+CRecognitions MatchAutomaton( const CText& text, const CStates& states )
+{
+	CRecognitions recognitions;
+	CRecognitionsCollector collector( recognitions );
+	CMatchContext context( text, states );
+	context.SetRecognitionCallback( &collector );
+	MatchText( context );
+	sort( recognitions.begin(), recognitions.end() );
+	return recognitions;
+}
+
+// loop states or transitions by words of transpositions
+bool HasCompactStates( const CStates& states )
+{
+	for( const CState& state : states ) {
+		if( state.IsLoop() ) {
+			return true;
+		}
+		for( const CTransitionPtr& transition : state.Transitions ) {
+			if( transition->TransposedWord() != NoTransposedWord ) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+} // end of anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Repeated words of patterns are matched by loop states with agreements
+// of their repetitions and transpositions by states of matched elements,
+// the recognitions must be the same as the ones of the automata
+// with all repetitions and transpositions unrolled.
+int main( int argc, const char* argv[] )
+{
+	if( argc != 4 ) {
+		cerr << "Usage: lspl3-loop-test CONFIGURATION PATTERNS TEXT" << endl;
+		return 1;
+	}
+
+	try {
+		ostringstream log;
+		const CConfigurationPtr conf = LoadConfiguration( argv[1], log, cerr );
+		if( !static_cast<bool>( conf ) ) {
+			return 1;
+		}
+		const unique_ptr<const CPatterns> loadedPatterns
+			= LoadPatterns( conf, argv[2], cerr );
+		if( !static_cast<bool>( loadedPatterns ) ) {
+			return 1;
+		}
+		const CPatterns& patterns = *loadedPatterns;
+
+		CText text( conf );
+		if( !text.LoadFromFile( argv[3], cerr ) ) {
+			return 1;
+		}
+
+		const TVariantSize maxSize = 12;
+		CPatternAutomata automata;
+		BuildPatterns( patterns, maxSize, nullptr, 1, automata );
+
+		size_t recognized = 0;
+		size_t failed = 0;
+		for( TReference ref = 0; ref < patterns.Size(); ref++ ) {
+			const CPattern& pattern = patterns.Pattern( ref );
+			if( !HasCompactStates( automata[ref].States ) ) {
+				cerr << "Pattern '" << pattern.Name()
+					<< "' has no loop or transposition states" << endl;
+				failed++;
+			}
+
+			CPatternBuildContext context( patterns );
+			CArena::CScope arenaScope( context.Arena() );
+			CPatternVariants variants;
+			pattern.Build( context, variants, maxSize );
+			variants.Unroll( context.Words() );
+			variants.SortAndRemoveDuplicates( context.Words() );
+			variants.Build( context );
+
+			const CRecognitions expected
+				= MatchAutomaton( text, context.States );
+			const CRecognitions recognitions
+				= MatchAutomaton( text, automata[ref].States );
+			recognized += expected.size();
+			if( recognitions != expected ) {
+				cerr << "Pattern '" << pattern.Name() << "': "
+					<< recognitions.size() << " recognitions by compact states"
+					<< " instead of " << expected.size() << endl;
+				failed++;
+			}
+		}
+
+		if( recognized == 0 ) {
+			cerr << "No recognitions" << endl;
+			return 1;
+		}
+		return ( failed == 0 ? 0 : 1 );
+	} catch( exception& e ) {
+		cerr << e.what() << endl;
+		return 1;
+	}
+}
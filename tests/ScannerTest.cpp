@@ -0,0 +1,145 @@
+#include <common.h>
+#include <PatternMatch.h>
+#include <PatternScanner.h>
+#include <WordClasses.h>
+#include <ToolInput.h>
+
+using namespace Lspl;
+using namespace Lspl::Text;
+using namespace Lspl::Pattern;
+using namespace Lspl::Configuration;
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Collects words where recognitions begin
+class CBeginsCollector : public IRecognitionCallback {
+public:
+	explicit CBeginsCollector( vector<TWordIndex>& _begins ) :
+		begins( _begins )
+	{
+	}
+
+	void OnRecognized( const TWordIndex begin, const TWordIndex /*end*/,
+		const CText& /*text*/, const CData& /*data*/,
+		const CVariantParts& /*parts*/ ) override
+	{
+		if( begins.empty() || begins.back() != begin ) {
+			begins.push_back( begin );
+		}
+	}
+
+private:
+	vector<TWordIndex>& begins;
+};
+
+// words where recognitions begin if the automaton is matched from every word
+vector<TWordIndex> MatchBegins( const CText& text, const CStates& states )
+{
+	vector<TWordIndex> begins;
+	CBeginsCollector collector( begins );
+	CMatchContext context( text, states );
+	context.SetRecognitionCallback( &collector );
+	for( TWordIndex wi = 0; wi < text.Length(); wi++ ) {
+		context.Match( wi );
+	}
+	return begins;
+}
+
+} // end of anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Scans of patterns without conditions must find the words where
+// recognitions begin if the automaton is matched from every word,
+// whether the DFA is rebuilt at almost every word or not
+// and whether words are matched by word classes or not.
+int main( int argc, const char* argv[] )
+{
+	if( argc != 4 ) {
+		cerr << "Usage: lspl3-scanner-test CONFIGURATION PATTERNS TEXT" << endl;
+		return 1;
+	}
+
+	try {
+		ostringstream log;
+		const CConfigurationPtr conf = LoadConfiguration( argv[1], log, cerr );
+		if( !static_cast<bool>( conf ) ) {
+			return 1;
+		}
+		const unique_ptr<const CPatterns> loadedPatterns
+			= LoadPatterns( conf, argv[2], cerr );
+		if( !static_cast<bool>( loadedPatterns ) ) {
+			return 1;
+		}
+		const CPatterns& patterns = *loadedPatterns;
+
+		CText text( conf );
+		if( !text.LoadFromFile( argv[3], cerr ) ) {
+			return 1;
+		}
+
+		const TVariantSize maxSize = 12;
+		CSpanAutomata spans( maxSize );
+		CPatternAutomata automata;
+		BuildPatterns( patterns, maxSize, nullptr, 1, automata );
+		CWordClasses wordClasses;
+		BuildWordClasses( automata, spans, text, wordClasses );
+
+		size_t scanned = 0;
+		size_t failed = 0;
+		for( TReference ref = 0; ref < patterns.Size(); ref++ ) {
+			const CStates& states = automata[ref].States;
+			if( !CPatternScanner::CanScan( states ) ) {
+				continue;
+			}
+			scanned++;
+
+			const vector<TWordIndex> begins = MatchBegins( text, states );
+			vector<TWordIndex> scanBegins;
+			CPatternScanner( text, states ).Scan( scanBegins );
+			if( scanBegins != begins ) {
+				cerr << "Pattern '" << patterns.Pattern( ref ).Name()
+					<< "': " << scanBegins.size() << " begins by the scan "
+					<< "instead of " << begins.size() << " by matching" << endl;
+				failed++;
+			}
+			for( size_t maxDfaStates = 1; maxDfaStates <= 3; maxDfaStates++ ) {
+				vector<TWordIndex> resetBegins;
+				CPatternScanner( text, states, maxDfaStates ).Scan( resetBegins );
+				if( resetBegins != begins ) {
+					cerr << "Pattern '" << patterns.Pattern( ref ).Name()
+						<< "': " << resetBegins.size() << " begins with at most "
+						<< maxDfaStates << " DFA states instead of "
+						<< begins.size() << endl;
+					failed++;
+				}
+			}
+			for( const size_t maxDfaStates : { size_t( 1 ),
+				CPatternScanner::DefaultMaxDfaStates } )
+			{
+				vector<TWordIndex> classBegins;
+				CPatternScanner scanner( text, states, maxDfaStates );
+				scanner.SetWordClasses( &wordClasses );
+				scanner.Scan( classBegins );
+				if( classBegins != begins ) {
+					cerr << "Pattern '" << patterns.Pattern( ref ).Name()
+						<< "': " << classBegins.size() << " begins by word "
+						<< "classes with at most " << maxDfaStates
+						<< " DFA states instead of " << begins.size() << endl;
+					failed++;
+				}
+			}
+		}
+
+		if( scanned == 0 ) {
+			cerr << "No patterns without conditions" << endl;
+			return 1;
+		}
+		return ( failed == 0 ? 0 : 1 );
+	} catch( exception& e ) {
+		cerr << e.what() << endl;
+		return 1;
+	}
+}
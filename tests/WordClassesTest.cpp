@@ -0,0 +1,150 @@
+#include <common.h>
+#include <WordClasses.h>
+#include <PatternMatch.h>
+#include <PatternScanner.h>
+#include <ToolInput.h>
+
+using namespace Lspl;
+using namespace Lspl::Text;
+using namespace Lspl::Pattern;
+using namespace Lspl::Configuration;
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+typedef vector<string> CRecognitions;
+
+// Collects words and annotations of recognitions
+class CRecognitionsCollector : public IRecognitionCallback {
+public:
+	explicit CRecognitionsCollector( CRecognitions& _recognitions ) :
+		recognitions( _recognitions )
+	{
+	}
+
+	void OnRecognized( const TWordIndex begin, const TWordIndex end,
+		const CText& /*text*/, const CData& data,
+		const CVariantParts& /*parts*/ ) override
+	{
+		ostringstream out;
+		out << begin << "-" << end << ":";
+		for( const CEdges& edges : data ) {
+			out << " ";
+			for( const TAnnotationIndex index : edges.Indices ) {
+				out << index << ",";
+			}
+		}
+		recognitions.push_back( out.str() );
+	}
+
+private:
+	CRecognitions& recognitions;
+};
+
+// attribute transitions are matched by the classes or by their caches
+CRecognitions MatchAutomaton( const CText& text, const CStates& states,
+	const CWordClasses* wordClasses )
+{
+	CRecognitions recognitions;
+	CRecognitionsCollector collector( recognitions );
+	CMatchContext context( text, states );
+	context.SetRecognitionCallback( &collector );
+	context.SetWordClasses( wordClasses );
+	MatchText( context );
+	return recognitions;
+}
+
+} // end of anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Patterns matched by word classes and by caches of attribute transitions
+// must have the same recognitions. Caches are filled by the first match,
+// then two threads match two texts with the same automata, so the caches
+// are used and bound to another text by several threads.
+int main( int argc, const char* argv[] )
+{
+	if( argc != 4 ) {
+		cerr << "Usage: lspl3-word-classes-test CONFIGURATION PATTERNS TEXT"
+			<< endl;
+		return 1;
+	}
+
+	try {
+		ostringstream log;
+		const CConfigurationPtr conf = LoadConfiguration( argv[1], log, cerr );
+		if( !static_cast<bool>( conf ) ) {
+			return 1;
+		}
+		const unique_ptr<const CPatterns> loadedPatterns
+			= LoadPatterns( conf, argv[2], cerr );
+		if( !static_cast<bool>( loadedPatterns ) ) {
+			return 1;
+		}
+		const CPatterns& patterns = *loadedPatterns;
+
+		CText text1( conf );
+		CText text2( conf );
+		if( !text1.LoadFromFile( argv[3], cerr )
+			|| !text2.LoadFromFile( argv[3], cerr ) )
+		{
+			return 1;
+		}
+
+		const TVariantSize maxSize = 12;
+		CSpanAutomata spans( maxSize );
+		CPatternAutomata automata;
+		BuildPatterns( patterns, maxSize, nullptr, 1, automata );
+		CWordClasses wordClasses;
+		BuildWordClasses( automata, spans, text1, wordClasses );
+
+		size_t recognized = 0;
+		size_t failed = 0;
+		const auto check = [&]( const TReference ref,
+			const CRecognitions& expected, const CRecognitions& recognitions,
+			const char* const mode )
+		{
+			if( recognitions != expected ) {
+				cerr << "Pattern '" << patterns.Pattern( ref ).Name()
+					<< "': " << recognitions.size() << " recognitions "
+					<< mode << " instead of " << expected.size() << endl;
+				failed++;
+			}
+		};
+
+		for( TReference ref = 0; ref < patterns.Size(); ref++ ) {
+			const CStates& states = automata[ref].States;
+			const CRecognitions expected
+				= MatchAutomaton( text1, states, &wordClasses );
+			recognized += expected.size();
+
+			check( ref, expected, MatchAutomaton( text1, states, nullptr ),
+				"with empty caches" );
+			check( ref, expected, MatchAutomaton( text1, states, nullptr ),
+				"with filled caches" );
+
+			for( int round = 0; round < 3; round++ ) {
+				CRecognitions recognitions1;
+				CRecognitions recognitions2;
+				thread worker( [&]()
+				{
+					recognitions2 = MatchAutomaton( text2, states, nullptr );
+				} );
+				recognitions1 = MatchAutomaton( text1, states, nullptr );
+				worker.join();
+				check( ref, expected, recognitions1, "by threads in text 1" );
+				check( ref, expected, recognitions2, "by threads in text 2" );
+			}
+		}
+
+		if( recognized == 0 ) {
+			cerr << "No recognitions" << endl;
+			return 1;
+		}
+		return ( failed == 0 ? 0 : 1 );
+	} catch( exception& e ) {
+		cerr << e.what() << endl;
+		return 1;
+	}
+}
@@ -0,0 +1,474 @@
+#include <common.h>
+#include <Chart.h>
+#include <PatternMatch.h>
+#include <PatternScanner.h>
+#include <WordClasses.h>
+#include <Configuration.h>
+#include <ToolInput.h>
+#include <ToolOptions.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace Lspl;
+using namespace Lspl::Text;
+using namespace Lspl::Pattern;
+using namespace Lspl::Configuration;
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct CBenchmarkParameters {
+	string Configuration;
+	string Text; // generated if empty
+	string Patterns; // generated if empty
+	string Prefix; // prefix of generated files
+	bool Keep; // do not remove generated files
+	TTextFileFormat Format; // format of generated text
+	CCorpusParameters Corpus;
+	size_t PatternsCount;
+	size_t Length; // number of elements in alternative
+	size_t Alternatives;
+	bool Agreement;
+	size_t Depth; // nesting depth of pattern references
+	TVariantSize MaxVariantSize;
+	bool Chart; // match referenced patterns using a chart
+	size_t Threads; // threads building patterns, 0 for all cores
+	TMatchPolicy Policy;
+	size_t Limit; // recognitions of each pattern, 0 for all
+	bool Classes; // match attributes by word classes
+
+	CBenchmarkParameters() :
+		Prefix( "lspl3-benchmark" ),
+		Keep( false ),
+		Format( TFF_Json ),
+		PatternsCount( 10 ),
+		Length( 3 ),
+		Alternatives( 2 ),
+		Agreement( true ),
+		Depth( 1 ),
+		MaxVariantSize( 12 ),
+		Chart( false ),
+		Threads( 1 ),
+		Policy( MP_All ),
+		Limit( 0 ),
+		Classes( true )
+	{
+	}
+};
+
+const char* const Usage =
+	"Usage: lspl3-benchmark [OPTIONS] CONFIGURATION\n"
+	"Options:\n"
+	"  --text=FILE           use the text instead of generated one\n"
+	"  --patterns=FILE       use the patterns instead of generated ones\n"
+	"  --prefix=PREFIX       prefix of generated files\n"
+	"  --format=json|tsv     format of generated text\n"
+	"  --keep                do not remove generated files\n"
+	"  --pattern-count=N     number of generated patterns\n"
+	"  --length=N            number of elements in alternative\n"
+	"  --alternatives=N      number of alternatives in pattern\n"
+	"  --agreement=0|1       generate agreement conditions\n"
+	"  --depth=N             nesting depth of pattern references\n"
+	"  --max-size=N          maximum size of pattern variants\n"
+	"  --chart               match referenced patterns using a chart\n"
+	"  --threads=N           build patterns by N threads (0 for all cores)\n"
+	"  --match=POLICY        all, longest, leftmost-longest or non-overlapping\n"
+	"  --count=N             stop matching a pattern after N recognitions\n"
+	"  --exists              stop matching a pattern after its first recognition\n"
+	"  --no-classes          match attributes without word classes\n";
+
+bool ParseArguments( int argc, const char* argv[],
+	CBenchmarkParameters& params, ostream& err )
+{
+	for( int i = 1; i < argc; i++ ) {
+		const string arg = argv[i];
+		string name;
+		string value;
+		if( !SplitOption( arg, name, value ) ) {
+			if( !params.Configuration.empty() ) {
+				err << "Unexpected argument '" << arg << "'" << endl;
+				return false;
+			}
+			params.Configuration = arg;
+			continue;
+		}
+
+		// options without values
+		const bool flag = ( arg.find( '=' ) == string::npos );
+		size_t size = 0;
+		bool valid = true;
+		if( ParseCorpusOption( name, value, params.Corpus, valid ) ) {
+			// option of generated text
+		} else if( name == "text" ) {
+			params.Text = value;
+		} else if( name == "patterns" ) {
+			params.Patterns = value;
+		} else if( name == "prefix" ) {
+			params.Prefix = value;
+		} else if( name == "format" ) {
+			valid = ( value == "json" || value == "tsv" );
+			params.Format = ( value == "tsv" ) ? TFF_Tsv : TFF_Json;
+		} else if( name == "keep" ) {
+			valid = flag;
+			params.Keep = true;
+		} else if( name == "chart" ) {
+			valid = flag;
+			params.Chart = true;
+		} else if( name == "match" ) {
+			valid = ParseMatchPolicy( value, params.Policy );
+		} else if( name == "exists" ) {
+			valid = flag;
+			params.Limit = 1;
+		} else if( name == "no-classes" ) {
+			valid = flag;
+			params.Classes = false;
+		} else if( ( valid = ParseSize( value, size ) ) == false ) {
+			// invalid value of numeric option
+		} else if( name == "pattern-count" ) {
+			params.PatternsCount = size;
+		} else if( name == "length" ) {
+			valid = ( size > 0 );
+			params.Length = size;
+		} else if( name == "alternatives" ) {
+			valid = ( size > 0 );
+			params.Alternatives = size;
+		} else if( name == "agreement" ) {
+			params.Agreement = ( size != 0 );
+		} else if( name == "depth" ) {
+			params.Depth = size;
+		} else if( name == "max-size" ) {
+			valid = ( size > 0 && size <= numeric_limits<TVariantSize>::max() );
+			params.MaxVariantSize = static_cast<TVariantSize>( size );
+		} else if( name == "threads" ) {
+			params.Threads = size;
+		} else if( name == "count" ) {
+			valid = ( size > 0 );
+			params.Limit = size;
+		} else {
+			err << "Unknown option '" << arg << "'" << endl;
+			return false;
+		}
+
+		if( !valid ) {
+			err << "Invalid value of option '" << arg << "'" << endl;
+			return false;
+		}
+	}
+
+	if( params.Configuration.empty() ) {
+		err << Usage << CorpusOptionsUsage;
+		return false;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Pattern names must not end with digits, so they are written in letters.
+string SyntheticPatternName( size_t index )
+{
+	string name = "Bench";
+	do {
+		name += static_cast<char>( 'a' + index % 26 );
+		index /= 26;
+	} while( index > 0 );
+	return name;
+}
+
+// Writes patterns with sequences of random elements.
+// Each pattern at depth d > 0 references the previous pattern at depth d - 1.
+void GeneratePatterns( const CConfiguration& configuration,
+	const CBenchmarkParameters& params, ostream& out )
+{
+	const CWordAttribute& main = configuration.Attributes().Main();
+	check_logic( main.ValuesCount() > 1 );
+	mt19937 random( params.Corpus.Seed );
+	uniform_int_distribution<TAttributeValue> elementDistribution( 1,
+		main.ValuesCount() - 1 );
+
+	for( size_t pi = 0; pi < params.PatternsCount; pi++ ) {
+		const size_t depth = pi % ( params.Depth + 1 );
+		out << SyntheticPatternName( pi ) << " =";
+		for( size_t ai = 0; ai < params.Alternatives; ai++ ) {
+			out << ( ai > 0 ? " |" : "" );
+			vector<string> elements;
+			for( size_t ei = 0; ei < params.Length; ei++ ) {
+				elements.push_back( main.Value( elementDistribution( random ) )
+					+ to_string( ei + 1 ) );
+				out << " " << elements.back();
+			}
+			if( depth > 0 ) {
+				out << " " << SyntheticPatternName( pi - 1 );
+			}
+			if( params.Agreement && elements.size() > 1 ) {
+				out << " <<" << elements[0] << "=" << elements[1] << ">>";
+			}
+		}
+		out << endl;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef chrono::steady_clock CClock;
+
+class CStopwatch {
+public:
+	CStopwatch() : start( CClock::now() ) {}
+
+	double Seconds() const
+	{
+		return chrono::duration<double>( CClock::now() - start ).count();
+	}
+
+private:
+	CClock::time_point start;
+};
+
+// Returns peak resident set size of the process in kilobytes.
+size_t PeakMemoryUsage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) ) {
+		return counters.PeakWorkingSetSize / 1024;
+	}
+	return 0;
+#else
+	rusage usage;
+	if( getrusage( RUSAGE_SELF, &usage ) != 0 ) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return static_cast<size_t>( usage.ru_maxrss ) / 1024;
+#else
+	return static_cast<size_t>( usage.ru_maxrss );
+#endif
+#endif
+}
+
+void PrintStage( const char* name, const double seconds )
+{
+	cout << "  " << left << setw( 20 ) << name << right
+		<< fixed << setprecision( 3 ) << setw( 10 ) << seconds << " s" << endl;
+}
+
+// Removes generated files when the benchmark exits by any path,
+// unless they are kept.
+class CGeneratedFiles {
+	CGeneratedFiles( const CGeneratedFiles& ) = delete;
+	CGeneratedFiles& operator=( const CGeneratedFiles& ) = delete;
+
+public:
+	explicit CGeneratedFiles( const bool _keep ) : keep( _keep ) {}
+	~CGeneratedFiles();
+
+	// the file is removed even if it is written only in part
+	void Add( const string& filename ) { filenames.push_back( filename ); }
+
+private:
+	const bool keep;
+	vector<string> filenames;
+};
+
+CGeneratedFiles::~CGeneratedFiles()
+{
+	if( !keep ) {
+		for( const string& filename : filenames ) {
+			remove( filename.c_str() );
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+class CCountingCallback : public IRecognitionCallback {
+public:
+	size_t Recognitions;
+
+	CCountingCallback() : Recognitions( 0 ) {}
+
+	void OnRecognized( const TWordIndex, const TWordIndex, const CText&,
+		const CData&, const CVariantParts& ) override
+	{
+		Recognitions++;
+	}
+};
+
+int RunBenchmark( const CBenchmarkParameters& params )
+{
+	CStopwatch configurationTime;
+	CConfigurationPtr conf;
+	{
+		ostringstream out;
+		conf = LoadConfiguration( params.Configuration, out, cerr );
+		if( !static_cast<bool>( conf ) ) {
+			return 1;
+		}
+	}
+	const double configurationSeconds = configurationTime.Seconds();
+
+	CGeneratedFiles generatedFiles( params.Keep );
+	string textFile = params.Text;
+	double generateSeconds = 0;
+	if( textFile.empty() ) {
+		textFile = params.Prefix
+			+ ( params.Format == TFF_Tsv ? ".tsv" : ".json" );
+		CStopwatch generateTime;
+		generatedFiles.Add( textFile );
+		ofstream out( textFile );
+		CCorpusGenerator generator( *conf, params.Corpus );
+		generator.Generate( out, params.Format );
+		if( !out ) {
+			cerr << "Cannot write file '" << textFile << "'" << endl;
+			return 1;
+		}
+		generateSeconds = generateTime.Seconds();
+	}
+
+	string patternsFile = params.Patterns;
+	if( patternsFile.empty() ) {
+		patternsFile = params.Prefix + ".txt";
+		generatedFiles.Add( patternsFile );
+		ofstream out( patternsFile );
+		GeneratePatterns( *conf, params, out );
+		if( !out ) {
+			cerr << "Cannot write file '" << patternsFile << "'" << endl;
+			return 1;
+		}
+	}
+
+	CText text( conf );
+	CStopwatch textTime;
+	if( !text.LoadFromFile( textFile, cerr ) ) {
+		return 1;
+	}
+	const double textSeconds = textTime.Seconds();
+
+	CStopwatch parseTime;
+	const unique_ptr<const CPatterns> loadedPatterns
+		= LoadPatterns( conf, patternsFile, cerr );
+	if( !static_cast<bool>( loadedPatterns ) ) {
+		return 1;
+	}
+	const CPatterns& patterns = *loadedPatterns;
+	const double parseSeconds = parseTime.Seconds();
+
+	double matchSeconds = 0;
+	size_t variantsCount = 0;
+	size_t statesCount = 0;
+	size_t scannedCount = 0;
+	CCountingCallback callback;
+	CSpanAutomata spans( params.MaxVariantSize );
+	CChart chart( text, spans );
+	CPatternAutomata automata;
+	// variants are streamed into the automaton as they are built,
+	// so the stages overlap and the total time is measured
+	CStopwatch buildTime;
+	BuildPatterns( patterns, params.MaxVariantSize,
+		params.Chart ? &spans : nullptr, params.Threads, automata );
+	const double buildSeconds = buildTime.Seconds();
+	for( const CPatternAutomaton& automaton : automata ) {
+		variantsCount += automaton.VariantsCount;
+		statesCount += automaton.States.size();
+	}
+
+	CStopwatch classesTime;
+	CWordClasses wordClasses;
+	if( params.Classes ) {
+		BuildWordClasses( automata, spans, text, wordClasses );
+		chart.SetWordClasses( &wordClasses );
+	}
+	const double classesSeconds = classesTime.Seconds();
+
+	for( const CPatternAutomaton& automaton : automata ) {
+		CMatchContext matchContext( text, automaton.States );
+		matchContext.SetRecognitionCallback( &callback );
+		matchContext.SetPolicy( params.Policy );
+		matchContext.SetLimit( params.Limit );
+		matchContext.SetWordClasses( params.Classes ? &wordClasses : nullptr );
+		if( params.Chart ) {
+			matchContext.SetChart( &chart );
+		}
+		CStopwatch matchTime;
+		if( MatchText( matchContext ) ) {
+			scannedCount++;
+		}
+		matchSeconds += matchTime.Seconds();
+	}
+
+	cout << "Text: " << textFile << " (" << text.Length() << " words, "
+		<< text.AnnotationSets().Size() << " annotation sets)" << endl
+		<< "Patterns: " << patternsFile
+		<< " (" << patterns.Size() << " patterns)" << endl
+		<< "Stages:" << endl;
+	PrintStage( "configuration", configurationSeconds );
+	if( !params.Text.empty() ) {
+		PrintStage( "text loading", textSeconds );
+	} else {
+		PrintStage( "text generation", generateSeconds );
+		PrintStage( "text loading", textSeconds );
+	}
+	PrintStage( "patterns parsing", parseSeconds );
+	PrintStage( "patterns building", buildSeconds );
+	if( params.Classes ) {
+		PrintStage( "word classes", classesSeconds );
+	}
+	PrintStage( "matching", matchSeconds );
+
+	// every pattern is matched over the whole text
+	const double words = static_cast<double>( text.Length() );
+	const double patternWords = words * patterns.Size();
+	cout << "Variants: " << variantsCount << endl
+		<< "States: " << statesCount << endl
+		<< "Scanned patterns: " << scannedCount << endl;
+	if( params.Classes ) {
+		cout << "Word classes: " << wordClasses.Size() << " classes of "
+			<< wordClasses.Restrictions() << " restrictions" << endl;
+	}
+	if( params.Chart ) {
+		size_t spanStates = 0;
+		for( TSpan span = 0; span < spans.Size(); span++ ) {
+			if( spans.Status( span ) == CSpanAutomata::S_Built ) {
+				spanStates += spans.Automaton( span ).States.size();
+			}
+		}
+		cout << "Chart: " << spans.Size() << " referenced patterns, "
+			<< spanStates << " states, " << chart.Size() << " entries" << endl;
+	}
+	cout << "Recognitions: " << callback.Recognitions << endl
+		<< "Matching speed: " << fixed << setprecision( 0 )
+		<< ( matchSeconds > 0 ? words / matchSeconds : 0.0 )
+		<< " words/s of the text, "
+		<< ( matchSeconds > 0 ? patternWords / matchSeconds : 0.0 )
+		<< " pattern-words/s (words times patterns)" << endl
+		<< "Peak memory usage: " << PeakMemoryUsage() << " KB" << endl;
+	return 0;
+}
+
+} // end of anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+int main( int argc, const char* argv[] )
+{
+	try {
+		CBenchmarkParameters params;
+		if( !ParseArguments( argc, argv, params, cerr ) ) {
+			return 1;
+		}
+		return RunBenchmark( params );
+	} catch( exception& e ) {
+		cerr << e.what() << endl;
+		return 1;
+	} catch( ... ) {
+		cerr << "unknown error!";
+		return 1;
+	}
+}
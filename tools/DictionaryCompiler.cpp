@@ -0,0 +1,60 @@
+#include <common.h>
+#include <Dictionary.h>
+
+using namespace Lspl;
+using namespace Lspl::Configuration;
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const char* const Usage =
+	"Usage: lspl3-dictionary SOURCE IMAGE\n"
+	"Compiles dictionary SOURCE (an entry per line, arguments are separated\n"
+	"by tabs, words of an argument are separated by spaces) to binary IMAGE\n"
+	"which is memory mapped by lspl3 instead of parsing the source.\n";
+
+} // end of anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+int main( int argc, const char* argv[] )
+{
+	try {
+		if( argc != 3 ) {
+			cerr << Usage;
+			return 1;
+		}
+
+		vector<uint64_t> image;
+		if( !CDictionary::Compile( argv[1], image, cerr ) ) {
+			return 1;
+		}
+
+		ofstream out( argv[2], ios::out | ios::binary );
+		out.write( reinterpret_cast<const char*>( image.data() ),
+			image.size() * sizeof( uint64_t ) );
+		out.close();
+		if( !out.good() ) {
+			cerr << "Cannot write dictionary image '" << argv[2] << "'" << endl;
+			return 1;
+		}
+
+		CDictionary dictionary( "image", 0 );
+		if( !dictionary.LoadFromFile( argv[2], cerr ) ) {
+			return 1;
+		}
+		cout << "entries: " << dictionary.Size()
+			<< ", arguments: " << dictionary.Arguments()
+			<< ", nodes: " << dictionary.Nodes()
+			<< ", words: " << dictionary.Tokens()
+			<< ", size: " << image.size() * sizeof( uint64_t ) << endl;
+	} catch( exception& e ) {
+		cerr << e.what() << endl;
+		return 1;
+	} catch( ... ) {
+		cerr << "unknown error!";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,97 @@
+#include <common.h>
+#include <Configuration.h>
+#include <ToolOptions.h>
+
+using namespace Lspl;
+using namespace Lspl::Text;
+using namespace Lspl::Configuration;
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const char* const Usage =
+	"Usage: lspl3-generator [OPTIONS] CONFIGURATION TEXT\n"
+	"Writes synthetic annotated text, TEXT \"cout\" selects the standard output.\n"
+	"Options:\n"
+	"  --format=json|tsv     format of the text, by default \"*.tsv\" files\n"
+	"                        are written in TSV and other ones in JSON\n";
+
+const size_t OutputBufferSize = 1 << 20;
+
+} // end of anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+int main( int argc, const char* argv[] )
+{
+	try {
+		CCorpusParameters params;
+		vector<string> arguments;
+		TTextFileFormat format = TFF_Json;
+		bool formatDefined = false;
+		for( int i = 1; i < argc; i++ ) {
+			const string arg = argv[i];
+			string name;
+			string value;
+			if( !SplitOption( arg, name, value ) ) {
+				arguments.push_back( arg );
+				continue;
+			}
+
+			bool valid = true;
+			if( ParseCorpusOption( name, value, params, valid ) ) {
+				// option of generated text
+			} else if( name == "format" ) {
+				valid = ( value == "json" || value == "tsv" );
+				format = ( value == "tsv" ) ? TFF_Tsv : TFF_Json;
+				formatDefined = true;
+			} else {
+				cerr << "Unknown option '" << arg << "'" << endl;
+				return 1;
+			}
+			if( !valid ) {
+				cerr << "Invalid value of option '" << arg << "'" << endl;
+				return 1;
+			}
+		}
+
+		if( arguments.size() != 2 ) {
+			cerr << Usage << CorpusOptionsUsage;
+			return 1;
+		}
+
+		CConfigurationPtr conf( new CConfiguration );
+		{
+			ostringstream out;
+			if( !conf->LoadFromFile( arguments[0].c_str(), out, cerr ) ) {
+				return 1;
+			}
+		}
+
+		CCorpusGenerator generator( *conf, params );
+		const string& textFile = arguments[1];
+		if( textFile == "cout" ) {
+			generator.Generate( cout, format );
+		} else {
+			vector<char> buffer( OutputBufferSize );
+			ofstream out;
+			out.rdbuf()->pubsetbuf( buffer.data(), buffer.size() );
+			out.open( textFile, ios::out | ios::binary );
+			generator.Generate( out,
+				formatDefined ? format : TextFileFormat( textFile ) );
+			out.close();
+			if( !out ) {
+				cerr << "Cannot write text '" << textFile << "'" << endl;
+				return 1;
+			}
+		}
+	} catch( exception& e ) {
+		cerr << e.what() << endl;
+		return 1;
+	} catch( ... ) {
+		cerr << "unknown error!";
+		return 1;
+	}
+	return 0;
+}
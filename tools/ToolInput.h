@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Parser.h>
+#include <Configuration.h>
+#include <ErrorProcessor.h>
+
+// Loading of input files of command line tools and tests
+
+///////////////////////////////////////////////////////////////////////////////
+
+// loads the configuration and sets the agreement attributes of annotations,
+// returns nullptr if the configuration cannot be loaded
+inline Lspl::Configuration::CConfigurationPtr LoadConfiguration(
+	const string& filename, ostream& out, ostream& err )
+{
+	Lspl::Configuration::CConfigurationPtr configuration(
+		new Lspl::Configuration::CConfiguration );
+	if( !configuration->LoadFromFile( filename.c_str(), out, err ) ) {
+		return Lspl::Configuration::CConfigurationPtr();
+	}
+	Lspl::Text::CAnnotation::SetArgreementBegin( configuration->Attributes() );
+	return configuration;
+}
+
+// reads and checks patterns, errors are printed to err,
+// returns nullptr if the patterns have errors
+inline unique_ptr<const Lspl::Pattern::CPatterns> LoadPatterns(
+	const Lspl::Configuration::CConfigurationPtr& configuration,
+	const string& filename, ostream& err )
+{
+	Lspl::Parser::CErrorProcessor errorProcessor;
+	Lspl::Parser::CPatternsBuilder patternsBuilder( configuration,
+		errorProcessor );
+	patternsBuilder.ReadFromFile( filename );
+	patternsBuilder.CheckAndBuildIfPossible();
+	if( errorProcessor.HasAnyErrors() ) {
+		errorProcessor.PrintErrors( err, filename );
+		return unique_ptr<const Lspl::Pattern::CPatterns>();
+	}
+	return unique_ptr<const Lspl::Pattern::CPatterns>(
+		new Lspl::Pattern::CPatterns( patternsBuilder.GetResult() ) );
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <CorpusGenerator.h>
+
+// Options of command line tools in the form --name=value
+
+///////////////////////////////////////////////////////////////////////////////
+
+inline bool ParseSize( const string& value, size_t& size )
+{
+	if( value.empty() || value.find_first_not_of( "0123456789" ) != string::npos ) {
+		return false;
+	}
+	size = static_cast<size_t>( stoull( value ) );
+	return true;
+}
+
+inline bool ParseProbability( const string& value, double& probability )
+{
+	istringstream stream( value );
+	return ( stream >> probability ) && stream.eof()
+		&& probability >= 0 && probability <= 1;
+}
+
+// splits --name=value, returns false if the argument is not an option
+inline bool SplitOption( const string& arg, string& name, string& value )
+{
+	if( arg.compare( 0, 2, "--" ) != 0 ) {
+		return false;
+	}
+	const size_t equal = arg.find( '=' );
+	name = arg.substr( 2, equal - 2 );
+	value = ( equal == string::npos ) ? "" : arg.substr( equal + 1 );
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const char* const CorpusOptionsUsage =
+	"  --words=N             number of words in generated text\n"
+	"  --lemmas=N            number of lemmas in generated text\n"
+	"  --forms=N             number of word forms of each lemma\n"
+	"  --annotations=N       maximum number of annotations per word\n"
+	"  --ambiguity=P         probability of each additional annotation\n"
+	"  --homonymy=P          probability of other speech part in additional annotation\n"
+	"  --zipf=S              exponent of Zipf's law of lemma frequencies\n"
+	"  --correlation=P       probability of agreement with the previous word\n"
+	"  --seed=N              seed of random generator\n";
+
+// returns false if the option is unknown, sets valid to false if its value is bad
+inline bool ParseCorpusOption( const string& name, const string& value,
+	Lspl::Text::CCorpusParameters& params, bool& valid )
+{
+	size_t size = 0;
+	if( name == "ambiguity" ) {
+		valid = ParseProbability( value, params.Ambiguity );
+	} else if( name == "homonymy" ) {
+		valid = ParseProbability( value, params.Homonymy );
+	} else if( name == "correlation" ) {
+		valid = ParseProbability( value, params.Correlation );
+	} else if( name == "zipf" ) {
+		istringstream stream( value );
+		valid = ( stream >> params.ZipfExponent ) && stream.eof()
+			&& params.ZipfExponent >= 0;
+	} else if( name == "words" ) {
+		valid = ParseSize( value, params.Words );
+	} else if( name == "lemmas" ) {
+		valid = ParseSize( value, params.Lemmas ) && params.Lemmas > 0;
+	} else if( name == "forms" ) {
+		valid = ParseSize( value, params.Forms ) && params.Forms > 0;
+	} else if( name == "annotations" ) {
+		valid = ParseSize( value, params.MaxAnnotations )
+			&& params.MaxAnnotations > 0
+			&& params.MaxAnnotations <= Lspl::Text::MaxAnnotation;
+	} else if( name == "seed" ) {
+		valid = ParseSize( value, size );
+		params.Seed = static_cast<uint32_t>( size );
+	} else {
+		return false;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////